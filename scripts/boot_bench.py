@@ -0,0 +1,72 @@
+# Time to first request after a power cut. For each round, cut the unit's
+# power, restore it and press Enter; the script then polls
+# /api/system/uptime every 100 ms until the device answers and prints the
+# boot phases it reports (ms since the firmware started; first_request is
+# this script's first successful request). The wall time from Enter to
+# the first answer is shown too, which includes the bootloader and the
+# reconnect to the access point.
+#   python scripts/boot_bench.py <device ip> [rounds]
+
+import http.client
+import json
+import statistics
+import sys
+import time
+
+PHASES = ["fs_mounted", "config_loaded", "server_started", "first_request", "wifi_connected", "clock_set", "ready"]
+
+
+def uptime(host):
+    conn = http.client.HTTPConnection(host, timeout=0.5)
+    try:
+        conn.request("GET", "/api/system/uptime")
+        resp = conn.getresponse()
+        return json.loads(resp.read()) if resp.status == 200 else None
+    except (OSError, http.client.HTTPException, ValueError):
+        return None
+    finally:
+        conn.close()
+
+
+def wait_ready(host, timeout):
+    """Polls until the boot phases through ready are in, or timeout s."""
+    start = time.monotonic()
+    first = None
+    boot = None
+    while time.monotonic() - start < timeout:
+        status = uptime(host)
+        if status:
+            if first is None:
+                first = (time.monotonic() - start) * 1000
+            boot = status["boot"]
+            if boot.get("ready") is not None:
+                break
+        time.sleep(0.1)
+    return first, boot
+
+
+def bench(host, rounds):
+    runs = []
+    for i in range(rounds):
+        input("[boot_bench] round %d/%d: cut the power, restore it, then press Enter " % (i + 1, rounds))
+        wall, boot = wait_ready(host, 240)
+        if boot is None:
+            print("[boot_bench] no answer within 240 s")
+            continue
+        runs.append((wall, boot))
+        print("    answered after %.0f ms wall time; %s" %
+              (wall, ", ".join("%s %s" % (p, boot.get(p)) for p in PHASES)))
+    if not runs:
+        return
+    print("%-16s %8s %8s" % ("phase", "median", "max"))
+    for phase in PHASES:
+        ms = [b[phase] for _, b in runs if b.get(phase) is not None]
+        if ms:
+            print("%-16s %8.0f %8d" % (phase, statistics.median(ms), max(ms)))
+    print("%-16s %8.0f %8.0f" % ("wall", statistics.median(w for w, _ in runs), max(w for w, _ in runs)))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: boot_bench.py <device ip> [rounds]")
+    bench(sys.argv[1], int(sys.argv[2]) if len(sys.argv) > 2 else 3)
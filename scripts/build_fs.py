@@ -0,0 +1,76 @@
+# PlatformIO pre-script: stages data/ into .pio/fsdata for the LittleFS
+# image (buildfs/uploadfs).
+#  - Text assets under data/UI are stored gzipped as <name>.gz only; the
+#    firmware serves them with Content-Encoding: gzip.
+#  - Links to css/ and assets/ in the HTML get a ?v=<etag> suffix so those
+#    files can be cached for a year and still change with a new image.
+#  - UI/etags.txt lists a strong ETag ("<path> <etag>") for every UI file.
+# Also runs standalone: python scripts/build_fs.py [data_dir] [out_dir]
+
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import sys
+
+GZIP_EXT = (".html", ".css", ".js", ".svg", ".json")
+ASSET_LINK = re.compile(r'((?:href|src)=")(/?)((?:css|assets)/[^"?#]+)(")')
+
+
+def etag_of(data):
+    return hashlib.sha1(data).hexdigest()[:16]
+
+
+def stage(data_dir, out_dir):
+    if os.path.isdir(out_dir):
+        shutil.rmtree(out_dir)
+    shutil.copytree(data_dir, out_dir, ignore=shutil.ignore_patterns("UI"))
+
+    ui_src = os.path.join(data_dir, "UI")
+    files = []
+    for root, _, names in os.walk(ui_src):
+        for name in sorted(names):
+            files.append(os.path.relpath(os.path.join(root, name), ui_src).replace(os.sep, "/"))
+    # Assets first, so the HTML can link to their ETags
+    files.sort(key=lambda f: (f.endswith(".html"), f))
+
+    etags = {}
+    total_in = total_out = 0
+    for rel in files:
+        with open(os.path.join(ui_src, rel), "rb") as f:
+            data = f.read()
+        total_in += len(data)
+        if rel.endswith(".html"):
+            def versioned(m):
+                tag = etags.get(m.group(3))
+                return m.group(0) if tag is None else "%s%s%s?v=%s%s" % (m.group(1), m.group(2), m.group(3), tag, m.group(4))
+            data = ASSET_LINK.sub(versioned, data.decode("utf-8")).encode("utf-8")
+
+        out_rel = rel
+        if rel.endswith(GZIP_EXT):
+            data = gzip.compress(data, 9, mtime=0)  # mtime=0 keeps the image reproducible
+            out_rel = rel + ".gz"
+        etags[rel] = etag_of(data)
+        total_out += len(data)
+
+        dest = os.path.join(out_dir, "UI", out_rel)
+        os.makedirs(os.path.dirname(dest), exist_ok=True)
+        with open(dest, "wb") as f:
+            f.write(data)
+
+    with open(os.path.join(out_dir, "UI", "etags.txt"), "w") as f:
+        for rel in files:
+            f.write("/UI/%s %s\n" % (rel, etags[rel]))
+    print("[build_fs] %d UI files, %d -> %d bytes" % (len(files), total_in, total_out))
+
+
+if __name__ == "__main__":
+    stage(sys.argv[1] if len(sys.argv) > 1 else "data",
+          sys.argv[2] if len(sys.argv) > 2 else os.path.join(".pio", "fsdata"))
+else:
+    Import("env")  # noqa: F821 (provided by PlatformIO)
+    if any(t in COMMAND_LINE_TARGETS for t in ("buildfs", "uploadfs", "uploadfsota")):  # noqa: F821
+        out = os.path.join(env.subst("$PROJECT_DIR"), ".pio", "fsdata")  # noqa: F821
+        stage(env.subst("$PROJECT_DATA_DIR"), out)  # noqa: F821
+        env.Replace(PROJECT_DATA_DIR=out)  # noqa: F821
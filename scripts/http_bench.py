@@ -0,0 +1,91 @@
+# Load test for the device's web server: several clients at once, each
+# repeating the requests the Troubleshooting page makes when it opens.
+# Reports latency per endpoint and the loop() profile over the run, which
+# shows whether serving the clients held up stepping and scheduling.
+#   python scripts/http_bench.py <device ip> [clients] [rounds]
+
+import http.client
+import json
+import statistics
+import sys
+import threading
+import time
+
+PAGE_REQUESTS = [
+    "/api/system/memory",
+    "/api/system/uptime",
+    "/api/config",
+    "/api/check_update",
+    "/api/events?limit=200&after=0",
+]
+
+
+def get(conn, path):
+    start = time.monotonic()
+    conn.request("GET", path)
+    resp = conn.getresponse()
+    body = resp.read()
+    return resp.status, body, (time.monotonic() - start) * 1000
+
+
+def client(host, rounds, results, errors):
+    conn = http.client.HTTPConnection(host, timeout=10)
+    for _ in range(rounds):
+        for path in PAGE_REQUESTS:
+            try:
+                status, _, ms = get(conn, path)
+                if status != 200:
+                    errors.append("%s: %d" % (path, status))
+                results.setdefault(path, []).append(ms)
+            except (OSError, http.client.HTTPException) as e:
+                errors.append("%s: %s" % (path, e))
+                conn.close()
+                conn = http.client.HTTPConnection(host, timeout=10)
+    conn.close()
+
+
+def profile(host, reset):
+    conn = http.client.HTTPConnection(host, timeout=10)
+    status, body, _ = get(conn, "/api/system/profile" + ("?reset=1" if reset else ""))
+    conn.close()
+    return json.loads(body) if status == 200 else None
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def bench(host, clients, rounds):
+    profile(host, True)
+    results = [dict() for _ in range(clients)]
+    errors = []
+    threads = [threading.Thread(target=client, args=(host, rounds, results[i], errors)) for i in range(clients)]
+    start = time.monotonic()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - start
+    loop = profile(host, False)
+
+    print("[http_bench] %d clients x %d rounds x %d requests in %.1f s" % (clients, rounds, len(PAGE_REQUESTS), elapsed))
+    print("%-32s %6s %8s %8s %8s" % ("endpoint", "n", "p50 ms", "p95 ms", "max ms"))
+    for path in PAGE_REQUESTS:
+        ms = [v for r in results for v in r.get(path, [])]
+        if ms:
+            print("%-32s %6d %8.1f %8.1f %8.1f" % (path, len(ms), statistics.median(ms), percentile(ms, 95), max(ms)))
+    print("[http_bench] %d errors%s" % (len(errors), ": " + "; ".join(errors[:5]) if errors else ""))
+    if loop:
+        print("[http_bench] loop(): %d passes, mean %d us, max %d us" %
+              (loop["loop"]["count"], loop["loop"]["mean_us"], loop["loop"]["max_us"]))
+        for name, s in loop["sections"].items():
+            print("    %-14s max %6d us" % (name, s["max_us"]))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: http_bench.py <device ip> [clients] [rounds]")
+    bench(sys.argv[1],
+          int(sys.argv[2]) if len(sys.argv) > 2 else 5,
+          int(sys.argv[3]) if len(sys.argv) > 3 else 20)
@@ -0,0 +1,39 @@
+# Prepares the OTA files for upload next to version.txt:
+#   firmware.bin.gz      gzipped firmware; the bootloader inflates it
+#   littlefs.bin         filesystem image (written as is)
+#   <file>.md5           MD5 of each file, checked after flashing
+# Run after `platformio run` and `platformio run --target buildfs`:
+#   python scripts/ota_release.py [build_dir] [out_dir]
+
+import gzip
+import hashlib
+import os
+import shutil
+import sys
+
+
+def write_md5(path):
+    with open(path, "rb") as f:
+        digest = hashlib.md5(f.read()).hexdigest()
+    with open(path + ".md5", "w") as f:
+        f.write("%s  %s\n" % (digest, os.path.basename(path)))
+    return digest
+
+
+def release(build_dir, out_dir):
+    os.makedirs(out_dir, exist_ok=True)
+    with open(os.path.join(build_dir, "firmware.bin"), "rb") as f:
+        firmware = f.read()
+    fw_out = os.path.join(out_dir, "firmware.bin.gz")
+    with open(fw_out, "wb") as f:
+        f.write(gzip.compress(firmware, 9, mtime=0))
+    fs_out = os.path.join(out_dir, "littlefs.bin")
+    shutil.copyfile(os.path.join(build_dir, "littlefs.bin"), fs_out)
+    for path in (fw_out, fs_out):
+        print("[ota_release] %s %d bytes, MD5 %s" % (path, os.path.getsize(path), write_md5(path)))
+    print("[ota_release] firmware %d -> %d bytes" % (len(firmware), os.path.getsize(fw_out)))
+
+
+if __name__ == "__main__":
+    release(sys.argv[1] if len(sys.argv) > 1 else os.path.join(".pio", "build", "d1mini"),
+            sys.argv[2] if len(sys.argv) > 2 else os.path.join(".pio", "ota"))
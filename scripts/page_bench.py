@@ -0,0 +1,115 @@
+# Bytes on the wire and time to first byte for each UI page, loaded the way
+# a browser does: the page, then the css/ and assets/ files it links.
+#  - first visit: nothing cached, every file is downloaded
+#  - revisit: the page is revalidated with If-None-Match (a 304), and the
+#    versioned assets come from the browser cache without a request
+# Bytes are counted on the socket, headers included.
+#   python scripts/page_bench.py <device ip> [rounds]
+#   python scripts/page_bench.py --offline [data_dir]
+# --offline needs no device: it stages data/ with build_fs.py and compares
+# the body bytes per page load against serving data/UI as it is.
+
+import gzip
+import os
+import re
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+PAGES = ["/index.html", "/windnow.html", "/setschedule.html", "/troubleshooting.html"]
+LINK = re.compile(r'(?:href|src)="/?((?:css|assets)/[^"#]+)"')
+
+
+def fetch(sock, host, path, etag=None):
+    """One GET on a kept-alive socket: (status, headers, body, wire bytes, ttfb ms)."""
+    req = "GET %s HTTP/1.1\r\nHost: %s\r\nAccept-Encoding: gzip\r\n" % (path, host)
+    if etag:
+        req += "If-None-Match: %s\r\n" % etag
+    start = time.monotonic()
+    sock.sendall((req + "\r\n").encode())
+    data = sock.recv(4096)
+    ttfb = (time.monotonic() - start) * 1000
+    while b"\r\n\r\n" not in data:
+        data += sock.recv(4096)
+    head, _, body = data.partition(b"\r\n\r\n")
+    lines = head.decode("latin-1").split("\r\n")
+    status = int(lines[0].split()[1])
+    headers = {k.strip().lower(): v.strip() for k, _, v in (l.partition(":") for l in lines[1:])}
+    length = int(headers.get("content-length", "0")) if status != 304 else 0
+    while len(body) < length:
+        chunk = sock.recv(4096)
+        if not chunk:
+            break
+        body += chunk
+    return status, headers, body, len(head) + 4 + len(body), ttfb
+
+
+def load_page(host, page, etags):
+    """Loads page and its assets; etags holds what the browser has cached."""
+    sock = socket.create_connection((host, 80), timeout=10)
+    status, headers, body, wire, ttfb = fetch(sock, host, page, etags.get(page))
+    if status == 200:
+        etags[page] = headers.get("etag")
+        html = gzip.decompress(body) if headers.get("content-encoding") == "gzip" else body
+        etags[page + " assets"] = LINK.findall(html.decode("utf-8", "replace"))
+    total = wire
+    for asset in etags.get(page + " assets", []):
+        if asset in etags:
+            continue  # immutable, still cached
+        _, h, _, w, _ = fetch(sock, host, "/" + asset)
+        etags[asset] = h.get("etag", "")
+        total += w
+    sock.close()
+    return status, total, ttfb
+
+
+def bench(host, rounds):
+    print("%-24s %10s %10s %12s %12s" % ("page", "first B", "revisit B", "first ttfb", "revisit ttfb"))
+    for page in PAGES:
+        first, revisit, ttfb_first, ttfb_revisit = [], [], [], []
+        for _ in range(rounds):
+            etags = {}
+            _, b, t = load_page(host, page, etags)
+            first.append(b)
+            ttfb_first.append(t)
+            status, b, t = load_page(host, page, etags)
+            revisit.append(b)
+            ttfb_revisit.append(t)
+        print("%-24s %10d %10d %9.1f ms %9.1f ms%s" % (page, statistics.median(first), statistics.median(revisit),
+              statistics.median(ttfb_first), statistics.median(ttfb_revisit), "" if status == 304 else "  (no 304)"))
+
+
+def offline(data_dir):
+    build_fs = os.path.join(os.path.dirname(os.path.abspath(__file__)), "build_fs.py")
+
+    def size(root, rel):
+        for name in (rel, rel + ".gz"):
+            if os.path.exists(os.path.join(root, name)):
+                return os.path.getsize(os.path.join(root, name))
+        return 0
+
+    with tempfile.TemporaryDirectory() as out:
+        subprocess.run([sys.executable, build_fs, data_dir, out], check=True)
+        ui_raw = os.path.join(data_dir, "UI")
+        ui_out = os.path.join(out, "UI")
+        # Body bytes only: before, every navigation sends all of it again;
+        # a revisit now costs a 304 without a body
+        print("%-24s %12s %12s %12s" % ("page", "before B", "first B", "revisit B"))
+        for page in PAGES:
+            rel = page.lstrip("/")
+            with open(os.path.join(ui_raw, rel), encoding="utf-8") as f:
+                assets = LINK.findall(f.read())
+            before = size(ui_raw, rel) + sum(size(ui_raw, a) for a in assets)
+            first = size(ui_out, rel) + sum(size(ui_out, a) for a in assets)
+            print("%-24s %12d %12d %12d" % (page, before, first, 0))
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: page_bench.py <device ip> [rounds] | --offline [data_dir]")
+    if sys.argv[1] == "--offline":
+        offline(sys.argv[2] if len(sys.argv) > 2 else "data")
+    else:
+        bench(sys.argv[1], int(sys.argv[2]) if len(sys.argv) > 2 else 5)
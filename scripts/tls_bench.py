@@ -0,0 +1,138 @@
+# Cold versus warm cost of the device's outbound HTTPS requests, against a
+# local TLS stand-in for the version check. Serves version.txt over HTTPS
+# on :8443 (self-signed, made with openssl) and has the device check it
+# repeatedly through /api/check_update?refresh=1:
+#  - cold: after the shared connection's 20 s idle timeout, so each check
+#    opens a new TLS connection (resuming the previous session if it can)
+#  - warm: right after a check, on the kept-alive connection
+# For each it reports the ms to the response headers and whether the
+# session was resumed (from /api/system/network), handshakes seen by the
+# stand-in, and the heap the check used (the "ota" tag and low-water mark
+# from /api/system/memory).
+# Build the firmware with
+#   -DOTA_VERSION_URL='"https://<this pc>:8443/version.txt"'
+# then run
+#   python scripts/tls_bench.py <device ip> [rounds]
+
+import http.client
+import http.server
+import json
+import os
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+PORT = 8443
+IDLE_S = 22  # HTTP_IDLE_MS plus a poll
+
+handshakes = {"full": 0, "resumed": 0}
+
+
+class VersionHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive
+
+    def setup(self):
+        super().setup()
+        handshakes["resumed" if self.connection.session_reused else "full"] += 1
+
+    def do_GET(self):
+        body = b"0.0.0-bench\n"
+        self.send_response(200)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+
+def serve(tmp):
+    cert, key = os.path.join(tmp, "cert.pem"), os.path.join(tmp, "key.pem")
+    subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1", "-subj", "/CN=tls-bench",
+                    "-keyout", key, "-out", cert], check=True, capture_output=True)
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    ctx.maximum_version = ssl.TLSVersion.TLSv1_2  # what BearSSL on the ESP8266 speaks
+    ctx.load_cert_chain(cert, key)
+    server = http.server.ThreadingHTTPServer(("0.0.0.0", PORT), VersionHandler)
+    server.socket = ctx.wrap_socket(server.socket, server_side=True)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+
+def api(host, path):
+    conn = http.client.HTTPConnection(host, timeout=10)
+    conn.request("GET", path)
+    resp = conn.getresponse()
+    body = resp.read()
+    conn.close()
+    return json.loads(body)
+
+
+def check(host):
+    """One version check on the device; returns the counters it moved."""
+    net = api(host, "/api/system/network")["http"]
+    api(host, "/api/system/memory?reset=1")
+    seen = dict(handshakes)
+    api(host, "/api/check_update?refresh=1")
+    deadline = time.monotonic() + 30
+    while time.monotonic() < deadline:
+        time.sleep(0.5)
+        status = api(host, "/api/check_update")
+        if not status["checking"]:
+            break
+    after = api(host, "/api/system/network")["http"]
+    mem = api(host, "/api/system/memory")
+    connects = after["connects"] - net["connects"]
+    reused = after["reused"] - net["reused"]
+    # The API reports running means in whole ms; this recovers the
+    # request's own time from them to within a few ms
+    if connects:
+        ms = after["cold_ms"] * after["connects"] - net["cold_ms"] * net["connects"]
+    else:
+        ms = after["warm_ms"] * after["reused"] - net["warm_ms"] * net["reused"]
+    return {
+        "code": status["last_code"],
+        "connects": connects,
+        "reused": reused,
+        "resumed": after["resumed"] - net["resumed"],
+        "ms": ms,
+        "full": handshakes["full"] - seen["full"],
+        "ota_peak": mem["tags"]["ota"]["peak"],
+        "min_free": mem["min_free_memory"],
+        "min_block": mem["min_max_free_block"],
+    }
+
+
+def report(name, runs):
+    if not runs:
+        return
+    n = len(runs)
+    print("%-5s %3d checks  %6.0f ms to headers  %d/%d resumed  %d full handshakes  ota peak %5d B" %
+          (name, n, sum(r["ms"] for r in runs) / n, sum(r["resumed"] for r in runs), sum(r["connects"] for r in runs),
+           sum(r["full"] for r in runs), max(r["ota_peak"] for r in runs)))
+
+
+def bench(host, rounds):
+    with tempfile.TemporaryDirectory() as tmp:
+        serve(tmp)
+        cold, warm = [], []
+        check(host)  # first contact: full handshake, MFLN probe
+        for i in range(rounds):
+            time.sleep(IDLE_S)
+            cold.append(check(host))
+            warm.append(check(host))
+            print("[tls_bench] round %d: cold %d ms (%s), warm %d ms" %
+                  (i + 1, cold[-1]["ms"], "resumed" if cold[-1]["resumed"] else "full handshake", warm[-1]["ms"]))
+        bad = [r for r in cold + warm if r["code"] != 200]
+        report("cold", [r for r in cold if r["connects"]])
+        report("warm", [r for r in warm if r["reused"]])
+        print("[tls_bench] heap low water since boot %d B, smallest largest block %d B, %d failed checks" %
+              (min(r["min_free"] for r in cold + warm), min(r["min_block"] for r in cold + warm), len(bad)))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: tls_bench.py <device ip> [rounds]")
+    bench(sys.argv[1], int(sys.argv[2]) if len(sys.argv) > 2 else 5)
@@ -0,0 +1,33 @@
+#include "BootTimeline.h"
+#include "EventLog.h"
+
+BootTimeline bootTimeline;
+
+void BootTimeline::mark(BootPhase phase) {
+    if (reached(phase)) return;
+    uint32_t ms = hal::millis();
+    uint32_t irq = hal::irqDisable();
+    _at[(uint8_t)phase] = ms;
+    _reached |= 1 << (uint8_t)phase;
+    hal::irqRestore(irq);
+    Serial.printf("[Boot] %s after %u ms\n", phaseName(phase), (unsigned)ms);
+
+    if (phase != BootPhase::Ready && reached(BootPhase::ServerStarted) && reached(BootPhase::WifiConnected) &&
+        reached(BootPhase::ClockSet)) {
+        mark(BootPhase::Ready);
+        eventLog.add(EventLog::Type::BootReady, EventLog::NO_WINDER, (int32_t)ms);
+    }
+}
+
+const char* BootTimeline::phaseName(BootPhase phase) {
+    switch (phase) {
+        case BootPhase::FsMounted:     return "fs_mounted";
+        case BootPhase::ConfigLoaded:  return "config_loaded";
+        case BootPhase::ServerStarted: return "server_started";
+        case BootPhase::FirstRequest:  return "first_request";
+        case BootPhase::WifiConnected: return "wifi_connected";
+        case BootPhase::ClockSet:      return "clock_set";
+        case BootPhase::Ready:         return "ready";
+        default:                       return "?";
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include "Hal.h"
+
+// Boot phases, roughly in the order they complete. setup() mounts the
+// filesystem, loads the settings and starts the web server; WiFi and the
+// clock come up afterwards from loop(). Ready = server, WiFi and clock.
+enum class BootPhase : uint8_t { FsMounted, ConfigLoaded, ServerStarted, FirstRequest, WifiConnected, ClockSet, Ready, Count };
+
+// When each boot phase was first reached, in ms since the firmware started,
+// to see how long a unit stays dark after a power cut and where the time goes
+class BootTimeline {
+public:
+    // Records the phase the first time; later calls are ignored. Cheap
+    // enough for every request, safe from the TCP context.
+    void mark(BootPhase phase);
+    bool reached(BootPhase phase) const { return _reached & (1 << (uint8_t)phase); }
+    uint32_t at(BootPhase phase) const { return _at[(uint8_t)phase]; }  // ms, valid if reached()
+    static const char* phaseName(BootPhase phase);
+
+private:
+    uint32_t _at[(uint8_t)BootPhase::Count] = {};
+    volatile uint8_t _reached = 0;
+};
+
+extern BootTimeline bootTimeline;
+
+#endif // BOOT_TIMELINE_H
@@ -0,0 +1,98 @@
+#include "CoilOutput.h"
+#include "Hal.h"
+
+CoilOutput coilOutput;
+
+CoilOutput::CoilOutput() {
+    memset(_slowPins, -1, sizeof(_slowPins));
+}
+
+// Precompute the GPO set mask for each of the 16 coil patterns, so
+// commit() is a table lookup and OR per motor
+void CoilOutput::attachPins(uint8_t motor, int in1, int in2, int in3, int in4) {
+    if (motor >= MAX_MOTORS) return;
+    const int pins[4] = {in1, in2, in3, in4};
+    _mode = Mode::Direct;
+    for (int n = 0; n < 4; n++) {
+        hal::pinModeOutput(pins[n]);
+        hal::gpioWrite(pins[n], false);
+        if (hal::gpioIsPortPin(pins[n])) {
+            _portMask |= (1UL << pins[n]);
+            _slowPins[motor][n] = -1;
+        } else {
+            _slowPins[motor][n] = pins[n];
+        }
+    }
+    for (uint8_t coils = 0; coils < 16; coils++) {
+        _setTable[motor][coils] = 0;
+        for (int n = 0; n < 4; n++) {
+            if ((coils >> n) & 1 && _slowPins[motor][n] < 0) _setTable[motor][coils] |= (1UL << pins[n]);
+        }
+    }
+    _coils[motor] = 0;
+    _slowWritten[motor] = 0;
+    if (motor >= _motors) _motors = motor + 1;
+    Serial.printf("[COILS] Motor %u on GPIO %d/%d/%d/%d\n", motor, in1, in2, in3, in4);
+}
+
+void CoilOutput::beginShiftRegister(int dataPin, int clockPin, int latchPin, uint8_t motors) {
+    _mode = Mode::ShiftRegister;
+    _dataPin = dataPin;
+    _clockPin = clockPin;
+    _latchPin = latchPin;
+    _motors = motors > MAX_MOTORS ? MAX_MOTORS : motors;
+    hal::pinModeOutput(_dataPin);
+    hal::pinModeOutput(_clockPin);
+    hal::pinModeOutput(_latchPin);
+    hal::gpioWrite(_clockPin, false);
+    hal::gpioWrite(_latchPin, false);
+    for (uint8_t m = 0; m < MAX_MOTORS; m++) _coils[m] = 0;
+    shiftOut(0);
+    _written = 0;
+    Serial.printf("[COILS] %u motor(s) on 74HC595 chain (data %d, clock %d, latch %d)\n", _motors, dataPin, clockPin, latchPin);
+}
+
+void IRAM_ATTR CoilOutput::set(uint8_t motor, uint8_t coils) {
+    _coils[motor] = coils & 0x0F;
+}
+
+// Shared by the step ISR and loop() (release, blocking steps), so the
+// staged patterns are read and written with interrupts off
+void IRAM_ATTR CoilOutput::commit() {
+    uint32_t state = hal::irqDisable();
+    if (_mode == Mode::ShiftRegister) {
+        uint32_t frame = 0;
+        for (uint8_t m = 0; m < _motors; m++) frame |= (uint32_t)_coils[m] << (4 * m);
+        if (frame != _written) {
+            shiftOut(frame);
+            _written = frame;
+        }
+    } else {
+        uint32_t set = 0;
+        for (uint8_t m = 0; m < _motors; m++) set |= _setTable[m][_coils[m]];
+        hal::gpioPortWrite(set, _portMask & ~set);
+        for (uint8_t m = 0; m < _motors; m++) {
+            uint8_t coils = _coils[m];
+            uint8_t changed = coils ^ _slowWritten[m];
+            if (!changed) continue;
+            for (int n = 0; n < 4; n++) {
+                if (_slowPins[m][n] >= 0 && (changed >> n) & 1) hal::gpioWrite(_slowPins[m][n], (coils >> n) & 1);
+            }
+            _slowWritten[m] = coils;
+        }
+    }
+    hal::irqRestore(state);
+}
+
+// MSB first through whole chips: the last bit shifted lands on QA of the
+// first chip, so bit 0 (motor 0, IN1) is the first chip's QA
+void IRAM_ATTR CoilOutput::shiftOut(uint32_t frame) {
+    uint8_t bits = ((_motors + 1) / 2) * 8;
+    for (int8_t b = bits - 1; b >= 0; b--) {
+        hal::gpioWrite(_dataPin, (frame >> b) & 1);
+        hal::gpioWrite(_clockPin, true);
+        hal::gpioWrite(_clockPin, false);
+    }
+    hal::gpioWrite(_latchPin, true);
+    hal::gpioWrite(_latchPin, false);
+}
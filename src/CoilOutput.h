@@ -0,0 +1,54 @@
+#ifndef COIL_OUTPUT_H
+#define COIL_OUTPUT_H
+
+#include <Arduino.h>
+#include "ConfigConstants.h"
+
+// Coil outputs for all motors. Drivers stage a 4-bit coil pattern per
+// motor with set(); commit() then writes every motor's coils at once:
+// one GPO store for motors on direct pins, or one shift + latch for a
+// 74HC595 chain (motor n on outputs 4n..4n+3, so two motors per chip).
+class CoilOutput {
+public:
+    static const uint8_t MAX_MOTORS = MAX_WINDERS;
+
+    CoilOutput();
+
+    // Direct wiring: IN1..IN4 of one motor. GPIO16 works but is written
+    // separately, outside the single port store.
+    void attachPins(uint8_t motor, int in1, int in2, int in3, int in4);
+
+    // 74HC595 chain for `motors` motors. Clears all outputs, since the
+    // chips power up with random contents.
+    void beginShiftRegister(int dataPin, int clockPin, int latchPin, uint8_t motors);
+
+    void set(uint8_t motor, uint8_t coils);  // ISR-safe, staged until commit()
+    void commit();                           // ISR-safe
+
+    uint8_t motors() const { return _motors; }
+
+private:
+    enum class Mode : uint8_t { Direct, ShiftRegister };
+
+    void shiftOut(uint32_t frame);
+
+    Mode _mode = Mode::Direct;
+    uint8_t _motors = 0;
+    volatile uint8_t _coils[MAX_MOTORS] = {};  // staged patterns, bit n = IN(n+1)
+
+    // Direct: GPO set mask per motor and coil pattern, plus pins outside GPO
+    uint32_t _setTable[MAX_MOTORS][16] = {};
+    uint32_t _portMask = 0;
+    int8_t _slowPins[MAX_MOTORS][4];
+    uint8_t _slowWritten[MAX_MOTORS] = {};
+
+    // Shift register
+    int _dataPin = -1;
+    int _clockPin = -1;
+    int _latchPin = -1;
+    uint32_t _written = 0;  // last frame latched
+};
+
+extern CoilOutput coilOutput;
+
+#endif // COIL_OUTPUT_H
@@ -4,19 +4,32 @@
 // Firmware version (update this with each release)
 #define FIRMWARE_VERSION "1.0.11"
 
-// OTA update URLs
+// OTA update URLs; each image has its MD5 at <url>.md5 (scripts/ota_release.py).
+// The version URL can be overridden with a build flag (scripts/tls_bench.py)
+#ifndef OTA_VERSION_URL
 #define OTA_VERSION_URL "https://raw.githubusercontent.com/bghosh412/OTA/main/WW-OTA/version.txt"
-#define OTA_BIN_URL     "https://raw.githubusercontent.com/bghosh412/OTA/main/WW-OTA/firmware.bin"
+#endif
+#define OTA_BIN_URL     "https://raw.githubusercontent.com/bghosh412/OTA/main/WW-OTA/firmware.bin.gz"
 #define OTA_LFS_URL     "https://raw.githubusercontent.com/bghosh412/OTA/main/WW-OTA/littlefs.bin"
 
 
-// Ntfy topic and message templates
+// Ntfy server, topic and message templates
+#define NTFY_HOST  "ntfy.sh"
+#define NTFY_PORT  80
 #define NTFY_TOPIC "ww-dad-01"
 #define NTFY_MSG_STARTUP_PREFIX "Watch Winder is up and running at http://"
 #define NTFY_MSG_STARTUP_SUFFIX ""
 #define NTFY_MSG_WINDING "Winding started at %s and will wind your favorite Automatic Watch for next %.1f min, at %.1f RPM."
 #define NTFY_MSG_WINDING_COMPLETE "Winding completed at %s. Your watch is ready!"
 
+// Winders on this controller, one stepper each (override with -DWINDER_COUNT=n).
+// Coils go to GPIOs directly (two winders max), or through a 74HC595
+// chain with -DWINDER_SHIFT_REGISTER; pins are set in main.cpp.
+#ifndef WINDER_COUNT
+#define WINDER_COUNT 1
+#endif
+#define MAX_WINDERS 4  // slots in the config record and coil output
+
 // WiFi credentials (optionally move to secrets file)
 #define WIFI_SSID     ""
 #define WIFI_PASSWORD ""
@@ -0,0 +1,212 @@
+#include "ConfigStore.h"
+#include "Hal.h"
+#include "HeapMonitor.h"
+#include "StepperMotorDriver.h"
+#include <ArduinoJson.h>
+
+ConfigStore configStore;
+
+static_assert(sizeof(ScheduleConfig::WindingTime) == 4, "WindingTime layout changed");
+
+// JSON files used to seed the store (and by older firmware)
+static const char* SCHEDULE_JSON = "/Config/schedule.txt";
+static const char* MOTOR_JSON = "/Config/motor.txt";
+static const char* DURATION_TXT = "/Config/duration.txt";
+static const char* LAST_WINDING_TXT = "/Config/last_winding.txt";
+static const char* NEXT_WINDING_TXT = "/Config/next_winding.txt";
+
+static time_t parseIso(const String& iso) {
+    struct tm t = {};
+    if (sscanf(iso.c_str(), "%d-%d-%dT%d:%d:%d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) != 6) return 0;
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
+// Empty for 0
+static const char* formatIso(time_t epoch, char* buf, size_t len) {
+    buf[0] = '\0';
+    if (epoch == 0) return buf;
+    struct tm t;
+    localtime_r(&epoch, &t);
+    strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &t);
+    return buf;
+}
+
+ConfigStore::ConfigStore() {
+    memset(&_rec, 0, sizeof(_rec));
+    for (WinderRecord& r : _rec.winders) {
+        r.durationMin = 30;
+        r.manualDurationMin = 30;
+        strlcpy(r.speed, "Medium", sizeof(r.speed));
+        r.motor.stepMode = StepMode::Full;
+    }
+}
+
+bool ConfigStore::begin() {
+    static_assert(sizeof(WinderRecord) == 48, "WinderRecord must not contain padding");
+    if (!_fsAvailable) {
+        Serial.println("[ConfigStore] No filesystem, settings kept in RAM only");
+        return false;
+    }
+    uint8_t buf[sizeof(Header) + sizeof(Record)];
+    size_t n = hal::fsReadBytes(PATH, buf, sizeof(buf));
+    Header hdr = {};
+    if (n >= sizeof(Header)) memcpy(&hdr, buf, sizeof(hdr));
+    size_t len = n >= sizeof(Header) ? n - sizeof(Header) : 0;
+    bool valid = hdr.magic == MAGIC && hdr.length == len && hdr.crc == crc32(buf + sizeof(Header), len);
+    if (valid && hdr.format == FORMAT_VERSION && len == sizeof(Record)) {
+        memcpy(&_rec, buf + sizeof(Header), sizeof(Record));
+        _seq = hdr.seq;
+        Serial.printf("[ConfigStore] Loaded %s (seq %u)\n", PATH, hdr.seq);
+        return true;
+    }
+    if (valid && hdr.format == 1 && len == sizeof(WinderRecord)) {
+        memcpy(&_rec.winders[0], buf + sizeof(Header), sizeof(WinderRecord));
+        _seq = hdr.seq;
+        Serial.printf("[ConfigStore] Upgraded %s from format 1 (seq %u)\n", PATH, hdr.seq);
+        markDirty();
+        flush();
+        return true;
+    }
+
+    Serial.printf("[ConfigStore] %s missing or invalid, importing JSON config\n", PATH);
+    importJson();
+    flush();
+    return false;
+}
+
+// Files from single-winder firmware, so they seed winder 0
+void ConfigStore::importJson() {
+    ScheduleConfig sched;
+    if (sched.fromJson(hal::fsRead(SCHEDULE_JSON))) setSchedule(0, sched);
+
+    StaticJsonDocument<256> doc;
+    if (!deserializeJson(doc, hal::fsRead(MOTOR_JSON))) {
+        MotorSettings m = _rec.winders[0].motor;
+        if (doc.containsKey("step_mode")) m.stepMode = StepperMotorDriver::stepModeFromString(doc["step_mode"].as<const char*>());
+        m.dutyCycle = doc["duty_cycle"] | m.dutyCycle;
+        m.pulseWidth = doc["pulse_width"] | m.pulseWidth;
+        setMotor(0, m);
+    }
+
+    int duration = hal::fsRead(DURATION_TXT).toInt();
+    if (duration > 0) setManualDuration(0, duration);
+    setLastWinding(0, parseIso(hal::fsRead(LAST_WINDING_TXT)));
+    setNextWinding(0, parseIso(hal::fsRead(NEXT_WINDING_TXT)));
+    _dirty = true;
+}
+
+void ConfigStore::getSchedule(uint8_t w, ScheduleConfig& out) const {
+    const WinderRecord& r = _rec.winders[w];
+    out.durationMin = r.durationMin;
+    strlcpy(out.speed, r.speed, sizeof(out.speed));
+    out.timeCount = r.timeCount;
+    memcpy(out.times, r.times, sizeof(out.times));
+    out.dayMask = r.dayMask;
+}
+
+void ConfigStore::setSchedule(uint8_t w, const ScheduleConfig& sched) {
+    WinderRecord next = _rec.winders[w];
+    next.durationMin = sched.durationMin;
+    memset(next.speed, 0, sizeof(next.speed));
+    strlcpy(next.speed, sched.speed, sizeof(next.speed));
+    next.timeCount = sched.timeCount;
+    memset(next.times, 0, sizeof(next.times));
+    memcpy(next.times, sched.times, sched.timeCount * sizeof(next.times[0]));
+    next.dayMask = sched.dayMask;
+    if (memcmp(&next, &_rec.winders[w], sizeof(WinderRecord)) == 0) return;
+    _rec.winders[w] = next;
+    markDirty();
+}
+
+void ConfigStore::setMotor(uint8_t w, const MotorSettings& motor) {
+    if (memcmp(&motor, &_rec.winders[w].motor, sizeof(motor)) == 0) return;
+    _rec.winders[w].motor = motor;
+    markDirty();
+}
+
+void ConfigStore::setManualDuration(uint8_t w, uint16_t minutes) {
+    if (minutes == _rec.winders[w].manualDurationMin) return;
+    _rec.winders[w].manualDurationMin = minutes;
+    markDirty();
+}
+
+void ConfigStore::setLastWinding(uint8_t w, time_t t) {
+    if ((uint32_t)t == _rec.winders[w].lastWinding) return;
+    _rec.winders[w].lastWinding = (uint32_t)t;
+    markDirty();
+}
+
+void ConfigStore::setNextWinding(uint8_t w, time_t t) {
+    if ((uint32_t)t == _rec.winders[w].nextWinding) return;
+    _rec.winders[w].nextWinding = (uint32_t)t;
+    markDirty();
+}
+
+void ConfigStore::markDirty() {
+    if (!_dirty) _dirtySinceMs = hal::millis();
+    _dirty = true;
+}
+
+void ConfigStore::poll() {
+    if (_dirty && _fsAvailable && hal::millis() - _dirtySinceMs >= COALESCE_MS) flush();
+}
+
+bool ConfigStore::flush() {
+    if (!_dirty) return true;
+    if (!_fsAvailable) return false;
+    HeapScope heapScope(HeapTag::Config);
+    uint8_t buf[sizeof(Header) + sizeof(Record)];
+    Header hdr = {MAGIC, FORMAT_VERSION, (uint16_t)sizeof(Record), _seq + 1, 0};
+    memcpy(buf + sizeof(Header), &_rec, sizeof(Record));
+    hdr.crc = crc32(buf + sizeof(Header), sizeof(Record));
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    if (!hal::fsWriteBytes(TMP_PATH, buf, sizeof(buf)) || !hal::fsRename(TMP_PATH, PATH)) {
+        if (!_failing) Serial.printf("[ConfigStore] Failed to write %s, retrying every %lu s\n", PATH, COALESCE_MS / 1000);
+        _failing = true;
+        hal::fsRemove(TMP_PATH);
+        _dirtySinceMs = hal::millis();  // retry after another window
+        return false;
+    }
+    _seq++;
+    _writes++;
+    _dirty = false;
+    _failing = false;
+    Serial.printf("[ConfigStore] Saved (seq %u)\n", _seq);
+    return true;
+}
+
+void ConfigStore::exportJson(JsonStreamWriter& json) const {
+    // Single-winder builds keep the flat layout of earlier exports
+    if (WINDER_COUNT > 1) json.beginObject().beginArray("winders");
+    for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+        const WinderRecord& r = _rec.winders[w];
+        ScheduleConfig sched;
+        getSchedule(w, sched);
+        char iso[25];
+        json.beginObject();
+        sched.writeJson(json, "schedule");
+        json.beginObject("motor")
+            .field("step_mode", StepperMotorDriver::stepModeToString(r.motor.stepMode))
+            .field("duty_cycle", r.motor.dutyCycle)
+            .field("pulse_width", r.motor.pulseWidth)
+            .endObject();
+        json.field("manual_duration", r.manualDurationMin);
+        json.field("last_winding", formatIso(r.lastWinding, iso, sizeof(iso)));
+        json.field("next_winding", formatIso(r.nextWinding, iso, sizeof(iso)));
+        json.endObject();
+    }
+    if (WINDER_COUNT > 1) json.endArray().endObject();
+}
+
+uint32_t ConfigStore::crc32(const uint8_t* data, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
@@ -0,0 +1,108 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "ConfigConstants.h"
+#include "ScheduleConfig.h"
+#include "StepModes.h"
+
+// Persistent settings and winding state in one binary record with a CRC,
+// one fixed-size section per winder (MAX_WINDERS, whatever WINDER_COUNT is
+// built, so the file survives changing it).
+// Writes go to TMP_PATH and are renamed over PATH, so a power cut leaves
+// either the old or the new record. Runtime changes (winding times,
+// manual duration) are coalesced for COALESCE_MS; settings the user saves
+// are flushed right away. The JSON files under /Config are only read to
+// seed the store when PATH is missing or invalid.
+class ConfigStore {
+public:
+    static constexpr const char* PATH = "/Config/config.bin";
+    static constexpr const char* TMP_PATH = "/Config/config.tmp";
+    static const uint32_t MAGIC = 0x46435757;     // "WWCF"
+    static const uint16_t FORMAT_VERSION = 2;     // 1 = single winder, upgraded on load
+    static const unsigned long COALESCE_MS = 5000;
+
+    struct MotorSettings {
+        StepMode stepMode;
+        uint8_t dutyCycle;
+        uint16_t pulseWidth;
+    };
+
+    ConfigStore();
+
+    // Without a filesystem the settings stay in RAM: begin() starts from
+    // the defaults and nothing is written, or retried, until it is
+    // available again. Call before begin().
+    void setFsAvailable(bool available) { _fsAvailable = available; }
+
+    // Loads PATH, or imports the JSON files (into winder 0) and writes PATH.
+    // Returns true if the binary record was valid.
+    bool begin();
+
+    // Per winder; `w` must be below MAX_WINDERS
+    void getSchedule(uint8_t w, ScheduleConfig& out) const;
+    void setSchedule(uint8_t w, const ScheduleConfig& sched);
+    const MotorSettings& motor(uint8_t w) const { return _rec.winders[w].motor; }
+    void setMotor(uint8_t w, const MotorSettings& motor);
+    uint16_t manualDuration(uint8_t w) const { return _rec.winders[w].manualDurationMin; }
+    void setManualDuration(uint8_t w, uint16_t minutes);
+    time_t lastWinding(uint8_t w) const { return (time_t)_rec.winders[w].lastWinding; }
+    void setLastWinding(uint8_t w, time_t t);
+    time_t nextWinding(uint8_t w) const { return (time_t)_rec.winders[w].nextWinding; }
+    void setNextWinding(uint8_t w, time_t t);
+
+    void poll();      // from loop(): writes changes that have settled
+    bool flush();     // writes pending changes now; false if not written
+    bool dirty() const { return _dirty; }
+    uint32_t writes() const { return _writes; }
+
+    // All settings in the JSON import format; a "winders" array when
+    // WINDER_COUNT > 1
+    void exportJson(JsonStreamWriter& json) const;
+
+    // CRC-32 (IEEE), also used by the other binary files
+    static uint32_t crc32(const uint8_t* data, size_t len);
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t format;
+        uint16_t length;  // sizeof(Record)
+        uint32_t seq;     // incremented per write
+        uint32_t crc;     // CRC-32 of the record
+    };
+
+    // Fixed layout, no implicit padding. Also the whole record of format 1.
+    struct WinderRecord {
+        uint32_t lastWinding;        // epoch seconds, 0 = never
+        uint32_t nextWinding;        // epoch seconds, 0 = none scheduled
+        uint16_t durationMin;        // schedule
+        uint16_t manualDurationMin;  // last Wind Now duration
+        char speed[12];
+        uint8_t timeCount;
+        uint8_t dayMask;
+        ScheduleConfig::WindingTime times[ScheduleConfig::MAX_TIMES];
+        MotorSettings motor;
+        uint8_t reserved[2];
+    };
+
+    struct Record {
+        WinderRecord winders[MAX_WINDERS];
+    };
+
+    void importJson();
+    void markDirty();
+
+    Record _rec;
+    uint32_t _seq = 0;
+    bool _fsAvailable = true;
+    bool _dirty = false;
+    bool _failing = false;  // the last write failed; logged once
+    unsigned long _dirtySinceMs = 0;
+    uint32_t _writes = 0;
+};
+
+extern ConfigStore configStore;
+
+#endif // CONFIG_STORE_H
@@ -0,0 +1,267 @@
+#include "EventLog.h"
+#include "HeapMonitor.h"
+
+EventLog eventLog;
+
+static_assert(sizeof(EventLog::Entry) == 16, "EventLog::Entry is a file format");
+
+static const time_t CLOCK_VALID_AFTER = 1640995200;  // 2022-01-01, before that SNTP has not run
+static constexpr const char* TMP_PATH = "/log/events.tmp";
+
+void EventLog::add(Type type, uint8_t winder, int32_t value) {
+    time_t now = hal::now();
+    uint32_t time = now > CLOCK_VALID_AFTER ? (uint32_t)now : 0;
+    uint32_t irq = hal::irqDisable();
+    if (_count == RAM_SLOTS) {
+        _stats.dropped++;
+        hal::irqRestore(irq);
+        return;
+    }
+    if (_count == 0) _oldestMs = hal::millis();
+    _ring[(_head + _count) % RAM_SLOTS] = {_nextSeq++, time, _boot, type, winder, value};
+    _count++;
+    _stats.logged++;
+    hal::irqRestore(irq);
+}
+
+// A power cut during an append can leave a partial entry at the end;
+// copy the whole entries to TMP_PATH and swap it in
+static void dropPartialEntry(const char* path, size_t size) {
+    EventLog::Entry chunk[8];
+    size_t whole = size - size % sizeof(EventLog::Entry);
+    Serial.printf("[EventLog] Dropping %u trailing bytes of %s\n", (unsigned)(size - whole), path);
+    hal::fsRemove(TMP_PATH);
+    for (size_t off = 0; off < whole; off += sizeof(chunk)) {
+        size_t len = whole - off < sizeof(chunk) ? whole - off : sizeof(chunk);
+        if (hal::fsReadAt(path, off, chunk, len) != len || !hal::fsAppendBytes(TMP_PATH, chunk, len)) {
+            hal::fsRemove(TMP_PATH);
+            hal::fsRemove(path);  // unreadable, start over
+            return;
+        }
+    }
+    if (whole == 0) {
+        hal::fsRemove(path);
+    } else {
+        hal::fsRename(TMP_PATH, path);
+    }
+}
+
+void EventLog::begin() {
+    hal::fsMkdir(DIR);
+    size_t size = hal::fsSize(PATH);
+    if (size % sizeof(Entry)) {
+        dropPartialEntry(PATH, size);
+        size = hal::fsSize(PATH);
+    }
+
+    // The newest entry on file gives the last seq and boot number
+    const char* path = PATH;
+    if (size == 0) {
+        path = OLD_PATH;
+        size = hal::fsSize(OLD_PATH);
+    }
+    Entry last = {};
+    if (size >= sizeof(Entry)) {
+        hal::fsReadAt(path, size - size % sizeof(Entry) - sizeof(Entry), &last, sizeof(last));
+    }
+
+    uint32_t irq = hal::irqDisable();
+    _boot = last.boot + 1;
+    _nextSeq = last.seq + 1;
+    for (uint8_t i = 0; i < _count; i++) {
+        Entry& e = _ring[(_head + i) % RAM_SLOTS];
+        e.seq = _nextSeq++;
+        e.boot = _boot;
+    }
+    _ready = true;
+    hal::irqRestore(irq);
+    Serial.printf("[EventLog] Boot %u, last event on file #%u\n", _boot, (unsigned)last.seq);
+}
+
+void EventLog::poll() {
+    if (!_ready || _count == 0) return;
+    if (_count < FLUSH_BATCH && hal::millis() - _oldestMs < FLUSH_MS) return;
+    flush();
+}
+
+bool EventLog::flush() {
+    if (!_ready || _count == 0) return true;
+    HeapScope heapScope(HeapTag::Events);
+    // add() only appends behind _count, so the pending entries stay put
+    uint8_t n = _count;
+    uint8_t first = n < RAM_SLOTS - _head ? n : RAM_SLOTS - _head;
+
+    if (hal::fsSize(PATH) + n * sizeof(Entry) > MAX_FILE_BYTES) {
+        Serial.println("[EventLog] Rotating log file");
+        hal::fsRename(PATH, OLD_PATH);
+    }
+    bool ok = hal::fsAppendBytes(PATH, &_ring[_head], first * sizeof(Entry));
+    if (ok && n > first) ok = hal::fsAppendBytes(PATH, &_ring[0], (n - first) * sizeof(Entry));
+    if (!ok) {
+        _stats.failures++;
+        _oldestMs = hal::millis();  // retry after FLUSH_MS
+        Serial.printf("[EventLog] Failed to write %u event(s)\n", n);
+        return false;
+    }
+
+    uint32_t irq = hal::irqDisable();
+    _head = (_head + n) % RAM_SLOTS;
+    _count -= n;
+    hal::irqRestore(irq);
+    _stats.flushes++;
+    return true;
+}
+
+// Seqs are contiguous within a file, so the first entry locates the rest
+size_t EventLog::readFile(const char* path, uint32_t after, Entry* out, size_t max) const {
+    size_t count = hal::fsSize(path) / sizeof(Entry);
+    Entry first;
+    if (count == 0 || hal::fsReadAt(path, 0, &first, sizeof(first)) != sizeof(first)) return 0;
+    if (after >= first.seq + count - 1) return 0;
+    size_t idx = after < first.seq ? 0 : after + 1 - first.seq;
+    size_t n = count - idx < max ? count - idx : max;
+    return hal::fsReadAt(path, idx * sizeof(Entry), out, n * sizeof(Entry)) / sizeof(Entry);
+}
+
+size_t EventLog::readAfter(uint32_t after, Entry* out, size_t max) const {
+    size_t n = readFile(OLD_PATH, after, out, max);
+    if (n == 0) n = readFile(PATH, after, out, max);
+    if (n > 0) return n;
+
+    uint32_t irq = hal::irqDisable();
+    for (uint8_t i = 0; i < _count && n < max; i++) {
+        const Entry& e = _ring[(_head + i) % RAM_SLOTS];
+        if (e.seq > after) out[n++] = e;
+    }
+    hal::irqRestore(irq);
+    return n;
+}
+
+size_t EventLog::exportRecent(uint8_t* buf, size_t len) {
+    if (!flush()) return 0;
+    Entry* out = (Entry*)buf;
+    size_t max = len / sizeof(Entry);
+    uint32_t after = lastSeq() > max ? lastSeq() - max : 0;
+    size_t n = 0;
+    // The newest entries can span OLD_PATH and PATH
+    while (n < max) {
+        size_t got = readAfter(after, out + n, max - n);
+        if (got == 0) break;
+        n += got;
+        after = out[n - 1].seq;
+    }
+    return n * sizeof(Entry);
+}
+
+const char* EventLog::typeName(Type type) {
+    switch (type) {
+    case Type::Boot: return "boot";
+    case Type::WifiConnected: return "wifi_connected";
+    case Type::WifiDisconnected: return "wifi_disconnected";
+    case Type::ClockSet: return "clock_set";
+    case Type::ScheduledStart: return "scheduled_start";
+    case Type::ManualStart: return "manual_start";
+    case Type::WindComplete: return "wind_complete";
+    case Type::WindStopped: return "wind_stopped";
+    case Type::ScheduleSaved: return "schedule_saved";
+    case Type::OtaStart: return "ota_start";
+    case Type::OtaFailed: return "ota_failed";
+    case Type::NtfyFailed: return "ntfy_failed";
+    case Type::NtfyDropped: return "ntfy_dropped";
+    case Type::BootReady: return "boot_ready";
+    case Type::OtaStateLost: return "ota_state_lost";
+    }
+    return "unknown";
+}
+
+size_t EventLog::describe(const Entry& e, char* buf, size_t len) {
+    int n = 0;
+    if (e.winder != NO_WINDER) n = snprintf(buf, len, "Winder %u: ", e.winder);
+    if (n < 0 || (size_t)n >= len) return 0;
+    char* p = buf + n;
+    size_t room = len - n;
+    int v = (int)e.value;
+
+    switch (e.type) {
+    case Type::Boot: n += snprintf(p, room, "Booted (reset reason %d)", v); break;
+    case Type::WifiConnected: n += snprintf(p, room, "WiFi connected"); break;
+    case Type::WifiDisconnected: n += snprintf(p, room, "WiFi disconnected (reason %d)", v); break;
+    case Type::ClockSet: n += snprintf(p, room, "Clock set"); break;
+    case Type::ScheduledStart: n += snprintf(p, room, "scheduled winding started, %d min", v); break;
+    case Type::ManualStart: n += snprintf(p, room, "manual winding started, %d min", v); break;
+    case Type::WindComplete: n += snprintf(p, room, "winding complete, %d steps", v); break;
+    case Type::WindStopped: n += snprintf(p, room, "winding stopped after %d steps", v); break;
+    case Type::ScheduleSaved: n += snprintf(p, room, "schedule saved"); break;
+    case Type::OtaStart: n += snprintf(p, room, "Firmware update started"); break;
+    case Type::OtaFailed: n += snprintf(p, room, "Firmware update failed"); break;
+    case Type::NtfyFailed:
+        n += v > 0 ? snprintf(p, room, "Notification failed (HTTP %d)", v)
+                   : snprintf(p, room, "Notification failed (no connection)");
+        break;
+    case Type::NtfyDropped: n += snprintf(p, room, "%d notification(s) dropped", v); break;
+    case Type::BootReady: n += snprintf(p, room, "Ready %d ms after boot", v); break;
+    case Type::OtaStateLost:
+        n += snprintf(p, room, "Update did not keep the%s%s%s%s", v & 1 ? " settings" : "", v & 2 ? " statistics" : "",
+                      v & 4 ? " runs" : "", v & 8 ? " events" : "");
+        break;
+    default: n += snprintf(p, room, "Event %u (%d)", (unsigned)e.type, v); break;
+    }
+    return (size_t)n < len ? n : len - 1;
+}
+
+bool EventLog::Reader::nextLine() {
+    int n = 0;
+    switch (_part) {
+    case Part::Head:
+        n = snprintf(_line, LINE_LEN, "{\"events\":[");
+        _part = Part::Entries;
+        break;
+
+    case Part::Entries: {
+        if (_left && _batchPos == _batchLen) {
+            _batchLen = eventLog.readAfter(_cursor, _batch, _left < 8 ? _left : 8);
+            _batchPos = 0;
+        }
+        if (_left == 0 || _batchPos == _batchLen) {
+            _part = Part::Tail;
+            return nextLine();
+        }
+        const Entry& e = _batch[_batchPos++];
+        _cursor = e.seq;
+        _left--;
+        char text[72];
+        describe(e, text, sizeof(text));
+        n = snprintf(_line, LINE_LEN, "%s{\"seq\":%u,\"time\":%u,\"boot\":%u,\"type\":\"%s\"", _first ? "" : ",",
+                     (unsigned)e.seq, (unsigned)e.time, e.boot, typeName(e.type));
+        if (e.winder != NO_WINDER) n += snprintf(_line + n, LINE_LEN - n, ",\"winder\":%u", e.winder);
+        n += snprintf(_line + n, LINE_LEN - n, ",\"value\":%d,\"text\":\"%s\"}", (int)e.value, text);
+        _first = false;
+        break;
+    }
+
+    case Part::Tail:
+        n = snprintf(_line, LINE_LEN, "],\"next\":%u,\"more\":%s}", (unsigned)_cursor,
+                     eventLog.lastSeq() > _cursor ? "true" : "false");
+        _part = Part::Done;
+        break;
+
+    case Part::Done:
+        return false;
+    }
+    _lineLen = n < LINE_LEN ? n : LINE_LEN - 1;
+    _lineOff = 0;
+    return true;
+}
+
+size_t EventLog::Reader::read(char* buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+        if (_lineOff == _lineLen && !nextLine()) break;
+        size_t avail = _lineLen - _lineOff;
+        size_t chunk = avail < len - n ? avail : len - n;
+        memcpy(buf + n, _line + _lineOff, chunk);
+        _lineOff += chunk;
+        n += chunk;
+    }
+    return n;
+}
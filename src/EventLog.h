@@ -0,0 +1,124 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include "Hal.h"
+
+// Persistent event log for troubleshooting. add() stores a fixed-size
+// binary entry in a RAM ring; poll() appends pending entries to PATH in
+// batches. When PATH would outgrow MAX_FILE_BYTES it is renamed to
+// OLD_PATH, so the log never takes more than twice that.
+// Entries are numbered without gaps (seq), which makes an entry's file
+// offset computable and lets readers page with a seq cursor. A full ring
+// drops new entries (counted) rather than leaving holes.
+class EventLog {
+public:
+    static constexpr const char* DIR = "/log";
+    static constexpr const char* PATH = "/log/events.bin";
+    static constexpr const char* OLD_PATH = "/log/events.old";
+    static const uint8_t RAM_SLOTS = 32;
+    static const uint8_t FLUSH_BATCH = 8;               // pending entries that trigger a write
+    static const unsigned long FLUSH_MS = 30000;        // oldest pending entry waits at most this
+    static const size_t MAX_FILE_BYTES = 16384;         // 1024 entries per file
+    static const uint8_t NO_WINDER = 0xFF;
+
+    enum class Type : uint8_t {
+        Boot = 1,          // value: reset reason
+        WifiConnected,
+        WifiDisconnected,  // value: disconnect reason
+        ClockSet,
+        ScheduledStart,    // value: minutes
+        ManualStart,       // value: minutes
+        WindComplete,      // value: steps
+        WindStopped,       // value: steps done
+        ScheduleSaved,
+        OtaStart,
+        OtaFailed,
+        NtfyFailed,        // value: HTTP code, <= 0 for no connection
+        NtfyDropped,       // value: messages
+        BootReady,         // value: ms from start to server, WiFi and clock up
+        OtaStateLost,      // value: OtaUpdate::Kept bits not carried over a filesystem update
+    };
+
+    struct Entry {
+        uint32_t seq;
+        uint32_t time;     // epoch seconds, 0 = clock not set yet
+        uint16_t boot;     // boot count, tells boots apart before the clock is set
+        Type type;
+        uint8_t winder;    // NO_WINDER for system events
+        int32_t value;
+    };
+
+    struct Stats {
+        uint32_t logged;
+        uint32_t dropped;  // ring full
+        uint32_t flushes;
+        uint32_t failures; // file writes
+    };
+
+    // Streams one page of entries with seq > after as JSON, a few entries
+    // per read(), so the response is never held in memory:
+    // {"events":[{...},...],"next":<cursor>,"more":true|false}
+    class Reader {
+    public:
+        static const uint16_t LINE_LEN = 192;
+
+        Reader(uint32_t after, uint16_t limit) : _cursor(after), _left(limit) {}
+
+        // Fills buf; returns 0 when the page is complete
+        size_t read(char* buf, size_t len);
+
+    private:
+        enum class Part : uint8_t { Head, Entries, Tail, Done };
+
+        bool nextLine();
+
+        uint32_t _cursor;
+        uint16_t _left;
+        Part _part = Part::Head;
+        bool _first = true;
+        Entry _batch[8];
+        uint8_t _batchLen = 0;
+        uint8_t _batchPos = 0;
+        char _line[LINE_LEN];
+        uint16_t _lineLen = 0;
+        uint16_t _lineOff = 0;
+    };
+
+    // Any context but ISRs, including the async web server's
+    void add(Type type, uint8_t winder = NO_WINDER, int32_t value = 0);
+
+    // After the filesystem is mounted: continues numbering from the files
+    // and renumbers what was logged before
+    void begin();
+    void poll();    // from loop()
+    bool flush();   // writes pending entries now
+
+    // Up to `max` entries with seq > after, oldest first; entries that
+    // were rotated out are skipped
+    size_t readAfter(uint32_t after, Entry* out, size_t max) const;
+    // The newest entries that fit in len bytes, flushed first, as the
+    // contents of PATH; for carrying the log over a filesystem update
+    size_t exportRecent(uint8_t* buf, size_t len);
+    uint32_t lastSeq() const { return _nextSeq - 1; }
+    const Stats& stats() const { return _stats; }
+
+    static const char* typeName(Type type);
+    // Human-readable text, e.g. "Winder 1: winding complete, 9000 steps"
+    static size_t describe(const Entry& e, char* buf, size_t len);
+
+private:
+    size_t readFile(const char* path, uint32_t after, Entry* out, size_t max) const;
+
+    Entry _ring[RAM_SLOTS];
+    uint8_t _head = 0;
+    uint8_t _count = 0;         // pending, not yet in PATH
+    uint32_t _nextSeq = 1;
+    uint16_t _boot = 0;
+    bool _ready = false;        // filesystem mounted
+    unsigned long _oldestMs = 0;
+    Stats _stats = {};
+};
+
+extern EventLog eventLog;
+
+#endif // EVENT_LOG_H
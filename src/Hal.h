@@ -0,0 +1,139 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// Thin hardware abstraction layer. Firmware logic calls these instead of
+// Arduino/ESP8266 APIs so it also builds for [env:native], where
+// HalNative.cpp backs them with fakes (see HalNative.h for test hooks).
+// Functions marked ISR-safe live in IRAM on the ESP8266.
+namespace hal {
+
+// GPIO
+void pinModeOutput(int pin);
+void gpioWrite(int pin, bool high);                       // ISR-safe
+bool gpioIsPortPin(int pin);                              // drivable through the port registers
+void gpioPortWrite(uint32_t setMask, uint32_t clearMask); // ISR-safe, set then clear, no read
+void gpioPortClear(uint32_t mask);                        // ISR-safe
+
+// Interrupt masking for short critical sections shared with the step ISR
+uint32_t irqDisable();                                    // ISR-safe, returns the previous state
+void irqRestore(uint32_t state);                          // ISR-safe
+
+// Clock
+unsigned long micros();                                   // ISR-safe
+unsigned long millis();
+void delayMs(unsigned long ms);
+void delayUs(unsigned int us);
+
+// Step timer (timer1 on the ESP8266). Periods are in ticks.
+const uint32_t STEP_TIMER_TICKS_PER_US = 5;
+const uint32_t STEP_TIMER_MAX_TICKS = 0x7FFFFF;
+typedef void (*TimerCallback)();
+void stepTimerAttach(TimerCallback cb);
+void stepTimerDetach();
+void stepTimerArm(uint32_t ticks);    // start periodic interrupts
+void stepTimerReload(uint32_t ticks); // ISR-safe, change the period
+void stepTimerDisarm();               // ISR-safe
+
+// Filesystem (LittleFS), whole-file helpers
+String fsRead(const char* path);
+bool fsWrite(const char* path, const String& content);
+bool fsExists(const char* path);
+bool fsMkdir(const char* path);
+// Binary helpers; fsReadBytes returns the number of bytes read (0 if missing)
+size_t fsReadBytes(const char* path, void* buf, size_t maxLen);
+bool fsWriteBytes(const char* path, const void* data, size_t len);
+bool fsRename(const char* from, const char* to); // replaces `to` atomically
+bool fsRemove(const char* path);
+// Append-only logs
+size_t fsSize(const char* path);                                          // 0 if missing
+size_t fsReadAt(const char* path, size_t offset, void* buf, size_t len);  // bytes read
+bool fsAppendBytes(const char* path, const void* data, size_t len);
+bool fsWriteAt(const char* path, size_t offset, const void* data, size_t len);   // in place, creates
+
+// HTTP client. Returns the status code, or <= 0 on transport failure.
+// https:// URLs are accepted without certificate validation. The requests
+// share one outbound connection: it is kept alive between requests to the
+// same host and closed by httpPoll() after HTTP_IDLE_MS unused, and a TLS
+// reconnect to the same host resumes the previous session.
+const unsigned long HTTP_IDLE_MS = 20000;
+struct HttpStats {
+    uint32_t requests;
+    uint32_t reused;    // sent on a kept-alive connection
+    uint32_t connects;  // new connections
+    uint32_t resumed;   // new TLS connections that resumed a session
+    uint32_t coldMs;    // total time to the response headers on new connections
+    uint32_t warmMs;    // and on reused ones
+};
+void httpPoll();                  // from loop()
+bool httpConnectionOpen();
+const HttpStats& httpStats();
+bool wifiConnected();
+int httpGet(const String& url, String& body);
+// Streaming GET of url from byte `offset` on (a Range request when > 0).
+// onBody gets the body in pieces, always starting at `offset` even if the
+// server ignores the range, with the full resource size; returning false
+// stops the transfer. Returns 200/206 once the whole body has arrived,
+// <= 0 on transport failure (also when the connection drops mid-body),
+// other status codes as they are. Needs a Content-Length.
+typedef bool (*HttpBodyCallback)(void* ctx, size_t size, const uint8_t* data, size_t len);
+int httpGetRange(const char* url, size_t offset, HttpBodyCallback onBody, void* ctx);
+// Conditional GET of a small text resource. Sends the validators from an
+// earlier response (If-None-Match/If-Modified-Since) and returns 304 when
+// the resource is unchanged; on 200 the body is copied into `body`
+// (NUL-terminated, cut at len - 1) and `validators` takes the new ones.
+struct HttpValidators {
+    char etag[64];
+    char lastModified[32];
+};
+int httpGetIfChanged(const char* url, HttpValidators& validators, char* body, size_t len);
+
+// Flashing images (Updater on the ESP8266). Firmware is staged and copied
+// into place by the bootloader on the next restart, which also inflates
+// gzip images. The filesystem is written in place: it is unmounted from
+// flashBegin() until flashEnd()/flashAbort(). Sizes must be known up front.
+enum class FlashTarget : uint8_t { Firmware, Filesystem };
+bool flashBegin(FlashTarget target, size_t size, const char* md5);  // md5: 32 hex digits
+bool flashWrite(const uint8_t* data, size_t len);
+bool flashEnd();    // false if incomplete or the MD5 does not match
+void flashAbort();
+void flashDiscardFirmware();  // unstages a committed firmware image, the running one stays
+
+// Non-blocking TCP client for background senders, polled from loop().
+// DNS, connect and transmit never block; on the ESP8266 they run in the
+// lwIP callbacks of ESPAsyncTCP. A handle stays valid until tcpClose().
+// The first TCP_RX_KEEP bytes of a reply are kept (status line and
+// headers), the rest is only counted; tcpClear() starts over for the next
+// request on a kept-alive connection.
+const size_t TCP_RX_KEEP = 512;
+enum class TcpState : uint8_t { Connecting, Connected, Closed, Failed };
+struct TcpConn;
+TcpConn* tcpOpen(const char* host, uint16_t port); // nullptr if it cannot start
+TcpState tcpState(TcpConn* conn);
+size_t tcpWrite(TcpConn* conn, const char* data, size_t len); // bytes accepted
+size_t tcpRead(TcpConn* conn, char* buf, size_t len);         // kept bytes received so far
+size_t tcpReceived(TcpConn* conn);                            // all bytes received
+void tcpClear(TcpConn* conn);
+void tcpClose(TcpConn* conn);                                 // also frees the handle
+
+// Heap
+uint32_t heapFree();
+uint32_t heapMaxBlock();        // largest block that can be allocated
+uint8_t heapFragmentation();    // 0-100 %
+// Instrumented allocator: onAlloc runs for every allocation and returns a
+// tag kept with the block, handed to onFree when it is released. Hooks must
+// not allocate. Returns false if the allocator has no hooks (the ESP8266).
+typedef uint8_t (*AllocHook)(size_t bytes);
+typedef void (*FreeHook)(size_t bytes, uint8_t tag);
+bool setAllocHooks(AllocHook onAlloc, FreeHook onFree);
+
+// Wall-clock time
+time_t now();
+typedef void (*ClockCallback)();
+void onClockSet(ClockCallback cb);  // after SNTP or anyone sets the time
+
+} // namespace hal
+
+#endif // HAL_H
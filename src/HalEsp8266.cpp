@@ -0,0 +1,531 @@
+#ifndef HAL_NATIVE
+
+#include "Hal.h"
+#include <ESP8266WiFi.h>
+#include <ESP8266HTTPClient.h>
+#include <ESPAsyncTCP.h>
+#include <coredecls.h>
+#include <LittleFS.h>
+#include <Updater.h>
+#include <eboot_command.h>
+
+namespace hal {
+
+void pinModeOutput(int pin) {
+    pinMode(pin, OUTPUT);
+}
+
+void IRAM_ATTR gpioWrite(int pin, bool high) {
+    digitalWrite(pin, high ? HIGH : LOW);
+}
+
+// GPIO16 lives in RTC space, outside GPO/GPOS/GPOC
+bool gpioIsPortPin(int pin) {
+    return pin >= 0 && pin < 16;
+}
+
+// Write-1-to-set then write-1-to-clear: no read of GPO, so pins changed in
+// between by other code are left alone. The two stores are one cycle apart.
+void IRAM_ATTR gpioPortWrite(uint32_t setMask, uint32_t clearMask) {
+    GPOS = setMask;
+    GPOC = clearMask;
+}
+
+void IRAM_ATTR gpioPortClear(uint32_t mask) {
+    GPOC = mask; // write-1-to-clear
+}
+
+uint32_t IRAM_ATTR irqDisable() {
+    return xt_rsil(15);
+}
+
+void IRAM_ATTR irqRestore(uint32_t state) {
+    xt_wsr_ps(state);
+}
+
+unsigned long IRAM_ATTR micros() {
+    return ::micros();
+}
+
+unsigned long millis() {
+    return ::millis();
+}
+
+void delayMs(unsigned long ms) {
+    delay(ms);
+}
+
+void delayUs(unsigned int us) {
+    delayMicroseconds(us);
+}
+
+// timer1 runs from the 80 MHz APB clock; DIV16 gives 5 ticks per microsecond
+// and a 23-bit reload register (max ~1.67 s per period).
+void stepTimerAttach(TimerCallback cb) {
+    timer1_isr_init();
+    timer1_attachInterrupt(cb);
+}
+
+void stepTimerDetach() {
+    timer1_disable();
+    timer1_detachInterrupt();
+}
+
+void stepTimerArm(uint32_t ticks) {
+    timer1_disable();
+    timer1_enable(TIM_DIV16, TIM_EDGE, TIM_LOOP);
+    timer1_write(ticks);
+}
+
+void IRAM_ATTR stepTimerReload(uint32_t ticks) {
+    timer1_write(ticks);
+}
+
+void IRAM_ATTR stepTimerDisarm() {
+    timer1_disable();
+}
+
+String fsRead(const char* path) {
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        Serial.printf("[readFile] Failed to open: %s\n", path);
+        return "";
+    }
+    String content = file.readString();
+    file.close();
+    content.trim();
+    return content;
+}
+
+bool fsWrite(const char* path, const String& content) {
+    File file = LittleFS.open(path, "w");
+    if (!file) {
+        Serial.printf("[writeFile] Failed to open: %s\n", path);
+        return false;
+    }
+    file.print(content);
+    file.close();
+    return true;
+}
+
+bool fsExists(const char* path) {
+    return LittleFS.exists(path);
+}
+
+bool fsMkdir(const char* path) {
+    return LittleFS.mkdir(path);
+}
+
+size_t fsReadBytes(const char* path, void* buf, size_t maxLen) {
+    if (!LittleFS.exists(path)) return 0;
+    File file = LittleFS.open(path, "r");
+    if (!file) return 0;
+    size_t n = file.read((uint8_t*)buf, maxLen);
+    file.close();
+    return n;
+}
+
+bool fsWriteBytes(const char* path, const void* data, size_t len) {
+    File file = LittleFS.open(path, "w");
+    if (!file) {
+        Serial.printf("[writeFile] Failed to open: %s\n", path);
+        return false;
+    }
+    size_t n = file.write((const uint8_t*)data, len);
+    file.close();
+    return n == len;
+}
+
+bool fsRename(const char* from, const char* to) {
+    return LittleFS.rename(from, to);
+}
+
+bool fsRemove(const char* path) {
+    return LittleFS.remove(path);
+}
+
+size_t fsSize(const char* path) {
+    if (!LittleFS.exists(path)) return 0;
+    File file = LittleFS.open(path, "r");
+    if (!file) return 0;
+    size_t size = file.size();
+    file.close();
+    return size;
+}
+
+size_t fsReadAt(const char* path, size_t offset, void* buf, size_t len) {
+    if (!LittleFS.exists(path)) return 0;
+    File file = LittleFS.open(path, "r");
+    if (!file) return 0;
+    size_t n = file.seek(offset) ? file.read((uint8_t*)buf, len) : 0;
+    file.close();
+    return n;
+}
+
+bool fsAppendBytes(const char* path, const void* data, size_t len) {
+    File file = LittleFS.open(path, "a");
+    if (!file) {
+        Serial.printf("[writeFile] Failed to open: %s\n", path);
+        return false;
+    }
+    size_t n = file.write((const uint8_t*)data, len);
+    file.close();
+    return n == len;
+}
+
+bool fsWriteAt(const char* path, size_t offset, const void* data, size_t len) {
+    File file = LittleFS.open(path, LittleFS.exists(path) ? "r+" : "w");
+    if (!file) {
+        Serial.printf("[writeFile] Failed to open: %s\n", path);
+        return false;
+    }
+    size_t n = file.seek(offset) ? file.write((const uint8_t*)data, len) : 0;
+    file.close();
+    return n == len;
+}
+
+bool wifiConnected() {
+    return WiFi.status() == WL_CONNECTED;
+}
+
+// The shared outbound connection. HTTPClient (core 3.x) works on a clone of
+// the client that shares its socket, and with setReuse() end() leaves the
+// socket open when the reply allows it, so the next request to the same
+// host skips the TCP and TLS handshakes. The HTTPClient is kept too: it
+// only reuses a connection its previous response allowed to stay open.
+struct Outbound {
+    HTTPClient http;
+    WiFiClientSecure secure;
+    WiFiClient plain;
+    BearSSL::Session session;  // offered on the next TLS connect to `host`
+    char host[64];
+    uint16_t port;
+    bool https;
+    unsigned long lastUseMs;
+};
+
+static Outbound& outbound() {
+    static Outbound out;
+    return out;
+}
+
+static HttpStats s_httpStats = {};
+
+static void outboundClose() {
+    Outbound& o = outbound();
+    o.secure.stop();  // also frees the TLS buffers
+    o.plain.stop();
+}
+
+// Points the shared connection at the host of `url`
+static WiFiClient& outboundClient(const char* url) {
+    Outbound& o = outbound();
+    bool https = strncmp(url, "https://", 8) == 0;
+    const char* h = strstr(url, "://");
+    h = h ? h + 3 : url;
+    char host[sizeof(o.host)];
+    size_t hostLen = std::min(strcspn(h, ":/"), sizeof(host) - 1);
+    memcpy(host, h, hostLen);
+    host[hostLen] = '\0';
+    uint16_t port = h[hostLen] == ':' ? atoi(h + hostLen + 1) : (https ? 443 : 80);
+
+    if (strcmp(host, o.host) != 0 || port != o.port || https != o.https) {
+        outboundClose();
+        strlcpy(o.host, host, sizeof(o.host));
+        o.port = port;
+        o.https = https;
+        o.session = BearSSL::Session();  // sessions belong to one server
+        if (https) {
+            o.secure.setInsecure();
+            o.secure.setSession(&o.session);
+            // 1 KB records if the server can do them; otherwise the receive
+            // buffer has to hold a full 16 KB record, but requests are small
+            if (WiFiClientSecure::probeMaxFragmentLength(host, port, 1024)) {
+                o.secure.setBufferSizes(1024, 1024);
+            } else {
+                o.secure.setBufferSizes(16384, 512);
+            }
+        }
+    }
+    return https ? (WiFiClient&)o.secure : o.plain;
+}
+
+// GET on the shared connection, up to the response headers; prepare(http)
+// sets timeouts and request headers. A kept-alive connection the server
+// closed in the meantime fails on first use, so that is retried once on a
+// new one. Finish with outboundEnd().
+template <typename Prepare>
+static int outboundGet(const char* url, Prepare prepare) {
+    Outbound& o = outbound();
+    for (uint8_t attempt = 0;; attempt++) {
+        WiFiClient& client = outboundClient(url);
+        bool reused = client.connected();
+        br_ssl_session_parameters offered = *o.session.getSession();
+        if (!o.http.begin(client, url)) return -1;
+        o.http.setReuse(true);
+        prepare(o.http);
+        unsigned long start = ::millis();
+        int code = o.http.GET();
+        unsigned long ms = ::millis() - start;
+        if (code <= 0 && reused && attempt == 0) {
+            o.http.end();
+            outboundClose();
+            continue;
+        }
+        s_httpStats.requests++;
+        if (reused) {
+            s_httpStats.reused++;
+            s_httpStats.warmMs += ms;
+        } else {
+            s_httpStats.connects++;
+            s_httpStats.coldMs += ms;
+            // A resumed session keeps its ID
+            const br_ssl_session_parameters* now = o.session.getSession();
+            if (o.https && code > 0 && offered.session_id_len && offered.session_id_len == now->session_id_len &&
+                memcmp(offered.session_id, now->session_id, offered.session_id_len) == 0) {
+                s_httpStats.resumed++;
+            }
+        }
+        return code;
+    }
+}
+
+// `complete`: the whole response was read, so the connection can be reused
+static void outboundEnd(bool complete) {
+    Outbound& o = outbound();
+    o.http.end();
+    if (!complete) outboundClose();
+    o.lastUseMs = ::millis();
+}
+
+void httpPoll() {
+    Outbound& o = outbound();
+    if (::millis() - o.lastUseMs > HTTP_IDLE_MS && httpConnectionOpen()) {
+        Serial.printf("[HTTP] Closing idle connection to %s\n", o.host);
+        outboundClose();
+    }
+}
+
+bool httpConnectionOpen() {
+    Outbound& o = outbound();
+    return o.https ? o.secure.connected() : o.plain.connected();
+}
+
+const HttpStats& httpStats() {
+    return s_httpStats;
+}
+
+int httpGet(const String& url, String& body) {
+    int httpCode = outboundGet(url.c_str(), [](HTTPClient& http) {
+        http.setTimeout(10000);
+    });
+    if (httpCode == 200) body = outbound().http.getString();
+    outboundEnd(httpCode == 200);
+    return httpCode;
+}
+
+int httpGetRange(const char* url, size_t offset, HttpBodyCallback onBody, void* ctx) {
+    int code = outboundGet(url, [offset](HTTPClient& http) {
+        http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+        http.setTimeout(15000);
+        static const char* headers[] = {"Content-Range"};
+        http.collectHeaders(headers, 1);
+        if (offset > 0) http.addHeader("Range", String("bytes=") + offset + "-");
+    });
+    HTTPClient& http = outbound().http;
+    int length = http.getSize();
+    if ((code != HTTP_CODE_OK && code != HTTP_CODE_PARTIAL_CONTENT) || length <= 0) {
+        outboundEnd(false);
+        return code == HTTP_CODE_OK || code == HTTP_CODE_PARTIAL_CONTENT ? -1 : code;
+    }
+
+    // "bytes <first>-<last>/<size>"; a server that ignores the range resends it all
+    size_t size = length;
+    size_t skip = 0;
+    if (code == HTTP_CODE_PARTIAL_CONTENT) {
+        String range = http.header("Content-Range");
+        int slash = range.indexOf('/');
+        size = slash >= 0 ? strtoul(range.c_str() + slash + 1, nullptr, 10) : 0;
+    } else {
+        skip = offset;
+    }
+
+    WiFiClient* stream = http.getStreamPtr();
+    size_t remaining = length;
+    uint8_t buf[512];
+    unsigned long lastData = ::millis();
+    while (remaining > 0) {
+        size_t avail = stream->available();
+        if (avail == 0) {
+            if (!stream->connected() || ::millis() - lastData > 15000) break;
+            delay(1);
+            continue;
+        }
+        int n = stream->read(buf, std::min(avail, std::min(remaining, sizeof(buf))));
+        if (n <= 0) continue;
+        lastData = ::millis();
+        remaining -= n;
+        size_t from = skip < (size_t)n ? skip : n;
+        skip -= from;
+        if ((size_t)n > from && !onBody(ctx, size, buf + from, n - from)) break;
+        yield();
+    }
+    outboundEnd(remaining == 0);
+    return remaining == 0 ? code : HTTPC_ERROR_READ_TIMEOUT;
+}
+
+int httpGetIfChanged(const char* url, HttpValidators& validators, char* body, size_t len) {
+    int code = outboundGet(url, [&validators](HTTPClient& http) {
+        http.setTimeout(10000);
+        static const char* headers[] = {"ETag", "Last-Modified"};
+        http.collectHeaders(headers, 2);
+        if (validators.etag[0]) http.addHeader("If-None-Match", validators.etag);
+        if (validators.lastModified[0]) http.addHeader("If-Modified-Since", validators.lastModified);
+    });
+    HTTPClient& http = outbound().http;
+    if (code == HTTP_CODE_OK) {
+        strlcpy(body, http.getString().c_str(), len);
+        strlcpy(validators.etag, http.header("ETag").c_str(), sizeof(validators.etag));
+        strlcpy(validators.lastModified, http.header("Last-Modified").c_str(), sizeof(validators.lastModified));
+    }
+    outboundEnd(code == HTTP_CODE_OK || code == HTTP_CODE_NOT_MODIFIED);
+    return code;
+}
+
+static bool s_fsUnmounted = false;  // while the filesystem image is written
+
+bool flashBegin(FlashTarget target, size_t size, const char* md5) {
+    if (target == FlashTarget::Filesystem) {
+        LittleFS.end();
+        s_fsUnmounted = true;
+    }
+    if (!Update.begin(size, target == FlashTarget::Firmware ? U_FLASH : U_FS) || !Update.setMD5(md5)) {
+        Serial.printf("[OTA] Cannot start flashing: %s\n", Update.getErrorString().c_str());
+        flashAbort();
+        return false;
+    }
+    return true;
+}
+
+bool flashWrite(const uint8_t* data, size_t len) {
+    return Update.write(const_cast<uint8_t*>(data), len) == len;
+}
+
+bool flashEnd() {
+    bool ok = Update.end();
+    if (!ok) Serial.printf("[OTA] Flashing failed: %s\n", Update.getErrorString().c_str());
+    if (s_fsUnmounted) LittleFS.begin();
+    s_fsUnmounted = false;
+    return ok;
+}
+
+// An unfinished Updater is reset by end() without committing anything
+void flashAbort() {
+    if (Update.isRunning()) Update.end();
+    if (s_fsUnmounted) LittleFS.begin();
+    s_fsUnmounted = false;
+}
+
+// Update.end() left a copy command for the bootloader; without it the
+// staged image is never copied over the running firmware
+void flashDiscardFirmware() {
+    eboot_command_clear();
+}
+
+// Callbacks run in the lwIP context; they only update state, buffer the
+// first bytes of the reply and count the rest
+struct TcpConn {
+    AsyncClient client;
+    volatile TcpState state = TcpState::Connecting;
+    char rx[TCP_RX_KEEP];
+    volatile size_t rxLen = 0;
+    volatile size_t received = 0;
+};
+
+TcpConn* tcpOpen(const char* host, uint16_t port) {
+    TcpConn* conn = new TcpConn();
+    conn->client.onConnect([](void* arg, AsyncClient*) {
+        ((TcpConn*)arg)->state = TcpState::Connected;
+    }, conn);
+    conn->client.onError([](void* arg, AsyncClient*, int8_t) {
+        ((TcpConn*)arg)->state = TcpState::Failed;
+    }, conn);
+    conn->client.onDisconnect([](void* arg, AsyncClient*) {
+        TcpConn* c = (TcpConn*)arg;
+        if (c->state != TcpState::Failed) c->state = TcpState::Closed;
+    }, conn);
+    conn->client.onData([](void* arg, AsyncClient*, void* data, size_t len) {
+        TcpConn* c = (TcpConn*)arg;
+        size_t n = std::min(len, sizeof(c->rx) - c->rxLen);
+        memcpy(c->rx + c->rxLen, data, n);
+        c->rxLen += n;
+        c->received += len;
+    }, conn);
+    if (!conn->client.connect(host, port)) {
+        delete conn;
+        return nullptr;
+    }
+    return conn;
+}
+
+TcpState tcpState(TcpConn* conn) {
+    return conn->state;
+}
+
+size_t tcpWrite(TcpConn* conn, const char* data, size_t len) {
+    if (conn->state != TcpState::Connected) return 0;
+    size_t n = conn->client.add(data, std::min(len, conn->client.space()));
+    if (n) conn->client.send();
+    return n;
+}
+
+size_t tcpRead(TcpConn* conn, char* buf, size_t len) {
+    size_t n = std::min(len, (size_t)conn->rxLen);
+    memcpy(buf, conn->rx, n);
+    return n;
+}
+
+size_t tcpReceived(TcpConn* conn) {
+    return conn->received;
+}
+
+void tcpClear(TcpConn* conn) {
+    uint32_t irq = irqDisable();
+    conn->rxLen = 0;
+    conn->received = 0;
+    irqRestore(irq);
+}
+
+void tcpClose(TcpConn* conn) {
+    // The destructor aborts the pcb, so no callback sees the freed handle
+    delete conn;
+}
+
+uint32_t heapFree() {
+    return ESP.getFreeHeap();
+}
+
+uint32_t heapMaxBlock() {
+    return ESP.getMaxFreeBlockSize();
+}
+
+uint8_t heapFragmentation() {
+    return ESP.getHeapFragmentation();
+}
+
+// umm_malloc has no allocation hooks
+bool setAllocHooks(AllocHook, FreeHook) {
+    return false;
+}
+
+time_t now() {
+    return time(nullptr);
+}
+
+void onClockSet(ClockCallback cb) {
+    settimeofday_cb(cb);
+}
+
+} // namespace hal
+
+#endif // HAL_NATIVE
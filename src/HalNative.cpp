@@ -0,0 +1,751 @@
+#ifdef HAL_NATIVE
+
+#include "HalNative.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <new>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace hal {
+
+namespace {
+unsigned long s_micros = 0;
+time_t s_epoch = 0;
+unsigned long s_epochBaseMicros = 0;
+ClockCallback s_clockCb = nullptr;
+
+uint32_t s_port = 0;
+bool s_pin16 = false;
+unsigned long s_portWrites = 0;
+
+TimerCallback s_timerCb = nullptr;
+bool s_timerArmed = false;
+uint32_t s_timerTicks = 0;
+unsigned long s_timerDeadline = 0;  // in micros, periods rounded up to whole µs
+
+std::map<std::string, std::string> s_files;
+
+bool s_wifi = true;
+int s_httpCode = 200;
+std::string s_httpBody;
+std::string s_httpEtag;
+std::vector<native::HttpRequest> s_requests;
+
+// Kept-alive socket of httpGetRange(), the only fake that really connects
+struct Outbound {
+    int fd;
+    char host[64];
+    unsigned port;
+    unsigned long lastUseMs;
+};
+Outbound s_outbound = {-1, "", 0, 0};
+HttpStats s_httpStats = {};
+
+// Instrumented allocator behind the global operator new/delete. Every block
+// carries a header with its size and the alloc hook's tag. The fake ESP
+// heap is s_heapSize minus what was allocated since reset(). Blocks made
+// while s_inFlash is set hold fake filesystem contents, which live in flash
+// on the device, and blocks made on threads that called heapIgnoreThread()
+// belong to test stand-ins; neither is charged to the heap.
+struct alignas(std::max_align_t) BlockHeader {
+    size_t size;
+    uint8_t tag;
+};
+const uint8_t UNCOUNTED_TAG = 0xFF;
+AllocHook s_allocHook = nullptr;
+FreeHook s_freeHook = nullptr;
+thread_local bool s_inFlash = false;
+thread_local bool s_ignoreThread = false;
+size_t s_heapLive = 0;
+size_t s_heapBase = 0;
+uint32_t s_heapSize = 40960;
+uint32_t s_heapMaxBlock = 0;  // 0 = the free heap is one block
+
+// Fake flash: images are kept whole, the committed one per target
+struct Flash {
+    bool open;
+    FlashTarget target;
+    size_t size;
+    char md5[33];
+    std::string data;
+    std::string images[2];
+};
+Flash s_flash;
+
+// RFC 1321, for checking fake flash images like Updater does
+std::string md5Hex(const std::string& msg) {
+    static const uint32_t K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+    static const uint8_t R[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+    std::string m = msg;
+    uint64_t bits = (uint64_t)msg.size() * 8;
+    m += (char)0x80;
+    while (m.size() % 64 != 56) m += '\0';
+    for (int i = 0; i < 8; i++) m += (char)(bits >> (8 * i));
+    uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    for (size_t off = 0; off < m.size(); off += 64) {
+        uint32_t w[16];
+        for (int i = 0; i < 16; i++) {
+            const uint8_t* p = (const uint8_t*)m.data() + off + i * 4;
+            w[i] = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        for (int i = 0; i < 64; i++) {
+            uint32_t f;
+            int g;
+            if (i < 16) { f = (b & c) | (~b & d); g = i; }
+            else if (i < 32) { f = (d & b) | (~d & c); g = (5 * i + 1) % 16; }
+            else if (i < 48) { f = b ^ c ^ d; g = (3 * i + 5) % 16; }
+            else { f = c ^ (b | ~d); g = (7 * i) % 16; }
+            uint32_t x = a + f + K[i] + w[g];
+            uint8_t r = R[(i / 16) * 4 + i % 4];
+            a = d;
+            d = c;
+            c = b;
+            b += (x << r) | (x >> (32 - r));
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+    }
+    char hex[33];
+    for (int i = 0; i < 16; i++) snprintf(hex + i * 2, 3, "%02x", (h[i / 4] >> (8 * (i % 4))) & 0xff);
+    return hex;
+}
+
+void* trackedAlloc(size_t size) {
+    BlockHeader* h = (BlockHeader*)malloc(sizeof(BlockHeader) + size);
+    if (!h) return nullptr;
+    h->size = size;
+    if (s_inFlash || s_ignoreThread) {
+        h->tag = UNCOUNTED_TAG;
+        return h + 1;
+    }
+    h->tag = s_allocHook ? s_allocHook(size) : 0;
+    s_heapLive += size;
+    return h + 1;
+}
+
+void trackedFree(void* p) {
+    if (!p) return;
+    BlockHeader* h = (BlockHeader*)p - 1;
+    if (h->tag != UNCOUNTED_TAG) {
+        s_heapLive -= h->size;
+        if (s_freeHook) s_freeHook(h->size, h->tag);
+    }
+    free(h);
+}
+
+// Marks the allocations in a scope as fake filesystem or flash storage
+struct InFlash {
+    InFlash() { s_inFlash = true; }
+    ~InFlash() { s_inFlash = false; }
+};
+
+unsigned long ticksToMicros(uint32_t ticks) {
+    return (ticks + STEP_TIMER_TICKS_PER_US - 1) / STEP_TIMER_TICKS_PER_US;
+}
+} // namespace
+
+void pinModeOutput(int) {}
+
+void gpioWrite(int pin, bool high) {
+    s_portWrites++;
+    if (pin == 16) {
+        s_pin16 = high;
+        return;
+    }
+    if (high) s_port |= (1UL << pin);
+    else s_port &= ~(1UL << pin);
+}
+
+bool gpioIsPortPin(int pin) {
+    return pin >= 0 && pin < 16;
+}
+
+void gpioPortWrite(uint32_t setMask, uint32_t clearMask) {
+    s_portWrites++;
+    s_port = (s_port | setMask) & ~clearMask;
+}
+
+void gpioPortClear(uint32_t mask) {
+    s_portWrites++;
+    s_port &= ~mask;
+}
+
+// Single-threaded host build: the step timer only fires from advanceMicros()
+uint32_t irqDisable() {
+    return 0;
+}
+
+void irqRestore(uint32_t) {}
+
+unsigned long micros() {
+    return s_micros;
+}
+
+unsigned long millis() {
+    return s_micros / 1000;
+}
+
+void delayMs(unsigned long ms) {
+    native::advanceMicros(ms * 1000UL);
+}
+
+void delayUs(unsigned int us) {
+    native::advanceMicros(us);
+}
+
+void stepTimerAttach(TimerCallback cb) {
+    s_timerCb = cb;
+}
+
+void stepTimerDetach() {
+    s_timerArmed = false;
+    s_timerCb = nullptr;
+}
+
+void stepTimerArm(uint32_t ticks) {
+    s_timerArmed = true;
+    s_timerTicks = ticks;
+    s_timerDeadline = s_micros + ticksToMicros(ticks);
+}
+
+// Like timer1_write(): the counter restarts from the new period
+void stepTimerReload(uint32_t ticks) {
+    s_timerTicks = ticks;
+    s_timerDeadline = s_micros + ticksToMicros(ticks);
+}
+
+void stepTimerDisarm() {
+    s_timerArmed = false;
+}
+
+String fsRead(const char* path) {
+    auto it = s_files.find(path);
+    if (it == s_files.end()) return "";
+    String content(it->second.c_str());
+    content.trim();
+    return content;
+}
+
+bool fsWrite(const char* path, const String& content) {
+    InFlash inFlash;
+    s_files[path] = content.c_str();
+    return true;
+}
+
+bool fsExists(const char* path) {
+    return s_files.count(path) > 0;
+}
+
+bool fsMkdir(const char*) {
+    return true;
+}
+
+size_t fsReadBytes(const char* path, void* buf, size_t maxLen) {
+    auto it = s_files.find(path);
+    if (it == s_files.end()) return 0;
+    size_t n = std::min(maxLen, it->second.size());
+    memcpy(buf, it->second.data(), n);
+    return n;
+}
+
+bool fsWriteBytes(const char* path, const void* data, size_t len) {
+    InFlash inFlash;
+    s_files[path].assign((const char*)data, len);
+    return true;
+}
+
+bool fsRename(const char* from, const char* to) {
+    InFlash inFlash;
+    auto it = s_files.find(from);
+    if (it == s_files.end()) return false;
+    s_files[to] = it->second;
+    s_files.erase(from);
+    return true;
+}
+
+bool fsRemove(const char* path) {
+    return s_files.erase(path) > 0;
+}
+
+size_t fsSize(const char* path) {
+    auto it = s_files.find(path);
+    return it == s_files.end() ? 0 : it->second.size();
+}
+
+size_t fsReadAt(const char* path, size_t offset, void* buf, size_t len) {
+    auto it = s_files.find(path);
+    if (it == s_files.end() || offset >= it->second.size()) return 0;
+    size_t n = std::min(len, it->second.size() - offset);
+    memcpy(buf, it->second.data() + offset, n);
+    return n;
+}
+
+bool fsAppendBytes(const char* path, const void* data, size_t len) {
+    InFlash inFlash;
+    s_files[path].append((const char*)data, len);
+    return true;
+}
+
+bool fsWriteAt(const char* path, size_t offset, const void* data, size_t len) {
+    InFlash inFlash;
+    std::string& file = s_files[path];
+    if (file.size() < offset + len) file.resize(offset + len);
+    file.replace(offset, len, (const char*)data, len);
+    return true;
+}
+
+bool wifiConnected() {
+    return s_wifi;
+}
+
+int httpGet(const String& url, String& body) {
+    if (!s_wifi) return -1;
+    s_requests.push_back({"GET", url.c_str(), "", ""});
+    if (s_httpCode == 200) body = s_httpBody.c_str();
+    return s_httpCode;
+}
+
+// The fake response carries s_httpEtag; a request that presents it gets 304
+int httpGetIfChanged(const char* url, HttpValidators& validators, char* body, size_t len) {
+    if (!s_wifi) return -1;
+    s_requests.push_back({"GET", url, "", validators.etag});
+    if (!s_httpEtag.empty() && s_httpEtag == validators.etag) return 304;
+    if (s_httpCode == 200) {
+        strlcpy(body, s_httpBody.c_str(), len);
+        strlcpy(validators.etag, s_httpEtag.c_str(), sizeof(validators.etag));
+        validators.lastModified[0] = '\0';
+    }
+    return s_httpCode;
+}
+
+static void outboundClose() {
+    if (s_outbound.fd >= 0) close(s_outbound.fd);
+    s_outbound.fd = -1;
+}
+
+static int outboundConnect(const char* host, unsigned port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    char portStr[8];
+    snprintf(portStr, sizeof(portStr), "%u", port);
+    if (getaddrinfo(host, portStr, &hints, &res) != 0 || !res) return -1;
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+        if (fd >= 0) close(fd);
+        freeaddrinfo(res);
+        return -1;
+    }
+    freeaddrinfo(res);
+    timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+void httpPoll() {
+    if (s_outbound.fd >= 0 && millis() - s_outbound.lastUseMs > HTTP_IDLE_MS) outboundClose();
+}
+
+bool httpConnectionOpen() {
+    return s_outbound.fd >= 0;
+}
+
+const HttpStats& httpStats() {
+    return s_httpStats;
+}
+
+// Blocking HTTP/1.1 over a real socket, for downloads from a local
+// stand-in server; http:// only. The socket is kept alive like the ESP
+// client's (no TLS here, so nothing is resumed).
+int httpGetRange(const char* url, size_t offset, HttpBodyCallback onBody, void* ctx) {
+    if (!s_wifi) return -1;
+    char host[64];
+    unsigned port = 80;
+    const char* path = "/";
+    if (strncmp(url, "http://", 7) != 0) return -1;
+    const char* h = url + 7;
+    size_t hostLen = strcspn(h, ":/");
+    if (hostLen >= sizeof(host)) return -1;
+    memcpy(host, h, hostLen);
+    host[hostLen] = '\0';
+    if (h[hostLen] == ':') port = strtoul(h + hostLen + 1, nullptr, 10);
+    const char* slash = strchr(h, '/');
+    if (slash) path = slash;
+
+    char req[512];
+    int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\n", path, host);
+    if (offset > 0) n += snprintf(req + n, sizeof(req) - n, "Range: bytes=%zu-\r\n", offset);
+    n += snprintf(req + n, sizeof(req) - n, "\r\n");
+
+    // Status line and headers. A kept-alive socket the server has closed
+    // fails here, which is retried once on a new one.
+    std::string head;
+    char buf[512];
+    ssize_t got;
+    size_t end;
+    bool reused = false;
+    for (uint8_t attempt = 0;; attempt++) {
+        reused = s_outbound.fd >= 0 && strcmp(s_outbound.host, host) == 0 && s_outbound.port == port;
+        if (!reused) {
+            outboundClose();
+            s_outbound.fd = outboundConnect(host, port);
+            if (s_outbound.fd < 0) return -1;
+            strlcpy(s_outbound.host, host, sizeof(s_outbound.host));
+            s_outbound.port = port;
+        }
+        head.clear();
+        bool sent = send(s_outbound.fd, req, n, MSG_NOSIGNAL) == n;
+        while (sent && (end = head.find("\r\n\r\n")) == std::string::npos) {
+            if ((got = recv(s_outbound.fd, buf, sizeof(buf), 0)) <= 0 || head.size() > 4096) break;
+            head.append(buf, got);
+        }
+        if (sent && end != std::string::npos) break;
+        outboundClose();
+        if (!reused || attempt > 0) return -1;
+    }
+    s_httpStats.requests++;
+    if (reused) {
+        s_httpStats.reused++;
+    } else {
+        s_httpStats.connects++;
+    }
+
+    std::string body = head.substr(end + 4);
+    head.resize(end + 2);
+    for (char& c : head) c = tolower(c);
+    int code = atoi(head.c_str() + head.find(' ') + 1);
+    size_t lenPos = head.find("\r\ncontent-length:");
+    long length = lenPos == std::string::npos ? -1 : atol(head.c_str() + lenPos + 17);
+    bool keep = head.find("\r\nconnection: close") == std::string::npos;
+    if ((code != 200 && code != 206) || length <= 0) {
+        outboundClose();
+        return code == 200 || code == 206 ? -1 : code;
+    }
+    size_t size = length;
+    size_t skip = 0;
+    if (code == 206) {
+        size_t rangePos = head.find("\r\ncontent-range:");
+        size_t total = rangePos == std::string::npos ? std::string::npos : head.find('/', rangePos);
+        size = total == std::string::npos ? 0 : strtoul(head.c_str() + total + 1, nullptr, 10);
+    } else {
+        skip = offset;
+    }
+
+    size_t remaining = length;
+    for (;;) {
+        size_t take = std::min(body.size(), remaining);
+        remaining -= take;
+        size_t from = std::min(skip, take);
+        skip -= from;
+        if (take > from && !onBody(ctx, size, (const uint8_t*)body.data() + from, take - from)) break;
+        if (remaining == 0) break;
+        if ((got = recv(s_outbound.fd, buf, std::min(sizeof(buf), remaining), 0)) <= 0) break;
+        body.assign(buf, got);
+    }
+    if (remaining != 0 || !keep) outboundClose();
+    s_outbound.lastUseMs = millis();
+    return remaining == 0 ? code : -1;
+}
+
+bool flashBegin(FlashTarget target, size_t size, const char* md5) {
+    if (s_flash.open || size == 0 || !md5 || strlen(md5) != 32) return false;
+    InFlash inFlash;
+    // The device overwrites the filesystem in place; its files are gone either way
+    if (target == FlashTarget::Filesystem) s_files.clear();
+    s_flash.open = true;
+    s_flash.target = target;
+    s_flash.size = size;
+    strlcpy(s_flash.md5, md5, sizeof(s_flash.md5));
+    s_flash.data.clear();
+    return true;
+}
+
+bool flashWrite(const uint8_t* data, size_t len) {
+    if (!s_flash.open || s_flash.data.size() + len > s_flash.size) return false;
+    InFlash inFlash;
+    s_flash.data.append((const char*)data, len);
+    return true;
+}
+
+bool flashEnd() {
+    if (!s_flash.open) return false;
+    s_flash.open = false;
+    if (s_flash.data.size() != s_flash.size || strcasecmp(md5Hex(s_flash.data).c_str(), s_flash.md5) != 0) return false;
+    InFlash inFlash;
+    s_flash.images[(uint8_t)s_flash.target] = s_flash.data;
+    return true;
+}
+
+void flashAbort() {
+    s_flash.open = false;
+}
+
+void flashDiscardFirmware() {
+    s_flash.images[(uint8_t)FlashTarget::Firmware].clear();
+}
+
+// Real non-blocking sockets, so senders can be tested against a local
+// HTTP stand-in. Name lookup blocks, which is fine for localhost.
+struct TcpConn {
+    int fd;
+    TcpState state;
+    char rx[TCP_RX_KEEP];
+    size_t rxLen;
+    size_t received;
+};
+
+TcpConn* tcpOpen(const char* host, uint16_t port) {
+    if (!s_wifi) return nullptr;
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    char portStr[8];
+    snprintf(portStr, sizeof(portStr), "%u", port);
+    if (getaddrinfo(host, portStr, &hints, &res) != 0 || !res) return nullptr;
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return nullptr;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int rc = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return nullptr;
+    }
+    return new TcpConn{fd, TcpState::Connecting, {}, 0, 0};
+}
+
+TcpState tcpState(TcpConn* conn) {
+    if (conn->state == TcpState::Connecting) {
+        pollfd p = {conn->fd, POLLOUT, 0};
+        if (poll(&p, 1, 0) > 0) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            conn->state = err ? TcpState::Failed : TcpState::Connected;
+        }
+    }
+    if (conn->state == TcpState::Connected) {
+        char buf[256];
+        ssize_t n;
+        while ((n = recv(conn->fd, buf, sizeof(buf), 0)) > 0) {
+            size_t keep = std::min((size_t)n, sizeof(conn->rx) - conn->rxLen);
+            memcpy(conn->rx + conn->rxLen, buf, keep);
+            conn->rxLen += keep;
+            conn->received += n;
+        }
+        if (n == 0) conn->state = TcpState::Closed;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) conn->state = TcpState::Failed;
+    }
+    return conn->state;
+}
+
+size_t tcpWrite(TcpConn* conn, const char* data, size_t len) {
+    if (tcpState(conn) != TcpState::Connected) return 0;
+    ssize_t n = send(conn->fd, data, len, MSG_NOSIGNAL);
+    return n > 0 ? (size_t)n : 0;
+}
+
+size_t tcpRead(TcpConn* conn, char* buf, size_t len) {
+    tcpState(conn);
+    size_t n = std::min(len, conn->rxLen);
+    memcpy(buf, conn->rx, n);
+    return n;
+}
+
+size_t tcpReceived(TcpConn* conn) {
+    tcpState(conn);
+    return conn->received;
+}
+
+void tcpClear(TcpConn* conn) {
+    conn->rxLen = 0;
+    conn->received = 0;
+}
+
+void tcpClose(TcpConn* conn) {
+    close(conn->fd);
+    delete conn;
+}
+
+uint32_t heapFree() {
+    size_t used = s_heapLive > s_heapBase ? s_heapLive - s_heapBase : 0;
+    return used < s_heapSize ? s_heapSize - (uint32_t)used : 0;
+}
+
+uint32_t heapMaxBlock() {
+    uint32_t free = heapFree();
+    return s_heapMaxBlock && s_heapMaxBlock < free ? s_heapMaxBlock : free;
+}
+
+// Same measure as the ESP8266 core: the share of free heap outside the largest block
+uint8_t heapFragmentation() {
+    uint32_t free = heapFree();
+    return free ? (uint8_t)(100 - (uint64_t)heapMaxBlock() * 100 / free) : 0;
+}
+
+bool setAllocHooks(AllocHook onAlloc, FreeHook onFree) {
+    s_allocHook = onAlloc;
+    s_freeHook = onFree;
+    return true;
+}
+
+time_t now() {
+    return s_epoch + (time_t)((s_micros - s_epochBaseMicros) / 1000000UL);
+}
+
+void onClockSet(ClockCallback cb) {
+    s_clockCb = cb;
+}
+
+namespace native {
+
+void reset() {
+    s_micros = 0;
+    s_epoch = 0;
+    s_epochBaseMicros = 0;
+    s_clockCb = nullptr;
+    s_port = 0;
+    s_pin16 = false;
+    s_portWrites = 0;
+    s_timerCb = nullptr;
+    s_timerArmed = false;
+    s_files.clear();
+    s_wifi = true;
+    s_httpCode = 200;
+    s_httpBody.clear();
+    s_httpEtag.clear();
+    s_requests.clear();
+    if (s_outbound.fd >= 0) close(s_outbound.fd);
+    s_outbound = {-1, "", 0, 0};
+    s_httpStats = {};
+    s_heapSize = 40960;
+    s_heapMaxBlock = 0;
+    s_heapBase = s_heapLive;
+    s_flash.open = false;
+    s_flash.images[0].clear();
+    s_flash.images[1].clear();
+}
+
+// Step through every timer deadline inside the window so the callback sees
+// the same clock it would on hardware
+void advanceMicros(unsigned long us) {
+    unsigned long target = s_micros + us;
+    while (s_timerArmed && s_timerCb && (long)(target - s_timerDeadline) >= 0) {
+        s_micros = s_timerDeadline;
+        s_timerDeadline += ticksToMicros(s_timerTicks);
+        s_timerCb();
+    }
+    s_micros = target;
+}
+
+void setEpoch(time_t epoch) {
+    s_epoch = epoch;
+    s_epochBaseMicros = s_micros;
+    if (s_clockCb) s_clockCb();
+}
+
+bool stepTimerArmed() {
+    return s_timerArmed;
+}
+
+uint32_t stepTimerPeriodTicks() {
+    return s_timerTicks;
+}
+
+uint32_t gpioPort() {
+    return s_port;
+}
+
+bool gpioPin(int pin) {
+    if (pin == 16) return s_pin16;
+    return (s_port >> pin) & 1;
+}
+
+unsigned long gpioPortWrites() {
+    return s_portWrites;
+}
+
+std::map<std::string, std::string>& files() {
+    return s_files;
+}
+
+void setWifiConnected(bool connected) {
+    s_wifi = connected;
+}
+
+void setHttpResponse(int code, const std::string& body, const std::string& etag) {
+    s_httpCode = code;
+    s_httpBody = body;
+    s_httpEtag = etag;
+}
+
+const std::vector<HttpRequest>& httpRequests() {
+    return s_requests;
+}
+
+void setHeap(uint32_t size, uint32_t maxBlock) {
+    s_heapSize = size;
+    s_heapMaxBlock = maxBlock;
+    s_heapBase = s_heapLive;
+}
+
+void heapIgnoreThread() {
+    s_ignoreThread = true;
+}
+
+size_t heapAllocated() {
+    return s_heapLive > s_heapBase ? s_heapLive - s_heapBase : 0;
+}
+
+const std::string& flashImage(FlashTarget target) {
+    return s_flash.images[(uint8_t)target];
+}
+
+bool flashOpen() {
+    return s_flash.open;
+}
+
+} // namespace native
+} // namespace hal
+
+void* operator new(size_t size) {
+    void* p = hal::trackedAlloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return hal::trackedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return hal::trackedAlloc(size); }
+void operator delete(void* p) noexcept { hal::trackedFree(p); }
+void operator delete[](void* p) noexcept { hal::trackedFree(p); }
+void operator delete(void* p, size_t) noexcept { hal::trackedFree(p); }
+void operator delete[](void* p, size_t) noexcept { hal::trackedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { hal::trackedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { hal::trackedFree(p); }
+
+#endif // HAL_NATIVE
@@ -0,0 +1,65 @@
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+#ifdef HAL_NATIVE
+
+#include "Hal.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Test hooks for the fakes behind Hal.h in [env:native]. Time only moves
+// when a test advances it; the step timer callback fires from advanceMicros()
+// at its exact deadlines, so step timing can be checked tick by tick.
+namespace hal {
+namespace native {
+
+struct HttpRequest {
+    std::string method;
+    std::string url;
+    std::string body;
+    std::string ifNoneMatch;  // httpGetIfChanged()
+};
+
+void reset();                        // clear all fake state
+
+// Clock and step timer
+void advanceMicros(unsigned long us); // fires due step timer interrupts
+void setEpoch(time_t epoch);          // also runs the onClockSet() callback
+bool stepTimerArmed();
+uint32_t stepTimerPeriodTicks();
+
+// GPIO
+uint32_t gpioPort();                 // port register (pins 0-15)
+bool gpioPin(int pin);
+unsigned long gpioPortWrites();      // number of port/pin writes so far
+
+// Filesystem contents, path -> data
+std::map<std::string, std::string>& files();
+
+// HTTP
+void setWifiConnected(bool connected);
+// A non-empty etag makes httpGetIfChanged() answer 304 to requests presenting it
+void setHttpResponse(int code, const std::string& body = "", const std::string& etag = "");
+const std::vector<HttpRequest>& httpRequests();
+
+// Heap. operator new/delete are instrumented (see hal::setAllocHooks());
+// the fake ESP heap has `size` bytes free at this call, less everything
+// allocated since. maxBlock caps the largest block (0 = no fragmentation).
+// Files written through hal::fs* are flash, not heap, and are not counted.
+void setHeap(uint32_t size, uint32_t maxBlock = 0);
+size_t heapAllocated();              // bytes allocated since reset()/setHeap() and not freed
+void heapIgnoreThread();             // the calling thread's allocations are not counted
+
+// Flash. httpGetRange() talks to a real http:// server (a local stand-in);
+// flashEnd() checks the MD5 and keeps the image per target. Flashing the
+// filesystem empties files(), as writing the image does on the device.
+const std::string& flashImage(FlashTarget target);  // last committed, "" if none or discarded
+bool flashOpen();                    // between flashBegin() and flashEnd()/flashAbort()
+
+} // namespace native
+} // namespace hal
+
+#endif // HAL_NATIVE
+
+#endif // HAL_NATIVE_H
@@ -0,0 +1,104 @@
+#include "HeapMonitor.h"
+
+HeapMonitor heapMonitor;
+
+HeapMonitor::HeapMonitor() {
+    memset(_tags, 0, sizeof(_tags));
+    _boot = {0, UINT32_MAX, UINT32_MAX, 0};
+    _history[0] = _boot;
+}
+
+void HeapMonitor::begin() {
+    _instrumented = hal::setAllocHooks(onAlloc, onFree);
+    _periodStartMs = hal::millis();
+    _history[_last].startS = _periodStartMs / 1000;
+    _count = 1;
+    Serial.printf("[Heap] Allocation tracking: %s\n", _instrumented ? "per allocation" : "per scope");
+}
+
+void HeapMonitor::fold(LowWater& low, const Heap& heap) {
+    if (heap.free < low.minFree) low.minFree = heap.free;
+    if (heap.maxBlock < low.minMaxBlock) low.minMaxBlock = heap.maxBlock;
+    if (heap.fragmentation > low.maxFragmentation) low.maxFragmentation = heap.fragmentation;
+}
+
+HeapMonitor::Heap HeapMonitor::sample() {
+    Heap heap = {hal::heapFree(), hal::heapMaxBlock(), hal::heapFragmentation()};
+    unsigned long now = hal::millis();
+    if (now - _periodStartMs >= PERIOD_MS) {
+        _periodStartMs = now;
+        _last = (_last + 1) % HISTORY;
+        _history[_last] = {(uint32_t)(now / 1000), UINT32_MAX, UINT32_MAX, 0};
+        if (_count < HISTORY) _count++;
+    }
+    fold(_boot, heap);
+    fold(_history[_last], heap);
+    return heap;
+}
+
+const HeapMonitor::LowWater& HeapMonitor::history(uint8_t i) const {
+    return _history[(_last + HISTORY - i) % HISTORY];
+}
+
+void HeapMonitor::resetTags() {
+    uint32_t irq = hal::irqDisable();
+    for (uint8_t i = 0; i < (uint8_t)HeapTag::Count; i++) {
+        // Blocks still held are credited back when freed, so keep liveBytes
+        int32_t live = _tags[i].liveBytes;
+        _tags[i] = {0, 0, 0, live, live > 0 ? (uint32_t)live : 0};
+    }
+    hal::irqRestore(irq);
+}
+
+const char* HeapMonitor::tagName(HeapTag tag) {
+    switch (tag) {
+        case HeapTag::Other:   return "other";
+        case HeapTag::Http:    return "http";
+        case HeapTag::Ota:     return "ota";
+        case HeapTag::Ntfy:    return "ntfy";
+        case HeapTag::Config:  return "config";
+        case HeapTag::Events:  return "events";
+        case HeapTag::History: return "history";
+        case HeapTag::Live:    return "live";
+        default:               return "?";
+    }
+}
+
+HeapTag HeapMonitor::enter(HeapTag tag) {
+    HeapTag previous = _current;
+    _current = tag;
+    return previous;
+}
+
+void HeapMonitor::leave(HeapTag tag, HeapTag previous, uint32_t freeAtEnter) {
+    _current = previous;
+    if (_instrumented) return;
+    // Without allocator hooks the scope is charged what it kept
+    charge((uint8_t)tag, (int32_t)(freeAtEnter - hal::heapFree()));
+}
+
+void HeapMonitor::charge(uint8_t tag, int32_t bytes) {
+    if (tag >= (uint8_t)HeapTag::Count || bytes == 0) return;
+    uint32_t irq = hal::irqDisable();
+    TagStats& s = _tags[tag];
+    if (bytes > 0) {
+        s.allocs++;
+        s.bytes += bytes;
+    } else {
+        s.frees++;
+    }
+    s.liveBytes += bytes;
+    if (s.liveBytes > 0 && (uint32_t)s.liveBytes > s.peakBytes) s.peakBytes = s.liveBytes;
+    hal::irqRestore(irq);
+}
+
+// Called by the instrumented allocator; must not allocate
+uint8_t HeapMonitor::onAlloc(size_t bytes) {
+    uint8_t tag = (uint8_t)heapMonitor._current;
+    heapMonitor.charge(tag, (int32_t)bytes);
+    return tag;
+}
+
+void HeapMonitor::onFree(size_t bytes, uint8_t tag) {
+    heapMonitor.charge(tag, -(int32_t)bytes);
+}
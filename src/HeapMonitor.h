@@ -0,0 +1,97 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include "Hal.h"
+
+// Subsystems heap use is charged to; HeapScope sets the current one
+enum class HeapTag : uint8_t { Other, Http, Ota, Ntfy, Config, Events, History, Live, Count };
+
+// Heap health: free heap, largest free block and fragmentation now, their
+// worst values since boot and per hour (low-water history), and heap use
+// per subsystem.
+//
+// With an instrumented allocator (the native build) every allocation is
+// charged to the HeapTag current when it was made and credited back when
+// it is freed. The ESP8266 allocator has no hooks, so there each HeapScope
+// charges the net change in free heap across the scope instead: counts are
+// per scope, bytes are what the scope kept (or released), and a nested
+// scope's bytes also count toward the enclosing one.
+class HeapMonitor {
+public:
+    static const uint8_t HISTORY = 24;
+    static const uint32_t PERIOD_MS = 3600000;  // one history entry per hour
+
+    struct TagStats {
+        uint32_t allocs;
+        uint32_t frees;
+        uint32_t bytes;      // allocated in total
+        int32_t liveBytes;   // held now
+        uint32_t peakBytes;  // most held at once
+    };
+
+    // Worst values over a period
+    struct LowWater {
+        uint32_t startS;     // uptime at the start of the period
+        uint32_t minFree;
+        uint32_t minMaxBlock;
+        uint8_t maxFragmentation;
+    };
+
+    struct Heap {
+        uint32_t free;
+        uint32_t maxBlock;
+        uint8_t fragmentation;  // %
+    };
+
+    HeapMonitor();
+
+    // Hooks into the allocator when it is instrumented
+    void begin();
+    bool instrumented() const { return _instrumented; }
+
+    // Reads the heap and updates the low-water marks; every few seconds
+    // from loop(). A new history entry starts every PERIOD_MS.
+    Heap sample();
+
+    const LowWater& sinceBoot() const { return _boot; }
+    uint8_t historyCount() const { return _count; }
+    const LowWater& history(uint8_t i) const;  // 0 = current period, then older
+
+    const TagStats& tag(HeapTag tag) const { return _tags[(uint8_t)tag]; }
+    void resetTags();
+    static const char* tagName(HeapTag tag);
+
+    // For HeapScope
+    HeapTag enter(HeapTag tag);
+    void leave(HeapTag tag, HeapTag previous, uint32_t freeAtEnter);
+
+private:
+    static uint8_t onAlloc(size_t bytes);
+    static void onFree(size_t bytes, uint8_t tag);
+    void charge(uint8_t tag, int32_t bytes);
+    void fold(LowWater& low, const Heap& heap);
+
+    TagStats _tags[(uint8_t)HeapTag::Count];
+    HeapTag _current = HeapTag::Other;
+    bool _instrumented = false;
+    LowWater _boot;
+    LowWater _history[HISTORY];  // ring, _history[_last] is the current period
+    uint8_t _last = 0;
+    uint8_t _count = 0;
+    unsigned long _periodStartMs = 0;
+};
+
+extern HeapMonitor heapMonitor;
+
+// Charges heap use in the enclosing scope to a subsystem
+class HeapScope {
+public:
+    explicit HeapScope(HeapTag tag) : _tag(tag), _free(hal::heapFree()), _previous(heapMonitor.enter(tag)) {}
+    ~HeapScope() { heapMonitor.leave(_tag, _previous, _free); }
+private:
+    HeapTag _tag;
+    uint32_t _free;
+    HeapTag _previous;
+};
+
+#endif // HEAP_MONITOR_H
@@ -0,0 +1,88 @@
+#ifndef JSON_RESPONSE_POOL_H
+#define JSON_RESPONSE_POOL_H
+
+#include <Arduino.h>
+#include <new>
+#include <type_traits>
+#include "JsonStreamWriter.h"
+
+// Fixed slots for chunked JSON responses. A slot holds a copy of the data
+// a response renders from and the function that renders it; the chunk
+// filler only captures the slot's address, which the response's
+// std::function keeps without allocating. Each chunk renders the document
+// from the same copy into the send buffer, keeping the bytes that fall in
+// its window, so the chunks always join up.
+//
+// Copies up to SmallBytes go into one of SmallSlots small slots, larger
+// ones (or any when the small slots are taken) into the one large slot.
+// take() returns nullptr when nothing fits; release() once the response
+// is done with the slot. Used from one context only (the TCP callbacks).
+template <size_t SmallBytes, uint8_t SmallSlots, size_t LargeBytes>
+class JsonResponsePool {
+    static_assert(SmallBytes % 8 == 0, "small slots must keep 8-byte alignment");
+
+public:
+    static const uint8_t SLOTS = SmallSlots + 1;
+
+    class Slot {
+    public:
+        // Writes bytes [index, index + maxLen) of the document to buf and
+        // returns how many; 0 once index is past the end
+        size_t fill(uint8_t* buf, size_t maxLen, size_t index) const {
+            JsonStreamWriter json((char*)buf, maxLen, index);
+            _thunk(json, *this);
+            return json.written();
+        }
+
+    private:
+        friend class JsonResponsePool;
+        template <typename Data>
+        static void renderAs(JsonStreamWriter& json, const Slot& slot) {
+            ((void (*)(JsonStreamWriter&, const Data&))slot._render)(json, *(const Data*)slot._data);
+        }
+
+        void (*_thunk)(JsonStreamWriter&, const Slot&) = nullptr;
+        void (*_render)() = nullptr;  // the caller's renderer, type-erased
+        uint8_t* _data = nullptr;
+        bool _busy = false;
+    };
+
+    JsonResponsePool() {
+        for (uint8_t i = 0; i < SmallSlots; i++) _slots[i]._data = _small[i];
+        _slots[SmallSlots]._data = _large;
+    }
+
+    template <typename Data>
+    const Slot* take(const Data& data, void (*render)(JsonStreamWriter&, const Data&)) {
+        static_assert(sizeof(Data) <= LargeBytes, "response data does not fit the large slot");
+        static_assert(alignof(Data) <= 8, "response data needs more than 8-byte alignment");
+        static_assert(std::is_trivially_destructible<Data>::value, "slots are released without a destructor");
+        for (uint8_t i = sizeof(Data) <= SmallBytes ? 0 : SmallSlots; i < SLOTS; i++) {
+            Slot& slot = _slots[i];
+            if (slot._busy) continue;
+            new (slot._data) Data(data);
+            slot._thunk = &Slot::template renderAs<Data>;
+            slot._render = (void (*)())render;
+            slot._busy = true;
+            return &slot;
+        }
+        return nullptr;
+    }
+
+    void release(const Slot* slot) {
+        if (slot) const_cast<Slot*>(slot)->_busy = false;
+    }
+
+    uint8_t inUse() const {
+        uint8_t n = 0;
+        for (const Slot& slot : _slots) n += slot._busy;
+        return n;
+    }
+
+private:
+    alignas(8) uint8_t _small[SmallSlots][SmallBytes];
+    alignas(8) uint8_t _large[LargeBytes];
+    Slot _slots[SLOTS];
+};
+
+#endif // JSON_RESPONSE_POOL_H
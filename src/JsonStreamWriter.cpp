@@ -0,0 +1,110 @@
+#include "JsonStreamWriter.h"
+
+// Copies the part of s that falls inside the window
+void JsonStreamWriter::put(const char* s, size_t n) {
+    size_t end = _skip + _len;
+    if (_pos < end && _pos + n > _skip) {
+        size_t from = _pos < _skip ? _skip - _pos : 0;
+        size_t to = _pos + n > end ? end - _pos : n;
+        memcpy(_buf + (_pos + from - _skip), s + from, to - from);
+    }
+    _pos += n;
+}
+
+size_t JsonStreamWriter::written() const {
+    if (_pos <= _skip) return 0;
+    return _pos - _skip < _len ? _pos - _skip : _len;
+}
+
+void JsonStreamWriter::element() {
+    if (_depth == 0) return;
+    uint16_t bit = 1 << (_depth - 1);
+    if (_hasItems & bit) put(',');
+    _hasItems |= bit;
+}
+
+void JsonStreamWriter::member(const char* key) {
+    element();
+    if (!key) return;
+    string(key);
+    put(':');
+}
+
+JsonStreamWriter& JsonStreamWriter::beginObject(const char* key) {
+    member(key);
+    put('{');
+    if (_depth < MAX_DEPTH) _hasItems &= ~(1 << _depth++);
+    return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::endObject() {
+    if (_depth) _depth--;
+    put('}');
+    return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::beginArray(const char* key) {
+    member(key);
+    put('[');
+    if (_depth < MAX_DEPTH) _hasItems &= ~(1 << _depth++);
+    return *this;
+}
+
+JsonStreamWriter& JsonStreamWriter::endArray() {
+    if (_depth) _depth--;
+    put(']');
+    return *this;
+}
+
+void JsonStreamWriter::string(const char* s) {
+    if (!s) {
+        literal("null");
+        return;
+    }
+    put('"');
+    const char* run = s;  // unescaped bytes are copied in runs
+    for (; *s; s++) {
+        char esc = 0;
+        switch (*s) {
+        case '"': esc = '"'; break;
+        case '\\': esc = '\\'; break;
+        case '\n': esc = 'n'; break;
+        case '\r': esc = 'r'; break;
+        case '\t': esc = 't'; break;
+        default:
+            if ((uint8_t)*s >= 0x20) continue;
+        }
+        put(run, s - run);
+        run = s + 1;
+        if (esc) {
+            char pair[2] = {'\\', esc};
+            put(pair, 2);
+        } else {
+            char hex[7];
+            snprintf(hex, sizeof(hex), "\\u%04x", (uint8_t)*s);
+            put(hex, 6);
+        }
+    }
+    put(run, s - run);
+    put('"');
+}
+
+void JsonStreamWriter::number(double value, uint8_t decimals) {
+    if (value != value || value > 1e15 || value < -1e15) {
+        literal("null");  // NaN and out of range are not valid JSON numbers
+        return;
+    }
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    put(buf, n > 0 && n < (int)sizeof(buf) ? n : 0);
+}
+
+void JsonStreamWriter::unsignedInt(unsigned long long value) {
+    char buf[20];
+    uint8_t i = sizeof(buf);
+    do {
+        buf[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    put(buf + i, sizeof(buf) - i);
+}
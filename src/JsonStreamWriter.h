@@ -0,0 +1,87 @@
+#ifndef JSON_STREAM_WRITER_H
+#define JSON_STREAM_WRITER_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+// Allocation-free JSON writer for HTTP responses. It writes into a fixed
+// window of the output: bytes [skip, skip + len) land in buf, everything
+// else is only counted, so a chunked response renders the whole document
+// per chunk and keeps the chunk's part (see JsonResponsePool). Every pass
+// must produce the same output: render from a copy, not from live values.
+//
+//   json.beginObject().field("running", true).beginArray("hist");
+//   for (...) json.value(n);
+//   json.endArray().endObject();
+class JsonStreamWriter {
+public:
+    static const uint8_t MAX_DEPTH = 16;
+
+    JsonStreamWriter(char* buf, size_t len, size_t skip = 0) : _buf(buf), _len(len), _skip(skip) {}
+
+    // Containers; the key is for members of an object
+    JsonStreamWriter& beginObject(const char* key = nullptr);
+    JsonStreamWriter& endObject();
+    JsonStreamWriter& beginArray(const char* key = nullptr);
+    JsonStreamWriter& endArray();
+
+    // Object members. A null string writes null; bools pick the non-template overloads.
+    JsonStreamWriter& field(const char* key, const char* value) { member(key); string(value); return *this; }
+    JsonStreamWriter& field(const char* key, bool value) { member(key); literal(value ? "true" : "false"); return *this; }
+    JsonStreamWriter& field(const char* key, double value, uint8_t decimals = 2) { member(key); number(value, decimals); return *this; }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, JsonStreamWriter&>::type field(const char* key, T value) {
+        member(key);
+        integer(value);
+        return *this;
+    }
+    // Pre-serialized JSON
+    JsonStreamWriter& rawField(const char* key, const char* json) { member(key); literal(json); return *this; }
+
+    // Array elements
+    JsonStreamWriter& value(const char* v) { element(); string(v); return *this; }
+    JsonStreamWriter& value(bool v) { element(); literal(v ? "true" : "false"); return *this; }
+    JsonStreamWriter& value(double v, uint8_t decimals = 2) { element(); number(v, decimals); return *this; }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, JsonStreamWriter&>::type value(T v) {
+        element();
+        integer(v);
+        return *this;
+    }
+
+    size_t length() const { return _pos; }  // whole document so far
+    size_t written() const;                 // bytes stored in buf
+
+private:
+    void put(const char* s, size_t n);
+    void put(char c) { put(&c, 1); }
+    void literal(const char* s) { put(s, strlen(s)); }
+    void string(const char* s);
+    void number(double value, uint8_t decimals);
+    void unsignedInt(unsigned long long value);
+    void element();
+    void member(const char* key);
+
+    template <typename T>
+    typename std::enable_if<std::is_signed<T>::value>::type integer(T value) {
+        if (value < 0) {
+            put('-');
+            unsignedInt(0ULL - (unsigned long long)value);
+        } else {
+            unsignedInt(value);
+        }
+    }
+    template <typename T>
+    typename std::enable_if<!std::is_signed<T>::value>::type integer(T value) {
+        unsignedInt(value);
+    }
+
+    char* _buf;
+    size_t _len;
+    size_t _skip;
+    size_t _pos = 0;
+    uint8_t _depth = 0;
+    uint16_t _hasItems = 0;  // bit n: the container at depth n has an item
+};
+
+#endif // JSON_STREAM_WRITER_H
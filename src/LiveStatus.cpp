@@ -0,0 +1,47 @@
+#include "LiveStatus.h"
+#include <stdarg.h>
+
+LiveStatus liveStatus;
+
+void LiveStatus::put(const char* fmt, ...) {
+    if (_pos >= _len) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(_buf + _pos, _len - _pos, fmt, args);
+    va_end(args);
+    if (n > 0) _pos += n;
+}
+
+static bool sameMotor(const LiveStatus::MotorState& a, const LiveStatus::MotorState& b) {
+    return a.running == b.running && a.totalSteps == b.totalSteps && a.stepsLeft == b.stepsLeft && a.etaSec == b.etaSec;
+}
+
+size_t LiveStatus::delta(const Snapshot& snap, char* buf, size_t len) {
+    bool full = _full;
+    _buf = buf;
+    _len = len;
+    _pos = 0;
+    _fields = 0;
+
+    put("{");
+    for (uint8_t m = 0; m < WINDER_COUNT; m++) {
+        const MotorState& s = snap.motors[m];
+        if (!full && sameMotor(s, _sent.motors[m])) continue;
+        put("%s\"m%u\":{\"run\":%u,\"total\":%u,\"left\":%u,\"eta\":%u}", sep(), m, s.running ? 1 : 0,
+            (unsigned)s.totalSteps, (unsigned)s.stepsLeft, (unsigned)s.etaSec);
+    }
+    if (full || snap.nextWinding != _sent.nextWinding) put("%s\"next\":%u", sep(), (unsigned)snap.nextWinding);
+    if (full || snap.lastWinding != _sent.lastWinding) put("%s\"last\":%u", sep(), (unsigned)snap.lastWinding);
+    uint32_t heapDiff = snap.freeHeap > _sent.freeHeap ? snap.freeHeap - _sent.freeHeap : _sent.freeHeap - snap.freeHeap;
+    bool heap = full || heapDiff >= HEAP_STEP;
+    if (heap) put("%s\"heap\":%u", sep(), (unsigned)snap.freeHeap);
+    put("}");
+
+    if (_fields == 0 || _pos >= _len) return 0;
+    // The heap baseline only moves when it is sent, so slow drift still shows
+    uint32_t sentHeap = heap ? snap.freeHeap : _sent.freeHeap;
+    _sent = snap;
+    _sent.freeHeap = sentHeap;
+    if (full) _full = false;
+    return _pos;
+}
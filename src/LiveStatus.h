@@ -0,0 +1,54 @@
+#ifndef LIVE_STATUS_H
+#define LIVE_STATUS_H
+
+#include <Arduino.h>
+#include "ConfigConstants.h"
+
+// Change-only status updates for the /api/live event stream. delta()
+// compares a snapshot with what was last sent and encodes just the groups
+// that changed as compact JSON, e.g. {"m0":{"run":1,"total":9000,
+// "left":4100,"eta":140},"heap":23040}. Times are epoch seconds. The
+// caller rate-limits by calling it every INTERVAL_MS.
+class LiveStatus {
+public:
+    static const unsigned long INTERVAL_MS = 500;  // at most two updates a second
+    static const uint32_t HEAP_STEP = 1024;        // smaller heap changes are noise
+    static const size_t MAX_LEN = 64 + 72 * WINDER_COUNT;
+
+    struct MotorState {
+        bool running;
+        uint32_t totalSteps;  // of the current program, 0 if open-ended
+        uint32_t stepsLeft;
+        uint32_t etaSec;
+    };
+
+    struct Snapshot {
+        MotorState motors[WINDER_COUNT];
+        uint32_t nextWinding;  // epoch, 0 = none
+        uint32_t lastWinding;
+        uint32_t freeHeap;
+    };
+
+    // Encodes the changes into buf (NUL-terminated); returns the length,
+    // or 0 if nothing changed or buf is too small
+    size_t delta(const Snapshot& snap, char* buf, size_t len);
+
+    // The next delta() sends every field (a client connected). Safe from
+    // the async server's context.
+    void reset() { _full = true; }
+
+private:
+    void put(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+    const char* sep() { return _fields++ ? "," : ""; }
+
+    Snapshot _sent = {};
+    volatile bool _full = true;
+    char* _buf = nullptr;
+    size_t _len = 0;
+    size_t _pos = 0;
+    uint8_t _fields = 0;
+};
+
+extern LiveStatus liveStatus;
+
+#endif // LIVE_STATUS_H
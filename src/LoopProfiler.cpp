@@ -0,0 +1,34 @@
+#include "LoopProfiler.h"
+
+#ifndef WW_DISABLE_PROFILER
+
+LoopProfiler loopProfiler;
+
+void LoopProfiler::reset() {
+    memset(_sections, 0, sizeof(_sections));
+    memset(&_loop, 0, sizeof(_loop));
+}
+
+const char* LoopProfiler::sectionName(ProfSection section) {
+    switch (section) {
+        case ProfSection::HttpServer:   return "http";
+        case ProfSection::Stepper:      return "stepper";
+        case ProfSection::Schedule:     return "schedule";
+        case ProfSection::Notify:       return "notify";
+        case ProfSection::Yield:        return "yield";
+        case ProfSection::Housekeeping: return "housekeeping";
+        default:                        return "?";
+    }
+}
+
+void LoopProfiler::dump() const {
+    Serial.printf("[PROF] loop n=%u avg=%uus max=%uus\n", _loop.count,
+                  _loop.count ? (unsigned)(_loop.totalUs / _loop.count) : 0u, _loop.maxUs);
+    for (uint8_t i = 0; i < (uint8_t)ProfSection::Count; i++) {
+        const Stats& s = _sections[i];
+        Serial.printf("[PROF]   %-12s n=%u avg=%uus max=%uus\n", sectionName((ProfSection)i), s.count,
+                      s.count ? (unsigned)(s.totalUs / s.count) : 0u, s.maxUs);
+    }
+}
+
+#endif // WW_DISABLE_PROFILER
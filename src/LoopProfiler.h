@@ -0,0 +1,91 @@
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <Arduino.h>
+#include "Hal.h"
+
+// Per-section loop() timing with fixed log2 histograms (bucket n holds
+// durations in [2^n, 2^(n+1)) µs, bucket 0 also holds 0-1 µs). No heap use.
+// Build with -DWW_DISABLE_PROFILER to compile all of it out.
+
+enum class ProfSection : uint8_t {
+    HttpServer,
+    Stepper,
+    Schedule,
+    Notify,
+    Yield,
+    Housekeeping,
+    Count
+};
+
+#ifndef WW_DISABLE_PROFILER
+
+class LoopProfiler {
+public:
+    static const uint8_t BUCKETS = 16; // last bucket collects >= 32 ms
+
+    struct Stats {
+        uint32_t count;
+        uint32_t maxUs;
+        uint64_t totalUs;
+        uint32_t hist[BUCKETS];
+    };
+
+    void record(ProfSection section, uint32_t us) { add(_sections[(uint8_t)section], us); }
+    void recordLoop(uint32_t us) { add(_loop, us); }
+    void reset();
+
+    const Stats& section(ProfSection section) const { return _sections[(uint8_t)section]; }
+    const Stats& loop() const { return _loop; }
+    static const char* sectionName(ProfSection section);
+
+    // One compact line per section: name n= avg= max=
+    void dump() const;
+
+private:
+    Stats _sections[(uint8_t)ProfSection::Count] = {};
+    Stats _loop = {};
+
+    static void add(Stats& s, uint32_t us) {
+        s.count++;
+        s.totalUs += us;
+        if (us > s.maxUs) s.maxUs = us;
+        uint8_t bucket = us < 2 ? 0 : 31 - __builtin_clz(us);
+        if (bucket >= BUCKETS) bucket = BUCKETS - 1;
+        s.hist[bucket]++;
+    }
+};
+
+extern LoopProfiler loopProfiler;
+
+// Times the enclosing scope
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfSection section) : _section(section), _start(hal::micros()) {}
+    ~ProfileScope() { loopProfiler.record(_section, hal::micros() - _start); }
+private:
+    ProfSection _section;
+    unsigned long _start;
+};
+
+class LoopProfileScope {
+public:
+    LoopProfileScope() : _start(hal::micros()) {}
+    ~LoopProfileScope() { loopProfiler.recordLoop(hal::micros() - _start); }
+private:
+    unsigned long _start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SECTION(section) ProfileScope PROFILE_CONCAT(_profScope, __LINE__)(section)
+#define PROFILE_LOOP() LoopProfileScope _profLoopScope
+
+#else
+
+#define PROFILE_SECTION(section) do {} while (0)
+#define PROFILE_LOOP() do {} while (0)
+
+#endif // WW_DISABLE_PROFILER
+
+#endif // LOOP_PROFILER_H
@@ -0,0 +1,234 @@
+#include "NtfyClient.h"
+#include "ConfigConstants.h"
+#include "EventLog.h"
+#include "HeapMonitor.h"
+#include <stdarg.h>
+
+NtfyClient ntfy(NTFY_HOST, NTFY_PORT, NTFY_TOPIC);
+
+char* NtfyClient::reserveSlot() {
+    if (_count == SLOTS) {
+        _stats.dropped++;
+        Serial.println("[NtfyClient] Queue full, message dropped");
+        eventLog.add(EventLog::Type::NtfyDropped, EventLog::NO_WINDER, 1);
+        return nullptr;
+    }
+    char* slot = _slots[(_head + _count) % SLOTS];
+    _count++;
+    _lastQueuedMs = hal::millis();
+    return slot;
+}
+
+bool NtfyClient::send(const char* message) {
+    char* slot = reserveSlot();
+    if (!slot) return false;
+    strncpy(slot, message, MSG_LEN - 1);
+    slot[MSG_LEN - 1] = '\0';
+    return true;
+}
+
+bool NtfyClient::sendf(const char* fmt, ...) {
+    char* slot = reserveSlot();
+    if (!slot) return false;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(slot, MSG_LEN, fmt, args);
+    va_end(args);
+    return true;
+}
+
+// Head and body in one buffer; as many queued messages as fit, one per line
+void NtfyClient::buildRequest() {
+    static const uint16_t HEAD_RESERVE = 192;
+    uint16_t bodyLen = 0;
+    _batch = 0;
+    while (_batch < _count) {
+        uint16_t len = strlen(_slots[(_head + _batch) % SLOTS]) + (_batch ? 1 : 0);
+        if (_batch && HEAD_RESERVE + bodyLen + len > TX_LEN) break;
+        bodyLen += len;
+        _batch++;
+    }
+    int head = snprintf(_tx, TX_LEN,
+        "POST /%s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Title: Watch Winder\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: %u\r\n\r\n",
+        _topic, _host, (unsigned)bodyLen);
+    _txLen = head;
+    for (uint8_t i = 0; i < _batch; i++) {
+        if (i) _tx[_txLen++] = '\n';
+        const char* msg = _slots[(_head + i) % SLOTS];
+        size_t len = strlen(msg);
+        memcpy(_tx + _txLen, msg, len);
+        _txLen += len;
+    }
+    _txOff = 0;
+}
+
+void NtfyClient::enter(State state) {
+    _state = state;
+    _stateMs = hal::millis();
+}
+
+void NtfyClient::closeConnection() {
+    if (_conn) hal::tcpClose(_conn);
+    _conn = nullptr;
+}
+
+// Case-insensitive match of a header line's name; returns its value
+static const char* headerValue(const char* line, const char* name) {
+    size_t len = strlen(name);
+    if (strncasecmp(line, name, len) != 0 || line[len] != ':') return nullptr;
+    line += len + 1;
+    while (*line == ' ') line++;
+    return line;
+}
+
+// The status code once the status line is in, else 0 (-1 if it is not
+// HTTP). `complete` when the whole reply has arrived; `reusable` if then
+// the server also keeps the connection open. A reply whose headers do not
+// fit the kept bytes, or without a Content-Length, is never reusable.
+int NtfyClient::readReply(bool& complete, bool& reusable) {
+    char head[hal::TCP_RX_KEEP + 1];
+    size_t n = hal::tcpRead(_conn, head, hal::TCP_RX_KEEP);
+    head[n] = '\0';
+    complete = reusable = false;
+    // Only the status line matters for the result: "HTTP/1.1 200"
+    if (n < 12) return 0;
+    int code = strncmp(head, "HTTP/", 5) == 0 ? atoi(head + 9) : -1;
+    char* end = strstr(head, "\r\n\r\n");
+    if (!end) return code;
+    end[2] = '\0';
+
+    long length = -1;
+    bool closing = false;
+    for (char* line = strstr(head, "\r\n"); line && line[2]; line = strstr(line + 2, "\r\n")) {
+        const char* value;
+        if ((value = headerValue(line + 2, "Content-Length"))) length = atol(value);
+        if ((value = headerValue(line + 2, "Connection"))) closing = strncasecmp(value, "close", 5) == 0;
+    }
+    if (length < 0) return code;
+    size_t total = (end - head) + 4 + length;
+    size_t received = hal::tcpReceived(_conn);
+    complete = received >= total;
+    reusable = received == total && !closing;
+    return code;
+}
+
+// httpCode <= 0 is a transport failure
+void NtfyClient::finish(int httpCode, bool keepConnection) {
+    if (keepConnection) {
+        hal::tcpClear(_conn);
+    } else {
+        closeConnection();
+    }
+    if (httpCode <= 0 && _reusing) {
+        // The server may have closed the idle connection as the request went
+        // out; try again at once on a new one
+        _reusing = false;
+        Serial.println("[NtfyClient] Kept-alive connection lost, reconnecting");
+        enter(State::Idle);
+        return;
+    }
+    if (httpCode >= 200 && httpCode < 300) {
+        Serial.printf("[NtfyClient] Sent %u message(s) to topic '%s' (code: %d%s)\n", _batch, _topic, httpCode,
+                      _reusing ? ", reused connection" : "");
+        _head = (_head + _batch) % SLOTS;
+        _count -= _batch;
+        _stats.posts++;
+        _stats.sent += _batch;
+        if (_reusing) _stats.reused++;
+        _attempts = 0;
+        enter(State::Idle);
+        return;
+    }
+
+    _stats.failures++;
+    _attempts++;
+    eventLog.add(EventLog::Type::NtfyFailed, EventLog::NO_WINDER, httpCode);
+    if (_attempts >= MAX_ATTEMPTS) {
+        Serial.printf("[NtfyClient] Giving up on %u message(s) after %u attempts (code: %d)\n", _batch, _attempts, httpCode);
+        _head = (_head + _batch) % SLOTS;
+        _count -= _batch;
+        _stats.dropped += _batch;
+        eventLog.add(EventLog::Type::NtfyDropped, EventLog::NO_WINDER, _batch);
+        _attempts = 0;
+        enter(State::Idle);
+        return;
+    }
+    _backoffMs = RETRY_BASE_MS << (_attempts - 1);
+    if (_backoffMs > RETRY_MAX_MS) _backoffMs = RETRY_MAX_MS;
+    Serial.printf("[NtfyClient] Failed to send to topic '%s' (code: %d), retry in %lus\n", _topic, httpCode, _backoffMs / 1000);
+    enter(State::Backoff);
+}
+
+void NtfyClient::poll() {
+    HeapScope heapScope(HeapTag::Ntfy);
+    unsigned long now = hal::millis();
+    bool timedOut = now - _stateMs > TIMEOUT_MS;
+
+    switch (_state) {
+    case State::Idle:
+        // A kept-alive connection is dropped when unused or closed by the server
+        if (_conn && (hal::tcpState(_conn) != hal::TcpState::Connected || hal::tcpReceived(_conn) ||
+                      now - _stateMs > KEEPALIVE_MS)) {
+            closeConnection();
+        }
+        if (_count == 0 || !hal::wifiConnected()) return;
+        // Let a burst settle so it goes out as one POST
+        if (_count < SLOTS && now - _lastQueuedMs < COALESCE_MS) return;
+        buildRequest();
+        _reusing = _conn != nullptr;
+        if (_reusing) {
+            enter(State::Sending);
+            return;
+        }
+        _conn = hal::tcpOpen(_host, _port);
+        if (!_conn) {
+            finish(-1);
+            return;
+        }
+        enter(State::Connecting);
+        return;
+
+    case State::Connecting: {
+        hal::TcpState st = hal::tcpState(_conn);
+        if (st == hal::TcpState::Connected) {
+            enter(State::Sending);
+            timedOut = false;  // Sending gets its own TIMEOUT_MS from here
+        } else if (st != hal::TcpState::Connecting || timedOut) {
+            finish(-1);
+            return;
+        } else {
+            return;
+        }
+        [[fallthrough]];  // start writing right away
+    }
+    case State::Sending:
+        if (hal::tcpState(_conn) != hal::TcpState::Connected || timedOut) {
+            finish(-1);
+            return;
+        }
+        _txOff += hal::tcpWrite(_conn, _tx + _txOff, _txLen - _txOff);
+        if (_txOff == _txLen) enter(State::AwaitReply);
+        return;
+
+    case State::AwaitReply: {
+        // Wait for the whole reply so the connection can be reused
+        bool complete, reusable;
+        int code = readReply(complete, reusable);
+        bool ended = hal::tcpState(_conn) != hal::TcpState::Connected;
+        if (complete || ((ended || timedOut) && code != 0)) {
+            finish(code, complete && reusable && !ended);
+        } else if (ended || timedOut) {
+            finish(-1);
+        }
+        return;
+    }
+
+    case State::Backoff:
+        if (now - _stateMs >= _backoffMs) enter(State::Idle);
+        return;
+    }
+}
@@ -1,38 +1,79 @@
 #ifndef NTFY_CLIENT_H
 #define NTFY_CLIENT_H
 
-#include <ESP8266WiFi.h>
-#include <ESP8266HTTPClient.h>
+#include "Hal.h"
 
+// Outbound ntfy notifications. send() only copies the message into a fixed
+// slot; poll() runs from loop() and drains the queue with a non-blocking
+// HTTP POST. Messages queued within COALESCE_MS of each other go out as one
+// POST, one per line. Failed POSTs are retried with exponential backoff.
+// The connection is kept alive for KEEPALIVE_MS after a reply, so messages
+// close together skip the TCP handshake.
 class NtfyClient {
 public:
-    NtfyClient(const String& topic) : _topic(topic) {}
-
-    bool send(const String& message) {
-        if (WiFi.status() != WL_CONNECTED) {
-            Serial.println("[NtfyClient] WiFi not connected");
-            return false;
-        }
-        WiFiClient client;
-        HTTPClient http;
-        String url = "http://ntfy.sh/" + _topic;
-        http.begin(client, url);
-        http.addHeader("Content-Type", "text/plain");
-        http.addHeader("Title", "Watch Winder");
-        int httpCode = http.POST(message);
-        if (httpCode > 0) {
-            Serial.printf("[NtfyClient] Sent to topic '%s': %s (code: %d)\n", _topic.c_str(), message.c_str(), httpCode);
-            http.end();
-            return true;
-        } else {
-            Serial.printf("[NtfyClient] Failed to send to topic '%s': %s (code: %d)\n", _topic.c_str(), message.c_str(), httpCode);
-            http.end();
-            return false;
-        }
-    }
+    static const uint8_t SLOTS = 6;
+    static const uint16_t MSG_LEN = 160;             // incl. terminator, longer messages are cut
+    static const uint16_t TX_LEN = 1280;             // request head + coalesced body
+    static const unsigned long COALESCE_MS = 1500;   // quiet time before a batch is sent
+    static const unsigned long TIMEOUT_MS = 10000;   // per phase: connect, send, reply
+    static const unsigned long RETRY_BASE_MS = 2000; // doubles per failed attempt
+    static const unsigned long RETRY_MAX_MS = 300000UL;
+    static const uint8_t MAX_ATTEMPTS = 6;           // then the batch is dropped
+    static const unsigned long KEEPALIVE_MS = 30000;
+
+    struct Stats {
+        uint32_t posts;     // successful POSTs
+        uint32_t sent;      // messages delivered
+        uint32_t failures;  // failed attempts
+        uint32_t dropped;   // queue full or out of attempts
+        uint32_t reused;    // POSTs on a kept-alive connection
+    };
+
+    NtfyClient(const char* host, uint16_t port, const char* topic)
+        : _host(host), _port(port), _topic(topic) {}
+
+    // Returns false if the queue is full and the message was dropped
+    bool send(const char* message);
+    bool sendf(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    void poll();
+    bool idle() const { return _count == 0 && _state == State::Idle; }
+    uint8_t pending() const { return _count; }
+    const Stats& stats() const { return _stats; }
 
 private:
-    String _topic;
+    enum class State : uint8_t { Idle, Connecting, Sending, AwaitReply, Backoff };
+
+    char* reserveSlot();
+    void buildRequest();
+    int readReply(bool& complete, bool& reusable);
+    void finish(int httpCode, bool keepConnection = false);
+    void closeConnection();
+    void enter(State state);
+
+    const char* _host;
+    uint16_t _port;
+    const char* _topic;
+
+    char _slots[SLOTS][MSG_LEN];
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    unsigned long _lastQueuedMs = 0;
+
+    State _state = State::Idle;
+    unsigned long _stateMs = 0;
+    hal::TcpConn* _conn = nullptr;
+    bool _reusing = false;  // the request in flight went out on a kept-alive connection
+    char _tx[TX_LEN];
+    uint16_t _txLen = 0;
+    uint16_t _txOff = 0;
+    uint8_t _batch = 0;     // slots covered by the request in flight
+    uint8_t _attempts = 0;
+    unsigned long _backoffMs = 0;
+
+    Stats _stats = {};
 };
 
+extern NtfyClient ntfy;
+
 #endif // NTFY_CLIENT_H
@@ -0,0 +1,195 @@
+#include "OtaUpdate.h"
+#include "ConfigStore.h"
+#include "EventLog.h"
+#include "WindingHistory.h"
+#include <memory>
+#include <new>
+
+namespace {
+
+struct Download {
+    hal::FlashTarget target;
+    const char* md5;
+    size_t size;       // of the image, from the first response
+    size_t written;
+    bool started;
+    bool failed;       // flashing failed or the image changed, don't retry
+    uint8_t lastTenth;
+};
+
+bool writeChunk(void* ctx, size_t size, const uint8_t* data, size_t len) {
+    Download& d = *(Download*)ctx;
+    if (!d.started) {
+        if (size == 0 || !hal::flashBegin(d.target, size, d.md5)) {
+            d.failed = true;
+            return false;
+        }
+        d.size = size;
+        d.started = true;
+    } else if (size != d.size) {
+        Serial.println("[OTA] Image changed on the server, giving up");
+        d.failed = true;
+        return false;
+    }
+    if (!hal::flashWrite(data, len)) {
+        d.failed = true;
+        return false;
+    }
+    d.written += len;
+    uint8_t tenth = (uint8_t)((uint64_t)d.written * 10 / d.size);
+    if (tenth != d.lastTenth) {
+        d.lastTenth = tenth;
+        Serial.printf("[OTA] Progress: %u%%\n", tenth * 10);
+    }
+    return true;
+}
+
+struct Text {
+    char buf[80];
+    size_t len;
+};
+
+bool collectText(void* ctx, size_t, const uint8_t* data, size_t len) {
+    Text& t = *(Text*)ctx;
+    if (t.len + len >= sizeof(t.buf)) return false;
+    memcpy(t.buf + t.len, data, len);
+    t.len += len;
+    return true;
+}
+
+// A file held in RAM while the filesystem image is written
+struct KeptFile {
+    const char* path;
+    std::unique_ptr<uint8_t[]> data = nullptr;
+    size_t len = 0;
+
+    uint8_t* alloc(size_t size) {
+        data.reset(new (std::nothrow) uint8_t[size]);
+        return data.get();
+    }
+};
+
+} // namespace
+
+// "<32 hex digits>", optionally followed by a file name as md5sum writes it
+bool OtaUpdate::fetchMd5(const char* url, char (&md5)[33]) {
+    char md5Url[160];
+    snprintf(md5Url, sizeof(md5Url), "%s.md5", url);
+    Text text = {};
+    int code = hal::httpGetRange(md5Url, 0, collectText, &text);
+    text.buf[text.len] = '\0';
+    size_t hex = strspn(text.buf, "0123456789abcdefABCDEF");
+    if ((code != 200 && code != 206) || hex != 32) {
+        Serial.printf("[OTA] No valid MD5 at %s (code %d)\n", md5Url, code);
+        return false;
+    }
+    memcpy(md5, text.buf, 32);
+    md5[32] = '\0';
+    return true;
+}
+
+bool OtaUpdate::download(const char* url, hal::FlashTarget target, bool& started) {
+    started = false;
+    char md5[33];
+    if (!fetchMd5(url, md5)) return false;
+    Serial.printf("[OTA] Downloading %s (MD5 %s)\n", url, md5);
+
+    Download d = {target, md5, 0, 0, false, false, 0};
+    uint8_t stalls = 0;
+    while (!d.failed && !(d.started && d.written == d.size)) {
+        size_t before = d.written;
+        int code = hal::httpGetRange(url, d.written, writeChunk, &d);
+        if (d.failed) break;
+        if (d.started && d.written == d.size) break;
+        // Client errors (404, 416, ...) won't go away by retrying
+        if (code >= 400 && code < 500) break;
+        stalls = d.written > before ? 1 : stalls + 1;
+        if (stalls > MAX_STALLS) break;
+        Serial.printf("[OTA] Interrupted at %u of %u bytes (code %d), resuming in %lu ms\n", (unsigned)d.written,
+                      (unsigned)d.size, code, RETRY_MS * stalls);
+        hal::delayMs(RETRY_MS * stalls);
+    }
+
+    started = d.started;
+    if (!d.started) return false;
+    if (d.failed || d.written != d.size) {
+        hal::flashAbort();
+        Serial.printf("[OTA] Download of %s failed at %u bytes\n", url, (unsigned)d.written);
+        return false;
+    }
+    if (!hal::flashEnd()) {
+        Serial.printf("[OTA] %s failed verification\n", url);
+        return false;
+    }
+    Serial.printf("[OTA] %s: %u bytes flashed and verified\n", url, (unsigned)d.size);
+    return true;
+}
+
+// Firmware first: it is only staged, so a failure there changes nothing
+bool OtaUpdate::updateAll(const char* version, const char* binUrl, const char* lfsUrl) {
+    // The new filesystem image would reset the settings and the logs. The
+    // settings and statistics must fit beside the download, or nothing starts.
+    KeptFile kept[4] = {{ConfigStore::PATH}, {WindingHistory::STATS_PATH}, {WindingHistory::PATH}, {EventLog::PATH}};
+    size_t essential = hal::fsSize(kept[0].path) + hal::fsSize(kept[1].path);
+    Serial.printf("[OTA] Free heap before update: %u bytes, largest block %u\n", hal::heapFree(), hal::heapMaxBlock());
+    if (hal::heapMaxBlock() < essential + MIN_BLOCK_BYTES) {
+        Serial.printf("[OTA] Not enough memory to keep the settings (%u bytes) over the update\n", (unsigned)essential);
+        return false;
+    }
+    if (!download(binUrl, hal::FlashTarget::Firmware)) return false;
+
+    uint8_t lost = 0;
+    for (uint8_t i = 0; i < 2; i++) {
+        size_t len = hal::fsSize(kept[i].path);
+        if (len && kept[i].alloc(len)) kept[i].len = hal::fsReadBytes(kept[i].path, kept[i].data.get(), len);
+        if (kept[i].len != len) lost |= i == 0 ? KEPT_SETTINGS : KEPT_STATS;
+    }
+    if (lost) {
+        Serial.println("[OTA] Could not read the settings to keep; staged firmware discarded");
+        hal::flashDiscardFirmware();
+        return false;
+    }
+    // The logs only while the download keeps its headroom
+    if (hal::heapMaxBlock() >= KEEP_RUNS_BYTES + MIN_BLOCK_BYTES && kept[2].alloc(KEEP_RUNS_BYTES)) {
+        kept[2].len = windingHistory.exportRecent(kept[2].data.get(), KEEP_RUNS_BYTES);
+    } else if (windingHistory.total()) {
+        lost |= KEPT_RUNS;
+    }
+    if (hal::heapMaxBlock() >= KEEP_EVENTS_BYTES + MIN_BLOCK_BYTES && kept[3].alloc(KEEP_EVENTS_BYTES)) {
+        kept[3].len = eventLog.exportRecent(kept[3].data.get(), KEEP_EVENTS_BYTES);
+    } else if (eventLog.lastSeq()) {
+        lost |= KEPT_EVENTS;
+    }
+
+    bool fsStarted;
+    bool ok = download(lfsUrl, hal::FlashTarget::Filesystem, fsStarted);
+    // Also after a failure, which can leave the filesystem reformatted
+    if (fsStarted) {
+        hal::fsMkdir("/Config");
+        hal::fsMkdir(EventLog::DIR);
+        hal::fsRemove(EventLog::OLD_PATH);  // its newest entries are in kept[3]
+        const uint8_t bits[4] = {KEPT_SETTINGS, KEPT_STATS, KEPT_RUNS, KEPT_EVENTS};
+        for (uint8_t i = 0; i < 4; i++) {
+            if (kept[i].len && !hal::fsWriteBytes(kept[i].path, kept[i].data.get(), kept[i].len)) {
+                Serial.printf("[OTA] Failed to restore %s\n", kept[i].path);
+                lost |= bits[i];
+            }
+        }
+        if (lost) {
+            Serial.printf("[OTA] Not carried over the update (bits %u):%s%s%s%s\n", lost,
+                          lost & KEPT_SETTINGS ? " settings" : "", lost & KEPT_STATS ? " statistics" : "",
+                          lost & KEPT_RUNS ? " runs" : "", lost & KEPT_EVENTS ? " events" : "");
+            eventLog.add(EventLog::Type::OtaStateLost, EventLog::NO_WINDER, lost);
+            eventLog.flush();
+        }
+    }
+    if (!ok) {
+        // The new firmware must not start on a half-written filesystem
+        hal::flashDiscardFirmware();
+        if (fsStarted) windingHistory.begin();  // the history file was rewritten
+        Serial.println("[OTA] Filesystem update failed; staged firmware discarded");
+        return false;
+    }
+    setLocalVersion(version);
+    return true;
+}
@@ -0,0 +1,81 @@
+#include "ScheduleConfig.h"
+#include <ArduinoJson.h>
+
+ScheduleConfig scheduleConfigs[WINDER_COUNT];
+
+// Root (duration, speed, times, days), up to MAX_TIMES time objects of four
+// fields and the seven days. Parsing in place stores no strings; parsing a
+// String copies the keys and values (deduplicated, well under 192 bytes).
+static const size_t SCHEDULE_JSON_SIZE = JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(ScheduleConfig::MAX_TIMES) +
+                                         ScheduleConfig::MAX_TIMES * JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(7);
+static const size_t SCHEDULE_JSON_STRINGS = 192;
+
+const char* ScheduleConfig::weekdayName(int wday) {
+    static const char* names[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
+    return names[wday % 7];
+}
+
+static void parseSchedule(JsonDocument& doc, ScheduleConfig& parsed) {
+    parsed.durationMin = doc["winding_duration"] | 30;
+    strlcpy(parsed.speed, doc["winding_speed"] | "Medium", sizeof(parsed.speed));
+    for (JsonVariant t : doc["winding_times"].as<JsonArray>()) {
+        if (parsed.timeCount == ScheduleConfig::MAX_TIMES) break;
+        ScheduleConfig::WindingTime& w = parsed.times[parsed.timeCount++];
+        w.hour = t["hour"] | 0;
+        w.minute = t["minute"] | 0;
+        w.pm = strcmp(t["ampm"] | "AM", "PM") == 0;
+        w.enabled = t["enabled"] | true;
+    }
+    JsonObject days = doc["days"].as<JsonObject>();
+    for (int wday = 0; wday < 7; wday++) {
+        if (days[ScheduleConfig::weekdayName(wday)] | false) parsed.dayMask |= 1 << wday;
+    }
+}
+
+bool ScheduleConfig::fromJson(const String& json) {
+    StaticJsonDocument<SCHEDULE_JSON_SIZE + SCHEDULE_JSON_STRINGS> doc;
+    if (json.length() == 0 || deserializeJson(doc, json)) return false;
+    ScheduleConfig parsed;
+    parseSchedule(doc, parsed);
+    parsed._version = _version;
+    *this = parsed;
+    return true;
+}
+
+// Zero-copy: the document's strings point into json
+bool ScheduleConfig::fromJson(char* json) {
+    StaticJsonDocument<SCHEDULE_JSON_SIZE> doc;
+    if (!json || !*json || deserializeJson(doc, json)) return false;
+    ScheduleConfig parsed;
+    parseSchedule(doc, parsed);
+    parsed._version = _version;
+    *this = parsed;
+    return true;
+}
+
+void ScheduleConfig::writeJson(JsonStreamWriter& json, const char* key) const {
+    json.beginObject(key);
+    json.field("winding_duration", durationMin);
+    json.field("winding_speed", speed);
+    json.beginArray("winding_times");
+    for (uint8_t i = 0; i < timeCount; i++) {
+        json.beginObject()
+            .field("hour", times[i].hour)
+            .field("minute", times[i].minute)
+            .field("ampm", times[i].pm ? "PM" : "AM")
+            .field("enabled", times[i].enabled)
+            .endObject();
+    }
+    json.endArray();
+    json.beginObject("days");
+    // Monday first, as in the UI
+    for (int i = 1; i <= 7; i++) json.field(weekdayName(i % 7), dayEnabled(i % 7));
+    json.endObject();
+    json.endObject();
+}
+
+void ScheduleConfig::replace(const ScheduleConfig& other) {
+    uint32_t version = _version;
+    *this = other;
+    _version = version + 1;
+}
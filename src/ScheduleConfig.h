@@ -0,0 +1,51 @@
+#ifndef SCHEDULE_CONFIG_H
+#define SCHEDULE_CONFIG_H
+
+#include <Arduino.h>
+#include "ConfigConstants.h"
+#include "JsonStreamWriter.h"
+
+// Winding schedule held in RAM, one per winder. Loaded from the ConfigStore
+// once at boot; the schedule API replaces it in place and serializes GET
+// responses from memory, so flash is only touched on writes.
+class ScheduleConfig {
+public:
+    static const uint8_t MAX_TIMES = 4;
+
+    struct WindingTime {
+        uint8_t hour;     // 1-12
+        uint8_t minute;
+        bool pm;
+        bool enabled;
+        int hour24() const { return pm ? (hour % 12) + 12 : hour % 12; }
+    };
+
+    uint16_t durationMin = 30;
+    char speed[12] = "Medium";
+    WindingTime times[MAX_TIMES] = {};
+    uint8_t timeCount = 0;
+    uint8_t dayMask = 0;   // bit n = tm_wday n (Sunday = 0)
+
+    bool dayEnabled(int wday) const { return dayMask & (1 << wday); }
+
+    // Parses the schedule JSON used by the UI; false leaves *this untouched.
+    // The char* overload parses in place (the buffer is modified).
+    bool fromJson(const String& json);
+    bool fromJson(char* json);
+    void writeJson(JsonStreamWriter& json, const char* key = nullptr) const;
+
+    void replace(const ScheduleConfig& other); // copies fields, bumps version
+
+    // Changes whenever the schedule changes; consumers keep the last value
+    // they acted on and recompute when it differs
+    uint32_t version() const { return _version; }
+
+    static const char* weekdayName(int wday);
+
+private:
+    uint32_t _version = 0;
+};
+
+extern ScheduleConfig scheduleConfigs[WINDER_COUNT];
+
+#endif // SCHEDULE_CONFIG_H
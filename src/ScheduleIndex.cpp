@@ -0,0 +1,62 @@
+#include "ScheduleIndex.h"
+#include <algorithm>
+
+void ScheduleIndex::build(const ScheduleConfig& sched) {
+    _count = 0;
+    _dayMask = 0;
+    for (int wday = 0; wday < 7; wday++) {
+        if (!sched.dayEnabled(wday)) continue;
+        for (uint8_t i = 0; i < sched.timeCount; i++) {
+            const ScheduleConfig::WindingTime& t = sched.times[i];
+            if (!t.enabled) continue;
+            _minutes[_count++] = wday * 1440 + t.hour24() * 60 + t.minute;
+            _dayMask |= 1 << wday;
+        }
+    }
+    std::sort(_minutes, _minutes + _count);
+    _count = std::unique(_minutes, _minutes + _count) - _minutes;
+}
+
+time_t ScheduleIndex::next(time_t now) const {
+    if (_count == 0) return 0;
+    struct tm t;
+    localtime_r(&now, &t);
+    uint16_t nowMinute = t.tm_wday * 1440 + t.tm_hour * 60 + t.tm_min;
+
+    // Scan from an hour back: a slot whose local time falls in a DST gap is
+    // moved forward by mktime() and can end up after `now` or after later
+    // slots. So slots up to an hour past the first hit are compared too;
+    // without DST this is one or two mktime() calls.
+    uint16_t from = (nowMinute + MINUTES_PER_WEEK - 60) % MINUTES_PER_WEEK;
+    uint8_t i = std::upper_bound(_minutes, _minutes + _count, from) - _minutes;
+    // Slots within the past hour come round again a week later, hence a
+    // second lap
+    time_t best = 0;
+    int firstAhead = 0;
+    for (uint8_t lap = 0; lap < 2 * _count; lap++, i++) {
+        uint16_t m = _minutes[i % _count];
+        int ahead = (m + MINUTES_PER_WEEK - from - 1) % MINUTES_PER_WEEK + 1;  // 1..week
+        if (lap >= _count) ahead += MINUTES_PER_WEEK;
+        if (best && ahead > firstAhead + 60) break;
+        int fromToday = (int)(nowMinute % 1440) - 60 + ahead;  // minutes from today's midnight
+        int dayOffset = fromToday >= 0 ? fromToday / 1440 : -1;
+        struct tm candidate = t;
+        candidate.tm_mday += dayOffset;
+        candidate.tm_hour = (m % 1440) / 60;
+        candidate.tm_min = m % 60;
+        candidate.tm_sec = 0;
+        candidate.tm_isdst = -1;
+        time_t epoch = mktime(&candidate);
+        // When DST ends an hour repeats; mktime() may pick either occurrence,
+        // so step back to the first. If that has passed, the slot already
+        // ran today and must not run again in the second.
+        time_t hourEarlier = epoch - 3600;
+        struct tm earlier;
+        localtime_r(&hourEarlier, &earlier);
+        if (earlier.tm_hour == candidate.tm_hour && earlier.tm_min == candidate.tm_min) epoch = hourEarlier;
+        if (epoch <= now) continue;
+        if (!best) firstAhead = ahead;
+        if (!best || epoch < best) best = epoch;
+    }
+    return best;
+}
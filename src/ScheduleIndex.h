@@ -0,0 +1,32 @@
+#ifndef SCHEDULE_INDEX_H
+#define SCHEDULE_INDEX_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "ScheduleConfig.h"
+
+// The enabled winding times of a ScheduleConfig compiled into a sorted
+// list of minute-of-week values (0 = Sunday 00:00 local time). Rebuild it
+// whenever the schedule version changes; next() is then a binary search
+// plus usually one mktime() instead of a mktime() per day and slot.
+class ScheduleIndex {
+public:
+    static const uint16_t MINUTES_PER_WEEK = 7 * 24 * 60;
+    static const uint8_t MAX_ENTRIES = 7 * ScheduleConfig::MAX_TIMES;
+
+    void build(const ScheduleConfig& sched);
+
+    // First scheduled time strictly after `now`, or 0 if nothing is enabled.
+    // Wall-clock based: a slot keeps its local time across DST changes.
+    time_t next(time_t now) const;
+
+    uint8_t size() const { return _count; }
+    uint8_t dayMask() const { return _dayMask; }  // days with at least one slot
+
+private:
+    uint16_t _minutes[MAX_ENTRIES];
+    uint8_t _count = 0;
+    uint8_t _dayMask = 0;
+};
+
+#endif // SCHEDULE_INDEX_H
@@ -0,0 +1,52 @@
+#include "StaticAssets.h"
+#include "Hal.h"
+
+StaticAssets staticAssets;
+
+static bool endsWith(const char* s, const char* suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+uint8_t StaticAssets::load() {
+    _count = 0;
+    String manifest = hal::fsRead(MANIFEST_PATH);
+    const char* p = manifest.c_str();
+    while (*p && _count < MAX_ENTRIES) {
+        const char* eol = strchr(p, '\n');
+        if (!eol) eol = p + strlen(p);
+        const char* sep = (const char*)memchr(p, ' ', eol - p);
+        if (sep && (size_t)(sep - p) < PATH_LEN && (size_t)(eol - sep - 1) < ETAG_LEN - 2) {
+            Entry& e = _entries[_count++];
+            memcpy(e.path, p, sep - p);
+            e.path[sep - p] = '\0';
+            snprintf(e.etag, ETAG_LEN, "\"%.*s\"", (int)(eol - sep - 1), sep + 1);
+        }
+        p = *eol ? eol + 1 : eol;
+    }
+    Serial.printf("[StaticAssets] %u ETags loaded\n", _count);
+    return _count;
+}
+
+const char* StaticAssets::etag(const char* path) const {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (strcmp(_entries[i].path, path) == 0) return _entries[i].etag;
+    }
+    return nullptr;
+}
+
+const char* StaticAssets::contentType(const char* path) {
+    if (endsWith(path, ".html")) return "text/html";
+    if (endsWith(path, ".css")) return "text/css";
+    if (endsWith(path, ".js")) return "application/javascript";
+    if (endsWith(path, ".png")) return "image/png";
+    if (endsWith(path, ".jpg") || endsWith(path, ".jpeg")) return "image/jpeg";
+    if (endsWith(path, ".gif")) return "image/gif";
+    if (endsWith(path, ".svg")) return "image/svg+xml";
+    return "text/plain";
+}
+
+const char* StaticAssets::cacheControl(const char* path) {
+    if (endsWith(path, ".html")) return "no-cache";
+    return "public, max-age=31536000, immutable";
+}
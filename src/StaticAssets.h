@@ -0,0 +1,38 @@
+#ifndef STATIC_ASSETS_H
+#define STATIC_ASSETS_H
+
+#include <Arduino.h>
+
+// Caching metadata for the files under /UI. scripts/build_fs.py gzips the
+// text assets into the LittleFS image and writes MANIFEST_PATH with one
+// "<path> <etag>" line per file; load() reads it once at boot.
+class StaticAssets {
+public:
+    static const uint8_t MAX_ENTRIES = 16;
+    static const uint8_t PATH_LEN = 48;
+    static const uint8_t ETAG_LEN = 20;   // quoted, 16 hex digits
+    static constexpr const char* MANIFEST_PATH = "/UI/etags.txt";
+
+    // Returns the number of entries loaded (0 for an image without manifest)
+    uint8_t load();
+
+    // Strong ETag (with quotes) for an uncompressed /UI path, or nullptr
+    const char* etag(const char* path) const;
+
+    static const char* contentType(const char* path);
+    // HTML revalidates on every load; everything else is linked with a
+    // ?v=<etag> suffix by the build step and never changes under its URL
+    static const char* cacheControl(const char* path);
+
+private:
+    struct Entry {
+        char path[PATH_LEN];
+        char etag[ETAG_LEN];
+    };
+    Entry _entries[MAX_ENTRIES];
+    uint8_t _count = 0;
+};
+
+extern StaticAssets staticAssets;
+
+#endif // STATIC_ASSETS_H
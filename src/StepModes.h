@@ -0,0 +1,58 @@
+#ifndef STEP_MODES_H
+#define STEP_MODES_H
+
+#include <Arduino.h>
+
+// 28BYJ-48 step mode policies for StepperMotorDriver.
+// Each sequence entry is a coil pattern, bit n = coil n+1 (IN1..IN4).
+// kPhases is a power of two so phase wraparound is a mask, not a branch.
+
+enum class StepMode : uint8_t { Full, Half, Wave };
+
+// Full-step: two coils on, max torque (2048 steps/rev)
+struct FullStepMode {
+    static constexpr StepMode kMode = StepMode::Full;
+    static constexpr uint8_t kPhases = 4;
+    static constexpr int kStepsPerRev = 2048;
+    static constexpr uint8_t kRampShift = 0;
+    static constexpr uint8_t kSequence[kPhases] = {
+        0b0101,  // Coils 1 & 3
+        0b0110,  // Coils 2 & 3
+        0b1010,  // Coils 2 & 4
+        0b1001   // Coils 1 & 4
+    };
+};
+
+// Half-step: alternates one and two coils, smoother and quieter (4096 steps/rev)
+struct HalfStepMode {
+    static constexpr StepMode kMode = StepMode::Half;
+    static constexpr uint8_t kPhases = 8;
+    static constexpr int kStepsPerRev = 4096;
+    static constexpr uint8_t kRampShift = 1; // two half-steps per full-step ramp entry
+    static constexpr uint8_t kSequence[kPhases] = {
+        0b0001,  // Coil 1
+        0b0101,  // Coils 1 & 3
+        0b0100,  // Coil 3
+        0b0110,  // Coils 3 & 2
+        0b0010,  // Coil 2
+        0b1010,  // Coils 2 & 4
+        0b1000,  // Coil 4
+        0b1001   // Coils 4 & 1
+    };
+};
+
+// Wave drive: one coil on, lowest current draw (2048 steps/rev)
+struct WaveDriveMode {
+    static constexpr StepMode kMode = StepMode::Wave;
+    static constexpr uint8_t kPhases = 4;
+    static constexpr int kStepsPerRev = 2048;
+    static constexpr uint8_t kRampShift = 0;
+    static constexpr uint8_t kSequence[kPhases] = {
+        0b0001,  // Coil 1
+        0b0100,  // Coil 3
+        0b0010,  // Coil 2
+        0b1000   // Coil 4
+    };
+};
+
+#endif // STEP_MODES_H
@@ -0,0 +1,107 @@
+#include "StepScheduler.h"
+#include "Hal.h"
+
+StepScheduler stepScheduler;
+
+bool StepScheduler::add(StepperMotorDriver& motor) {
+    if (_count >= MAX_MOTORS) return false;
+    motor._slot = _count;
+    _motors[_count++] = &motor;
+    return true;
+}
+
+bool StepScheduler::setTimerMode(bool enabled) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_motors[i]->_running) return false;
+    }
+    if (enabled == _timerMode) return true;
+    if (enabled) hal::stepTimerAttach(timerISR);
+    else hal::stepTimerDetach();
+    _timerMode = enabled;
+    Serial.printf("[MOTOR] Timer-interrupt stepping %s\n", enabled ? "enabled" : "disabled");
+    return true;
+}
+
+// The ISR may be re-arming for another motor right now, so compute and
+// arm with interrupts off
+void StepScheduler::wake() {
+    if (!_timerMode) return;
+    uint32_t state = hal::irqDisable();
+    unsigned long deadline;
+    if (earliestDeadline(deadline)) hal::stepTimerArm(timerTicksUntil(deadline, hal::micros()));
+    hal::irqRestore(state);
+}
+
+void IRAM_ATTR StepScheduler::timerISR() {
+    stepScheduler.onTimer();
+}
+
+// One tick: step everything that is due, one coil write, re-arm
+void IRAM_ATTR StepScheduler::onTimer() {
+    unsigned long now = hal::micros();
+    bool stepped = false;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (!due(_motors[i], now)) continue;
+        _motors[i]->advance(now, false);
+        stepped = true;
+    }
+    if (stepped) coilOutput.commit();
+
+    unsigned long deadline;
+    if (!earliestDeadline(deadline)) {
+        hal::stepTimerDisarm();
+        return;
+    }
+    hal::stepTimerReload(timerTicksUntil(deadline, hal::micros()));
+}
+
+void StepScheduler::poll() {
+    if (!_timerMode) {
+        unsigned long start = hal::micros();
+        uint8_t burst[MAX_MOTORS] = {};
+        // Process multiple steps if we've fallen behind
+        for (;;) {
+            unsigned long now = hal::micros();
+            bool stepped = false;
+            for (uint8_t i = 0; i < _count; i++) {
+                if (!due(_motors[i], now)) continue;
+                _motors[i]->advance(now, true);
+                if (++burst[i] == 2) _motors[i]->_stats.recordCatchUpBurst();
+                stepped = true;
+            }
+            if (!stepped) break;
+            coilOutput.commit();
+
+            // Limit catch-up to prevent blocking too long
+            if (hal::micros() - start > MAX_POLL_US) {
+                for (uint8_t i = 0; i < _count; i++) {
+                    if (burst[i] && _motors[i]->_running) _motors[i]->_stats.recordCatchUpCap();
+                }
+                break;
+            }
+        }
+    }
+    for (uint8_t i = 0; i < _count; i++) _motors[i]->update();
+}
+
+bool IRAM_ATTR StepScheduler::due(const StepperMotorDriver* m, unsigned long now) {
+    return m->_running && (long)(m->_deadlineUs - now) <= (long)BATCH_WINDOW_US;
+}
+
+bool IRAM_ATTR StepScheduler::earliestDeadline(unsigned long& deadline) const {
+    bool any = false;
+    for (uint8_t i = 0; i < _count; i++) {
+        const StepperMotorDriver* m = _motors[i];
+        if (!m->_running) continue;
+        if (!any || (long)(m->_deadlineUs - deadline) < 0) deadline = m->_deadlineUs;
+        any = true;
+    }
+    return any;
+}
+
+uint32_t IRAM_ATTR StepScheduler::timerTicksUntil(unsigned long deadline, unsigned long now) {
+    long us = (long)(deadline - now);
+    if (us < (long)MIN_TIMER_US) us = MIN_TIMER_US;
+    if (us > (long)MAX_TIMER_US) us = MAX_TIMER_US;
+    return (uint32_t)us * hal::STEP_TIMER_TICKS_PER_US;
+}
@@ -0,0 +1,52 @@
+#ifndef STEP_SCHEDULER_H
+#define STEP_SCHEDULER_H
+
+#include <Arduino.h>
+#include "CoilOutput.h"
+#include "StepperMotorDriver.h"
+
+// Steps every motor from one timeline. Each running motor has a deadline
+// for its next step (or dwell end); a tick steps all motors due within
+// BATCH_WINDOW_US and writes their coils with a single coilOutput.commit().
+// In timer mode timer1 is re-armed for the earliest remaining deadline,
+// otherwise poll() does the same from loop() with catch-up.
+class StepScheduler {
+public:
+    static const uint8_t MAX_MOTORS = CoilOutput::MAX_MOTORS;
+    static const unsigned long BATCH_WINDOW_US = 20;   // steps this close share one write
+    static const unsigned long MIN_TIMER_US = 10;
+    static const unsigned long MAX_TIMER_US = 1000000; // longer waits (dwells) re-arm
+    static const unsigned long MAX_POLL_US = 5000;     // catch-up budget per poll()
+
+    // Assigns the motor its coil slot (= index). False when full.
+    bool add(StepperMotorDriver& motor);
+    uint8_t size() const { return _count; }
+
+    // Timer-interrupt stepping: loop() stalls no longer show up as jitter.
+    // Returns false while a motor is running.
+    bool setTimerMode(bool enabled);
+    bool timerMode() const { return _timerMode; }
+
+    // A motor (re)started: re-arm the timer for the earliest deadline.
+    // Loop context only.
+    void wake();
+
+    // From loop(): polled stepping when timer mode is off, and finishing
+    // completed moves (release + notification) in either mode
+    void poll();
+
+private:
+    static void timerISR();
+    void onTimer();
+    static bool due(const StepperMotorDriver* m, unsigned long now);
+    bool earliestDeadline(unsigned long& deadline) const;
+    static uint32_t timerTicksUntil(unsigned long deadline, unsigned long now);
+
+    StepperMotorDriver* _motors[MAX_MOTORS] = {};
+    uint8_t _count = 0;
+    bool _timerMode = false;
+};
+
+extern StepScheduler stepScheduler;
+
+#endif // STEP_SCHEDULER_H
@@ -0,0 +1,45 @@
+#include "StepTimingStats.h"
+#include <algorithm>
+
+void StepTimingStats::reset() {
+    _head = 0;
+    _count = 0;
+    _minUs = UINT32_MAX;
+    _maxUs = 0;
+    _sumUs = 0;
+    _sumHighUs = 0;
+    _catchUpBursts = 0;
+    _catchUpCapHits = 0;
+}
+
+void IRAM_ATTR StepTimingStats::record(uint32_t lateUs) {
+    _ring[_head & (RING_SIZE - 1)] = lateUs > 0xFFFF ? 0xFFFF : (uint16_t)lateUs;
+    _head = _head + 1;
+    _count = _count + 1;
+    if (lateUs < _minUs) _minUs = lateUs;
+    if (lateUs > _maxUs) _maxUs = lateUs;
+    uint32_t sum = _sumUs + lateUs;
+    if (sum < _sumUs) _sumHighUs = _sumHighUs + 1;
+    _sumUs = sum;
+}
+
+// p99 over the last RING_SIZE samples, min/max/mean over the whole run
+void StepTimingStats::summarize(Summary& out) const {
+    uint32_t count = _count;
+    out.steps = count;
+    out.window = count < RING_SIZE ? count : RING_SIZE;
+    out.minUs = count ? _minUs : 0;
+    out.maxUs = _maxUs;
+    uint64_t sum = ((uint64_t)_sumHighUs << 32) | _sumUs;
+    out.meanUs = count ? (uint32_t)(sum / count) : 0;
+    out.catchUpBursts = _catchUpBursts;
+    out.catchUpCapHits = _catchUpCapHits;
+    out.p99Us = 0;
+    if (out.window == 0) return;
+
+    uint16_t copy[RING_SIZE];
+    memcpy(copy, _ring, out.window * sizeof(uint16_t));
+    uint16_t rank = (uint16_t)((out.window * 99 + 99) / 100) - 1;
+    std::nth_element(copy, copy + rank, copy + out.window);
+    out.p99Us = copy[rank];
+}
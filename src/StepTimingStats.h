@@ -0,0 +1,44 @@
+#ifndef STEP_TIMING_STATS_H
+#define STEP_TIMING_STATS_H
+
+#include <Arduino.h>
+
+// Per-step lateness against the scheduled step deadline.
+// record() is called from the stepping path (timer ISR or poll()) and
+// only touches a ring slot and a few counters. summarize() runs in loop
+// context; it reads without locking, so a sample written concurrently
+// may or may not be included.
+class StepTimingStats {
+public:
+    static const uint16_t RING_SIZE = 256; // power of two
+
+    struct Summary {
+        uint32_t steps;         // samples recorded since reset
+        uint16_t window;        // samples in the ring used for p99
+        uint32_t minUs;
+        uint32_t maxUs;
+        uint32_t meanUs;
+        uint32_t p99Us;
+        uint32_t catchUpBursts; // poll() calls that had to issue >1 step
+        uint32_t catchUpCapHits; // bursts cut short by the 5 ms cap
+    };
+
+    void reset();
+    void record(uint32_t lateUs);
+    void recordCatchUpBurst() { _catchUpBursts++; }
+    void recordCatchUpCap() { _catchUpCapHits++; }
+    void summarize(Summary& out) const;
+
+private:
+    uint16_t _ring[RING_SIZE];
+    volatile uint16_t _head = 0;  // written by the producer only
+    volatile uint32_t _count = 0;
+    volatile uint32_t _minUs = UINT32_MAX;
+    volatile uint32_t _maxUs = 0;
+    volatile uint32_t _sumUs = 0;     // 64-bit lateness sum, split so the
+    volatile uint32_t _sumHighUs = 0; // ISR never does 64-bit arithmetic
+    volatile uint32_t _catchUpBursts = 0;
+    volatile uint32_t _catchUpCapHits = 0;
+};
+
+#endif // STEP_TIMING_STATS_H
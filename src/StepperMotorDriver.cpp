@@ -1,150 +1,406 @@
 
 #include "StepperMotorDriver.h"
+#include "StepScheduler.h"
+#include "CoilOutput.h"
+#include "Hal.h"
 #include "NtfyClient.h"
+#include "EventLog.h"
 #include "ConfigConstants.h"
 #include <time.h>
 
-// 28BYJ-48 stepper motor sequences
-// Full-step mode for higher speed and torque (4 steps per cycle)
-const int STEPS_PER_REV = 2048; // Half of 4096 because we're using full-step mode
-const uint8_t stepSequence[4][4] = {
-    {1, 0, 1, 0},  // Coils 1 & 3
-    {0, 1, 1, 0},  // Coils 2 & 3
-    {0, 1, 0, 1},  // Coils 2 & 4
-    {1, 0, 0, 1}   // Coils 1 & 4
-};
+// 28BYJ-48 coil sequences live in StepModes.h; full-step is the default
+// for higher speed and torque.
+constexpr uint8_t FullStepMode::kSequence[];
+constexpr uint8_t HalfStepMode::kSequence[];
+constexpr uint8_t WaveDriveMode::kSequence[];
+
+// Default ramp: ~130 steps to reach 15 RPM. Ramp tables stop once the
+// interval drops below the fastest step the 28BYJ-48 can follow.
+const float DEFAULT_ACCELERATION = 1000.0f;   // full steps/s^2
+const float MIN_STEP_INTERVAL_US = 1800.0f;
 
 // Non-blocking state machine: start a move
+// A single move is a one-segment program at the current speed
 void StepperMotorDriver::start(int steps, bool clockwise) {
-    _stepsRemaining = abs(steps);
-    _direction = clockwise ? 1 : -1;
-    _running = (_stepsRemaining > 0);
-    _lastStepTime = micros();
+    _running = false;
+    clearProgram();
+    queueMove(steps, _rpm, clockwise);
+    startProgram(1);
+}
+
+bool StepperMotorDriver::queueMove(long steps, float rpm, bool clockwise) {
+    if (_running || _segmentCount >= MAX_SEGMENTS || steps == 0 || rpm <= 0) return false;
+    MotionSegment& seg = _segments[_segmentCount++];
+    seg.steps = labs(steps);
+    seg.dwellMs = 0;
+    seg.rpm = rpm;
+    seg.direction = clockwise ? 1 : -1;
+    return true;
+}
+
+bool StepperMotorDriver::queueDwell(unsigned long ms) {
+    if (_running || _segmentCount >= MAX_SEGMENTS || ms == 0) return false;
+    MotionSegment& seg = _segments[_segmentCount++];
+    seg.steps = 0;
+    seg.dwellMs = ms;
+    seg.rpm = 0;
+    seg.direction = 1;
+    return true;
+}
+
+void StepperMotorDriver::clearProgram() {
+    if (_running) return;
+    _segmentCount = 0;
+}
+
+bool StepperMotorDriver::startProgram(uint16_t repeats, uint8_t tail) {
+    _running = false; // the step ISR leaves this motor alone from here
+    _completePending = false;
+    if (tail >= _segmentCount) return false;
+    if (_pendingMode != _stepMode) setStepMode(_pendingMode);
+
+    // Precompute per-segment timing so segment switches are O(1)
+    _loopEnd = _segmentCount - tail;
+    uint32_t cycleSteps = 0, tailSteps = 0;
+    float cycleMs = 0, tailMs = 0;
+    for (uint8_t i = 0; i < _segmentCount; i++) {
+        MotionSegment& seg = _segments[i];
+        uint32_t& steps = i < _loopEnd ? cycleSteps : tailSteps;
+        float& ms = i < _loopEnd ? cycleMs : tailMs;
+        if (seg.steps == 0) {
+            ms += seg.dwellMs;
+            continue;
+        }
+        seg.cruiseQ8 = (uint32_t)((60.0f * 1000000.0f * 256.0f) / (_stepsPerRev * seg.rpm));
+        seg.rampSteps = rampStepsFor(seg.steps, seg.cruiseQ8);
+        steps += seg.steps;
+        ms += seg.steps * (seg.cruiseQ8 / 256000.0f);
+    }
+    // An endless program has no total, whatever its tail
+    _programSteps = repeats ? cycleSteps * repeats + tailSteps : 0;
+    _programMs = repeats ? (unsigned long)(cycleMs * repeats + tailMs) : 0;
+    _programStartMs = hal::millis();
+    _stepsDone = 0;
+    _stoppedEarly = false;
+
+    _repeatsLeft = repeats;
+    _segmentIdx = 0;
+    loadSegment(0);
+    coilOutput.commit(); // a leading dwell rests with the coils off
+    _stats.reset();
+    _deadlineUs = hal::micros() + nextEventUs();
+    _running = true;
+    stepScheduler.wake();
+    return true;
 }
 
-// Non-blocking state machine: call frequently from loop()
+// Ramp until the table reaches cruise speed, or half the move for short moves
+int StepperMotorDriver::rampStepsFor(long steps, uint32_t cruiseQ8) const {
+    uint32_t cruiseFullQ8 = cruiseQ8 << _rampShift;
+    int halfMove = (steps >> _rampShift) / 2;
+    int n = 0;
+    while (n < _rampTableLen && _rampTable[n] > cruiseFullQ8) n++;
+    return n > halfMove ? halfMove : n;
+}
+
+void IRAM_ATTR StepperMotorDriver::loadSegment(uint8_t idx) {
+    const MotionSegment& seg = _segments[idx];
+    _stepFracQ8 = 0;
+    if (seg.steps == 0) {
+        coilOutput.set(_slot, 0); // rest with the coils off
+        _stepsRemaining = 0;
+        _dwellRemainingMs = seg.dwellMs;
+        return;
+    }
+    _dwellRemainingMs = 0;
+    _stepsRemaining = seg.steps;
+    _moveSteps = seg.steps;
+    _direction = seg.direction;
+    _cruiseQ8 = seg.cruiseQ8;
+    _rampSteps = seg.rampSteps;
+}
+
+// Advance to the next segment, wrapping for repeats and then going on to
+// the tail. False when the program is done.
+bool IRAM_ATTR StepperMotorDriver::nextSegment() {
+    uint8_t idx = _segmentIdx + 1;
+    if (idx == _loopEnd && (_repeatsLeft == 0 || --_repeatsLeft != 0)) idx = 0;
+    if (idx >= _segmentCount) return false;
+    _segmentIdx = idx;
+    loadSegment(idx);
+    return true;
+}
+
+// Time to the next event: the next dwell chunk, or the next step interval
+// with the sub-microsecond remainder carried between steps
+unsigned long IRAM_ATTR StepperMotorDriver::nextEventUs() {
+    if (_dwellRemainingMs) return (_dwellRemainingMs < DWELL_CHUNK_MS ? _dwellRemainingMs : DWELL_CHUNK_MS) * 1000UL;
+    uint32_t intervalQ8 = nextIntervalQ8() + _stepFracQ8;
+    _stepFracQ8 = intervalQ8 & 0xFF;
+    return intervalQ8 >> 8;
+}
+
+// Interval before the next step: ramp up, cruise, then mirror the ramp down
+uint32_t IRAM_ATTR StepperMotorDriver::nextIntervalQ8() const {
+    int done = (_moveSteps - _stepsRemaining) >> _rampShift;
+    int left = (_stepsRemaining - 1) >> _rampShift;
+    if (done < _rampSteps) return _rampTable[done] >> _rampShift;
+    if (left < _rampSteps) return _rampTable[left] >> _rampShift;
+    return _cruiseQ8;
+}
+
+// Builds the ramp with Austin's recurrence c[n] = c[n-1] - 2*c[n-1]/(4n+1),
+// c[0] = 0.676 * sqrt(2/a). Runs once per acceleration setting, not per step.
+void StepperMotorDriver::setAcceleration(float stepsPerSec2) {
+    _rampTableLen = 0;
+    if (stepsPerSec2 <= 0) return;
+    float c = 0.676f * sqrtf(2.0f / stepsPerSec2) * 1000000.0f;
+    for (int n = 0; n < RAMP_TABLE_SIZE; n++) {
+        if (n > 0) c -= (2.0f * c) / (4.0f * n + 1.0f);
+        _rampTable[n] = (uint32_t)(c * 256.0f);
+        _rampTableLen++;
+        if (c < MIN_STEP_INTERVAL_US) break;
+    }
+    Serial.printf("[MOTOR] Acceleration %.0f steps/s^2, ramp table %d entries\n", stepsPerSec2, _rampTableLen);
+}
+
+// Finishes programs the StepScheduler completed, from loop() context
 void StepperMotorDriver::update() {
-    if (!_running) return;
-    
-    unsigned long now = micros();
-    
-    // Process multiple steps if we've fallen behind
-    while (_running && (now - _lastStepTime >= _stepDelay)) {
-        _currentStep += _direction;
-        if (_currentStep < 0) _currentStep = 3;
-        if (_currentStep > 3) _currentStep = 0;
+    if (!_completePending) return;
+    _completePending = false;
+    finishMove();
+}
+
+// One due event: a step, whose coils the scheduler commits together with
+// the other motors', or the end of a dwell
+bool IRAM_ATTR StepperMotorDriver::advance(unsigned long now, bool catchUp) {
+    bool more = true;
+    if (_dwellRemainingMs) {
+        _dwellRemainingMs -= _dwellRemainingMs < DWELL_CHUNK_MS ? _dwellRemainingMs : DWELL_CHUNK_MS;
+        if (!_dwellRemainingMs) more = nextSegment();
+    } else {
+        _currentStep = (_currentStep + _direction) & _phaseMask;
         stepMotor(_currentStep);
-        _lastStepTime += _stepDelay;
-        _stepsRemaining--;
-        
-        if (_stepsRemaining <= 0) {
-            _running = false;
-            
-            // Fully release motor to remove holding torque
-            release();
-            Serial.println("[Motor] Winding complete - motor released");
-            
-            // Small delay to ensure pins are fully released
-            delay(10);
-            
-            // Send completion notification
-            NtfyClient ntfy(NTFY_TOPIC);
-            char timeStr[32];
-            time_t nowT = time(nullptr);
-            strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&nowT));
-            char msgBuf[128];
-            snprintf(msgBuf, sizeof(msgBuf), "{" NTFY_MSG_WINDING_COMPLETE "}", timeStr);
-            ntfy.send(String(msgBuf));
-            
-            break;
-        }
-        
-        // Limit catch-up to prevent blocking too long
-        if (micros() - now > 5000) break; // Max 5ms per update call
+        _stepsDone++;
+        long late = (long)(now - _deadlineUs);
+        _stats.record(late > 0 ? late : 0);
+        if (--_stepsRemaining <= 0) more = nextSegment();
     }
+    if (!more) {
+        coilOutput.set(_slot, 0);
+        _running = false;
+        _completePending = true;
+        return false;
+    }
+    // Polled stepping catches up on missed steps; the timer path carries on
+    // from now, so a stalled interrupt doesn't become a burst of steps
+    unsigned long base = _deadlineUs;
+    if (!catchUp && (long)(now - base) > 0) base = now;
+    _deadlineUs = base + nextEventUs();
+    return true;
+}
+
+// Runs once per completed move, always from loop() context
+void StepperMotorDriver::finishMove() {
+    // Fully release motor to remove holding torque
+    release();
+    // The release is committed right away; no settle delay, which would
+    // stall the other motors' polled steps
+    Serial.printf("[Motor] Motor %u winding complete - motor released\n", _slot);
+    eventLog.add(EventLog::Type::WindComplete, _slot, _stepsDone);
+    
+    // Queue completion notification (sent from loop() by ntfy.poll())
+    char timeStr[32];
+    time_t nowT = hal::now();
+    strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&nowT));
+#if WINDER_COUNT > 1
+    ntfy.sendf("{Winder %u: " NTFY_MSG_WINDING_COMPLETE "}", _slot, timeStr);
+#else
+    ntfy.sendf("{" NTFY_MSG_WINDING_COMPLETE "}", timeStr);
+#endif
 }
 
 bool StepperMotorDriver::isRunning() const {
     return _running;
 }
 
+uint32_t StepperMotorDriver::stepsLeft() const {
+    uint32_t done = _stepsDone;
+    return _running && _programSteps > done ? _programSteps - done : 0;
+}
+
+uint32_t StepperMotorDriver::secondsLeft() const {
+    if (!_running || _programMs == 0) return 0;
+    unsigned long elapsed = hal::millis() - _programStartMs;
+    return elapsed >= _programMs ? 0 : (_programMs - elapsed + 999) / 1000;
+}
+
 void StepperMotorDriver::stop() {
+    if (_running) {
+        eventLog.add(EventLog::Type::WindStopped, _slot, _stepsDone);
+        _stoppedEarly = true;
+    }
     _running = false;
     _stepsRemaining = 0;
+    _dwellRemainingMs = 0;
+    _completePending = false;
     release();
-    Serial.println("[MOTOR] Stopped by user request");
+    Serial.printf("[MOTOR] Motor %u stopped by user request\n", _slot);
 }
 
 // Adapter: run for duration (minutes) at given speed (non-blocking)
 void StepperMotorDriver::runForDuration(float durationMinutes, float rpm, bool clockwise) {
     setSpeed(rpm);
+    // Apply a pending step mode first so steps/rev matches the move
+    if (_pendingMode != _stepMode) setStepMode(_pendingMode);
     // Total steps = RPM * steps/rev * minutes
-    // Use STEPS_PER_REV constant defined at top of file (2048 for full-step mode)
-    int totalSteps = (int)(rpm * STEPS_PER_REV * durationMinutes);
+    int totalSteps = (int)(rpm * _stepsPerRev * durationMinutes);
+
+    notifyWindingStart(durationMinutes, rpm);
+    start(totalSteps, clockwise);
+}
+
+// Adapter: alternate direction with a rest in between (non-blocking)
+void StepperMotorDriver::runAlternatingForDuration(float durationMinutes, float rpm, unsigned long restMs) {
+    _running = false;
+    setSpeed(rpm);
+    if (_pendingMode != _stepMode) setStepMode(_pendingMode);
+    // One CW + one CCW block per cycle; blocks are a minute, shorter for short
+    // runs. What is left after the whole cycles runs once as shorter blocks,
+    // so the motion adds up to durationMinutes; the rests come on top.
+    float blockMinutes = durationMinutes < 2.0f ? durationMinutes / 2.0f : 1.0f;
+    long totalSteps = (long)(rpm * _stepsPerRev * durationMinutes);
+    long blockSteps = (long)(rpm * _stepsPerRev * blockMinutes);
+    long cycles = blockSteps > 0 ? totalSteps / (2 * blockSteps) : 0;
+    if (cycles > UINT16_MAX) cycles = UINT16_MAX;
+    long restSteps = totalSteps - cycles * 2 * blockSteps;
+    long tailCw = restSteps < blockSteps ? restSteps : blockSteps;
+
+    clearProgram();
+    if (cycles > 0) {
+        queueMove(blockSteps, rpm, true);
+        if (restMs) queueDwell(restMs);
+        queueMove(blockSteps, rpm, false);
+        if (restMs) queueDwell(restMs);
+    }
+    uint8_t loopLen = _segmentCount;
+    if (queueMove(tailCw, rpm, true) && restSteps > tailCw) {
+        if (restMs) queueDwell(restMs);
+        queueMove(restSteps - tailCw, rpm, false);
+    }
+
+    notifyWindingStart(durationMinutes, rpm);
+    if (cycles > 0) {
+        startProgram((uint16_t)cycles, _segmentCount - loopLen);
+    } else {
+        startProgram(1);
+    }
+}
 
-    // Send ntfy notification when winding starts
-    NtfyClient ntfy(NTFY_TOPIC);
+// Queue ntfy notification when winding starts
+void StepperMotorDriver::notifyWindingStart(float durationMinutes, float rpm) {
     char timeStr[32];
-    time_t nowT = time(nullptr);
+    time_t nowT = hal::now();
     strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", localtime(&nowT));
-    char msgBuf[160];
-    snprintf(msgBuf, sizeof(msgBuf), "" NTFY_MSG_WINDING "", timeStr, durationMinutes, rpm);
-    ntfy.send(String(msgBuf));
-
-    start(totalSteps, clockwise);
+#if WINDER_COUNT > 1
+    ntfy.sendf("Winder %u: " NTFY_MSG_WINDING, _slot, timeStr, durationMinutes, rpm);
+#else
+    ntfy.sendf(NTFY_MSG_WINDING, timeStr, durationMinutes, rpm);
+#endif
 }
 
-StepperMotorDriver::StepperMotorDriver(int in1, int in2, int in3, int in4)
-    : _in1(in1), _in2(in2), _in3(in3), _in4(in4), _rpm(15), _currentStep(0) {
-    pinMode(_in1, OUTPUT);
-    pinMode(_in2, OUTPUT);
-    pinMode(_in3, OUTPUT);
-    pinMode(_in4, OUTPUT);
+StepperMotorDriver::StepperMotorDriver() : _rpm(15), _currentStep(0) {
+    applyStepMode<FullStepMode>();
     setSpeed(_rpm);
+    setAcceleration(DEFAULT_ACCELERATION);
+}
+
+// Specialise the driver for one step mode: latch Mode::kSequence, the
+// phase wrap mask and steps/rev, so stepping never branches on the mode.
+// Coil patterns become port writes in CoilOutput.
+template <typename Mode>
+void StepperMotorDriver::applyStepMode() {
+    static_assert((Mode::kPhases & (Mode::kPhases - 1)) == 0, "phase count must be a power of two");
+    static_assert(Mode::kPhases <= MAX_PHASES, "too many phases");
+    _sequence = Mode::kSequence;
+    _phaseMask = Mode::kPhases - 1;
+    _rampShift = Mode::kRampShift;
+    _stepsPerRev = Mode::kStepsPerRev;
+    _stepMode = _pendingMode = Mode::kMode;
+    _currentStep &= _phaseMask;
+}
+
+void StepperMotorDriver::setStepMode(StepMode mode) {
+    _pendingMode = mode;
+    if (_running || mode == _stepMode) return;
+    switch (mode) {
+        case StepMode::Half: applyStepMode<HalfStepMode>(); break;
+        case StepMode::Wave: applyStepMode<WaveDriveMode>(); break;
+        default:             applyStepMode<FullStepMode>(); break;
+    }
+    setSpeed(_rpm); // step delay depends on steps/rev
+    Serial.printf("[MOTOR] Step mode: %s (%d steps/rev)\n", stepModeToString(_stepMode), _stepsPerRev);
 }
 
 void StepperMotorDriver::setSpeed(float rpm) {
     _rpm = rpm;
-    _stepDelay = (60L * 1000000L) / (STEPS_PER_REV * _rpm); // microseconds per step
+    _stepDelay = (60L * 1000000L) / (_stepsPerRev * _rpm); // microseconds per step
+    _cruiseQ8 = (uint32_t)((60.0f * 1000000.0f * 256.0f) / (_stepsPerRev * _rpm));
 }
 
 void StepperMotorDriver::step(int steps, bool clockwise) {
     int direction = clockwise ? 1 : -1;
     for (int i = 0; i < abs(steps); i++) {
-        _currentStep += direction;
-        if (_currentStep < 0) _currentStep = 3;
-        if (_currentStep > 3) _currentStep = 0;
+        _currentStep = (_currentStep + direction) & _phaseMask;
         stepMotor(_currentStep);
-        delayMicroseconds(_stepDelay);
+        coilOutput.commit();
+        hal::delayUs(_stepDelay);
     }
     release();
 }
 
-void StepperMotorDriver::stepMotor(int stepIdx) {
-    digitalWrite(_in1, stepSequence[stepIdx][0]);
-    digitalWrite(_in2, stepSequence[stepIdx][1]);
-    digitalWrite(_in3, stepSequence[stepIdx][2]);
-    digitalWrite(_in4, stepSequence[stepIdx][3]);
+// Called from the timer ISR as well, so it must live in IRAM. Only
+// stages the pattern: the coils change on the next commit(), together
+// with every other motor stepping in the same tick.
+void IRAM_ATTR StepperMotorDriver::stepMotor(int stepIdx) {
+    coilOutput.set(_slot, _sequence[stepIdx]);
+}
+
+void IRAM_ATTR StepperMotorDriver::release() {
+    coilOutput.set(_slot, 0);
+    coilOutput.commit();
 }
 
+// Map step mode names from /Config/motor.txt ("full", "half", "wave")
+StepMode StepperMotorDriver::stepModeFromString(const char* modeStr) {
+    if (!modeStr) return StepMode::Full;
+    if (!strcmp(modeStr, "half") || !strcmp(modeStr, "Half")) return StepMode::Half;
+    if (!strcmp(modeStr, "wave") || !strcmp(modeStr, "Wave")) return StepMode::Wave;
+    // Default fallback
+    return StepMode::Full;
+}
 
-void StepperMotorDriver::release() {
-    digitalWrite(_in1, LOW);
-    digitalWrite(_in2, LOW);
-    digitalWrite(_in3, LOW);
-    digitalWrite(_in4, LOW);
+const char* StepperMotorDriver::stepModeToString(StepMode mode) {
+    switch (mode) {
+        case StepMode::Half: return "half";
+        case StepMode::Wave: return "wave";
+        default:             return "full";
+    }
 }
 
 // Map 5 speed levels to RPM for 28BYJ-48
+// RPM is mode-independent; half-step just takes twice as many steps
 // Full-step mode - conservative speeds for reliability
 // Lower RPM = slower winding speed
-// Max ~12 RPM to keep step delay above 2400μs (motor's physical limit)
-float StepperMotorDriver::speedStringToRPM(const String& speedStr) {
-    if (speedStr == "Very Slow") return 4.0;   // ~7,324 μs delay
-    if (speedStr == "Slow") return 6.0;        // ~4,882 μs delay
-    if (speedStr == "Medium") return 8.0;      // ~3,662 μs delay
-    if (speedStr == "Fast") return 10.0;       // ~2,930 μs delay
-    if (speedStr == "Very Fast") return 12.0;  // ~2,441 μs delay
+// Starting at full speed loses steps below ~2400μs, but with the
+// acceleration ramp the motor reaches ~15 RPM (~1950μs) reliably
+float StepperMotorDriver::speedStringToRPM(const char* speedStr) {
+    if (!speedStr) return 8.0;
+    if (!strcmp(speedStr, "Very Slow")) return 4.0;   // ~7,324 μs delay
+    if (!strcmp(speedStr, "Slow")) return 6.0;        // ~4,882 μs delay
+    if (!strcmp(speedStr, "Medium")) return 8.0;      // ~3,662 μs delay
+    if (!strcmp(speedStr, "Fast")) return 10.0;       // ~2,930 μs delay
+    if (!strcmp(speedStr, "Very Fast")) return 15.0;  // ~1,953 μs delay, needs ramp
     // Default fallback
     return 8.0;
 }
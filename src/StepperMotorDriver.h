@@ -2,35 +2,143 @@
 #define STEPPER_MOTOR_DRIVER_H
 
 #include <Arduino.h>
+#include "StepModes.h"
+#include "StepTimingStats.h"
 
 
+// Motion state of one stepper. Coils are driven through coilOutput in the
+// slot assigned by StepScheduler::add(); the scheduler decides when each
+// step happens, for all motors together.
 class StepperMotorDriver {
 public:
-    StepperMotorDriver(int in1, int in2, int in3, int in4);
+    StepperMotorDriver();
     void setSpeed(float rpm);
     void step(int steps, bool clockwise = true); // blocking
     void release();
     void runForDuration(float durationMinutes, float rpm, bool clockwise = true); // non-blocking, speed as parameter
-    static float speedStringToRPM(const String& speedStr);
+    static float speedStringToRPM(const char* speedStr);
 
-    // Non-blocking state machine interface
+    // Non-blocking state machine interface. Steps are emitted by the
+    // StepScheduler (timer1 ISR or polled); update() finishes moves
+    // (release + notify) and is called by StepScheduler::poll().
     void start(int steps, bool clockwise = true);
-    void update(); // call frequently from loop()
+    void update();
     bool isRunning() const;
     void stop(); // stop running motor
+    uint8_t index() const { return _slot; } // coil slot, also the winder index
+
+    // Progress of the current program. Totals are 0 for programs that
+    // repeat until stop(); the ETA is estimated from cruise speed and dwells.
+    uint32_t totalSteps() const { return _programSteps; }
+    uint32_t stepsLeft() const;
+    uint32_t secondsLeft() const;
+    uint32_t stepsDone() const { return _stepsDone; }
+    bool stoppedEarly() const { return _stoppedEarly; } // last run ended by stop()
+
+    // Trapezoidal acceleration in steps/s^2 (0 = start at full speed).
+    // The ramp table is rebuilt here; each move only picks its ramp length.
+    // Acceleration is given in full steps/s^2 regardless of step mode.
+    void setAcceleration(float stepsPerSec2);
+
+    // Coil sequence policy (see StepModes.h). Takes effect immediately when
+    // idle, otherwise at the start of the next move.
+    void setStepMode(StepMode mode);
+    StepMode stepMode() const { return _stepMode; }
+    int stepsPerRev() const { return _stepsPerRev; }
+    static StepMode stepModeFromString(const char* modeStr);
+    static const char* stepModeToString(StepMode mode);
+
+    // Step lateness vs. deadline, reset at the start of every run
+    const StepTimingStats& timingStats() const { return _stats; }
+    void resetTimingStats() { _stats.reset(); }
+
+    // Multi-phase winding programs: a fixed-capacity queue of moves and
+    // dwells, run back to back from the stepping path (ISR or update())
+    // without loop() involvement. isRunning() and stop() cover the program.
+    static const int MAX_SEGMENTS = 8;
+    bool queueMove(long steps, float rpm, bool clockwise = true);
+    bool queueDwell(unsigned long ms);
+    void clearProgram();
+    // 0 = repeat until stop(); the last `tail` queued segments run once after the repeats
+    bool startProgram(uint16_t repeats = 1, uint8_t tail = 0);
+    // CW minute, rest, CCW minute, rest... for durationMinutes of winding
+    void runAlternatingForDuration(float durationMinutes, float rpm, unsigned long restMs);
 
 private:
-    int _in1, _in2, _in3, _in4;
+    friend class StepScheduler;
+
+    uint8_t _slot = 0;
     float _rpm;
     unsigned long _stepDelay; // microseconds
     void stepMotor(int stepIdx);
-    int _currentStep;
+    volatile int _currentStep;
+
+    // Step mode, specialised per policy in applyStepMode<Mode>()
+    StepMode _stepMode = StepMode::Full;
+    StepMode _pendingMode = StepMode::Full;
+    const uint8_t* _sequence = nullptr; // Mode::kSequence
+    uint8_t _phaseMask = 3;             // Mode::kPhases - 1
+    uint8_t _rampShift = 0;             // mode steps per full step, as a shift
+    int _stepsPerRev = 2048;
+    template <typename Mode> void applyStepMode();
+
+    static const int MAX_PHASES = 8;
 
     // State machine variables
     volatile bool _running = false;
-    int _stepsRemaining = 0;
+    volatile int _stepsRemaining = 0;
     int _direction = 1;
-    unsigned long _lastStepTime = 0;
+    volatile unsigned long _deadlineUs = 0; // when the next step or dwell end is due
+
+    // Acceleration ramp. _rampTable[i] is the interval before full step i of
+    // the ramp, in 1/256 µs fixed point; decel mirrors it at the end of the
+    // move. Half-step mode reuses it at half the interval per table entry.
+    static const int RAMP_TABLE_SIZE = 160;
+    uint32_t _rampTable[RAMP_TABLE_SIZE];
+    int _rampTableLen = 0;
+    int _rampSteps = 0;        // ramp length for the current move, in full steps
+    int _moveSteps = 0;        // total steps of the current move segment
+    uint32_t _cruiseQ8 = 0;    // _stepDelay in 1/256 µs
+    uint32_t _stepFracQ8 = 0;  // sub-microsecond remainder carried between steps
+    uint32_t nextIntervalQ8() const;
+    int rampStepsFor(long steps, uint32_t cruiseQ8) const;
+
+    // Segment queue. cruiseQ8/rampSteps are precomputed by startProgram()
+    // so switching segments from the ISR is O(1).
+    struct MotionSegment {
+        long steps;              // 0 for a dwell
+        unsigned long dwellMs;
+        float rpm;
+        int direction;
+        uint32_t cruiseQ8;
+        int rampSteps;
+    };
+    MotionSegment _segments[MAX_SEGMENTS];
+    uint8_t _segmentCount = 0;
+    uint8_t _loopEnd = 0;                         // segments before this one repeat
+    volatile uint8_t _segmentIdx = 0;
+    volatile uint16_t _repeatsLeft = 0;
+    // Dwells are timed in chunks of at most DWELL_CHUNK_MS so one event stays
+    // well inside the signed 32-bit µs deadline arithmetic
+    static const unsigned long DWELL_CHUNK_MS = 60000;
+    volatile unsigned long _dwellRemainingMs = 0; // rest of the current dwell, 0 while moving
+    uint32_t _programSteps = 0;
+    unsigned long _programMs = 0;
+    unsigned long _programStartMs = 0;
+    volatile uint32_t _stepsDone = 0;
+    bool _stoppedEarly = false;
+    void loadSegment(uint8_t idx);
+    bool nextSegment();
+    unsigned long nextEventUs();
+    void notifyWindingStart(float durationMinutes, float rpm);
+
+    StepTimingStats _stats;
+
+    // Called by the StepScheduler when _deadlineUs is due; stages the coils
+    // and schedules the next event. False once the program has finished.
+    bool advance(unsigned long now, bool catchUp);
+    volatile bool _completePending = false; // set by advance(), consumed by update()
+    void finishMove(); // release + completion notification, loop context only
 };
 
 #endif // STEPPER_MOTOR_DRIVER_H
@@ -0,0 +1,126 @@
+#include "TaskScheduler.h"
+#include "Hal.h"
+#include <limits.h>
+
+TaskScheduler taskScheduler;
+
+TaskScheduler::TaskId TaskScheduler::after(unsigned long delayMs, TaskFn fn) {
+    return add(hal::millis() + delayMs, 0, 0, fn);
+}
+
+TaskScheduler::TaskId TaskScheduler::every(unsigned long periodMs, TaskFn fn) {
+    return add(hal::millis() + periodMs, periodMs, 0, fn);
+}
+
+TaskScheduler::TaskId TaskScheduler::at(time_t epoch, TaskFn fn) {
+    return add(deadlineFor(epoch), 0, epoch, fn);
+}
+
+// Past times give a deadline of now, far ones are capped so the millis()
+// comparison stays valid; the task re-checks the wall clock when it fires
+unsigned long TaskScheduler::deadlineFor(time_t epoch) {
+    const time_t maxAheadSec = 7 * 24 * 3600UL;
+    time_t now = hal::now();
+    time_t ahead = epoch > now ? epoch - now : 0;
+    if (ahead > maxAheadSec) ahead = maxAheadSec;
+    return hal::millis() + (unsigned long)ahead * 1000UL;
+}
+
+TaskScheduler::TaskId TaskScheduler::add(unsigned long deadline, unsigned long period, time_t epoch, TaskFn fn) {
+    for (TaskId id = 0; id < MAX_TASKS; id++) {
+        if (_tasks[id].fn) continue;
+        _tasks[id] = {fn, deadline, period, epoch, _heapSize};
+        _heap[_heapSize++] = id;
+        siftUp(_heapSize - 1);
+        return id;
+    }
+    Serial.println("[TaskScheduler] No free task slot");
+    return NONE;
+}
+
+void TaskScheduler::cancel(TaskId& id) {
+    if (id != NONE && id < MAX_TASKS && _tasks[id].fn) remove(id);
+    id = NONE;
+}
+
+void TaskScheduler::remove(TaskId id) {
+    uint8_t pos = _tasks[id].heapPos;
+    _tasks[id].fn = nullptr;
+    _heapSize--;
+    if (pos == _heapSize) return;
+    _heap[pos] = _heap[_heapSize];
+    _tasks[_heap[pos]].heapPos = pos;
+    siftUp(pos);
+    siftDown(_tasks[_heap[pos]].heapPos);
+}
+
+void TaskScheduler::run() {
+    if (_clockChanged) {
+        _clockChanged = false;
+        rearmWallClockTasks();
+    }
+    // Run everything that is due; a callback may add or cancel tasks
+    while (_heapSize && (long)(hal::millis() - _tasks[_heap[0]].deadline) >= 0) {
+        TaskId id = _heap[0];
+        Task& task = _tasks[id];
+        TaskFn fn = task.fn;
+        if (task.epoch && hal::now() < task.epoch) {
+            // Fired early (capped deadline or clock drift), wait for the rest
+            task.deadline = deadlineFor(task.epoch);
+            siftDown(0);
+            continue;
+        }
+        if (task.period) {
+            // Fixed rate, but never a burst of catch-up runs
+            task.deadline += task.period;
+            if ((long)(hal::millis() - task.deadline) >= 0) task.deadline = hal::millis() + task.period;
+            siftDown(0);
+        } else {
+            remove(id);
+        }
+        fn();
+    }
+}
+
+void TaskScheduler::rearmWallClockTasks() {
+    for (uint8_t pos = 0; pos < _heapSize; pos++) {
+        Task& task = _tasks[_heap[pos]];
+        if (task.epoch) task.deadline = deadlineFor(task.epoch);
+    }
+    // Rebuild the heap bottom-up
+    for (int pos = _heapSize / 2 - 1; pos >= 0; pos--) siftDown(pos);
+}
+
+unsigned long TaskScheduler::msUntilNext() const {
+    if (!_heapSize) return ULONG_MAX;
+    long left = (long)(_tasks[_heap[0]].deadline - hal::millis());
+    return left > 0 ? (unsigned long)left : 0;
+}
+
+void TaskScheduler::swap(uint8_t a, uint8_t b) {
+    uint8_t t = _heap[a];
+    _heap[a] = _heap[b];
+    _heap[b] = t;
+    _tasks[_heap[a]].heapPos = a;
+    _tasks[_heap[b]].heapPos = b;
+}
+
+void TaskScheduler::siftUp(uint8_t pos) {
+    while (pos > 0) {
+        uint8_t parent = (pos - 1) / 2;
+        if (!earlier(pos, parent)) break;
+        swap(pos, parent);
+        pos = parent;
+    }
+}
+
+void TaskScheduler::siftDown(uint8_t pos) {
+    for (;;) {
+        uint8_t child = 2 * pos + 1;
+        if (child >= _heapSize) break;
+        if (child + 1 < _heapSize && earlier(child + 1, child)) child++;
+        if (!earlier(child, pos)) break;
+        swap(pos, child);
+        pos = child;
+    }
+}
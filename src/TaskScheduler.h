@@ -0,0 +1,59 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// Timed callbacks for loop() work, kept in a binary min-heap on their
+// millis() deadline. run() only compares the earliest deadline with the
+// clock when nothing is due. Wall-clock tasks (at()) are converted to a
+// millis() deadline and recomputed when the system time is set, so an
+// NTP step never delays them by more than one loop() pass.
+class TaskScheduler {
+public:
+    typedef void (*TaskFn)();
+    typedef uint8_t TaskId;
+    static const TaskId NONE = 0xFF;
+    static const uint8_t MAX_TASKS = 8;
+
+    TaskId after(unsigned long delayMs, TaskFn fn);    // once
+    TaskId every(unsigned long periodMs, TaskFn fn);   // first run after one period
+    TaskId at(time_t epoch, TaskFn fn);                // once, local wall clock
+    void cancel(TaskId& id);                           // sets id to NONE
+
+    // Safe from any context (e.g. the SNTP callback); applied in run()
+    void clockChanged() { _clockChanged = true; }
+
+    void run();
+    unsigned long msUntilNext() const;  // ULONG_MAX when idle
+    uint8_t size() const { return _heapSize; }
+
+private:
+    struct Task {
+        TaskFn fn;
+        unsigned long deadline;  // millis()
+        unsigned long period;    // 0 = one-shot
+        time_t epoch;            // wall-clock target, 0 for millis() tasks
+        uint8_t heapPos;
+    };
+
+    TaskId add(unsigned long deadline, unsigned long period, time_t epoch, TaskFn fn);
+    void remove(TaskId id);
+    void siftUp(uint8_t pos);
+    void siftDown(uint8_t pos);
+    void swap(uint8_t a, uint8_t b);
+    bool earlier(uint8_t a, uint8_t b) const {
+        return (long)(_tasks[_heap[a]].deadline - _tasks[_heap[b]].deadline) < 0;
+    }
+    static unsigned long deadlineFor(time_t epoch);
+    void rearmWallClockTasks();
+
+    Task _tasks[MAX_TASKS] = {};
+    uint8_t _heap[MAX_TASKS];  // task ids, earliest deadline first
+    uint8_t _heapSize = 0;
+    volatile bool _clockChanged = false;
+};
+
+extern TaskScheduler taskScheduler;
+
+#endif // TASK_SCHEDULER_H
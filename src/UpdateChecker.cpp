@@ -0,0 +1,61 @@
+#include "UpdateChecker.h"
+#include "HeapMonitor.h"
+#include <ctype.h>
+
+UpdateChecker updateChecker;
+
+void UpdateChecker::begin(const char* localVersion) {
+    strlcpy(_result.local, localVersion, sizeof(_result.local));
+    _waitStartMs = hal::millis();
+    _waitMs = FIRST_CHECK_MS;
+    _started = true;
+}
+
+void UpdateChecker::requestRefresh() {
+    _waitMs = 0;
+    _result.refreshing = true;
+}
+
+void UpdateChecker::poll(bool canBlock) {
+    if (!_started || hal::millis() - _waitStartMs < _waitMs) return;
+    if (!canBlock || !hal::wifiConnected()) {
+        _result.deferred = true;
+        return;
+    }
+    checkNow();
+}
+
+bool UpdateChecker::checkNow() {
+    HeapScope heapScope(HeapTag::Ota);
+    char body[sizeof(_result.remote)];
+    int code = hal::httpGetIfChanged(OTA_VERSION_URL, _validators, body, sizeof(body));
+    _result.lastCode = code;
+    _result.refreshing = false;
+    _result.deferred = false;
+    _waitStartMs = hal::millis();
+
+    bool ok = code == 304 || code == 200;
+    if (code == 200) {
+        // Trim whitespace around the version
+        char* start = body;
+        while (isspace((unsigned char)*start)) start++;
+        size_t len = strlen(start);
+        while (len > 0 && isspace((unsigned char)start[len - 1])) start[--len] = '\0';
+        ok = len > 0;
+        if (ok) strlcpy(_result.remote, start, sizeof(_result.remote));
+    }
+    if (code == 304 && !_result.remote[0]) ok = false;  // validators without a version
+
+    if (!ok) {
+        // Forget the validators so the next attempt fetches the body
+        _validators = {};
+        _waitMs = RETRY_MS;
+        Serial.printf("[OTA] Version check failed with code: %d\n", code);
+        return false;
+    }
+    _result.checked = true;
+    _result.checkedMs = _waitStartMs;
+    _waitMs = INTERVAL_MS;
+    Serial.printf("[OTA] Remote version: %s%s\n", _result.remote, code == 304 ? " (unchanged)" : "");
+    return true;
+}
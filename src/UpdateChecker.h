@@ -0,0 +1,50 @@
+#ifndef UPDATE_CHECKER_H
+#define UPDATE_CHECKER_H
+
+#include "Hal.h"
+#include "ConfigConstants.h"
+
+// Background firmware version check. poll() fetches OTA_VERSION_URL every
+// INTERVAL_MS (RETRY_MS after a failure) with a conditional GET, so an
+// unchanged version costs a 304 and no body, and keeps the latest result
+// in RAM for /api/check_update to answer from. The fetch is a blocking TLS
+// request, so it only runs from loop() and can be held off while motors run.
+class UpdateChecker {
+public:
+    static const unsigned long FIRST_CHECK_MS = 60000;       // after begin()
+    static const unsigned long INTERVAL_MS = 6 * 3600000UL;
+    static const unsigned long RETRY_MS = 15 * 60000UL;
+
+    struct Result {
+        char local[32];
+        char remote[32];         // "" until a check succeeded
+        unsigned long checkedMs; // millis() of the last successful check
+        bool checked;
+        int lastCode;            // status of the last attempt, 0 before the first
+        bool refreshing;         // requestRefresh() called, check not run yet
+        bool deferred;           // a due check is held off by poll(false) or WiFi down
+    };
+
+    void begin(const char* localVersion);
+
+    // Asks for a check on the next poll(), which runs it even between intervals
+    void requestRefresh();
+    // From loop(); canBlock = false defers a due check (reported as deferred)
+    void poll(bool canBlock);
+    // Checks now; false if the version could not be fetched
+    bool checkNow();
+
+    const Result& result() const { return _result; }
+    bool updateAvailable() const { return _result.remote[0] && strcmp(_result.remote, _result.local) != 0; }
+
+private:
+    Result _result = {};
+    hal::HttpValidators _validators = {};
+    unsigned long _waitStartMs = 0;
+    unsigned long _waitMs = 0;  // until the next check
+    bool _started = false;
+};
+
+extern UpdateChecker updateChecker;
+
+#endif // UPDATE_CHECKER_H
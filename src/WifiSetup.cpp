@@ -0,0 +1,36 @@
+#include "WifiSetup.h"
+#include <WiFiManager.h>
+
+static WiFiManager* s_portal = nullptr;
+
+bool wifiHasCredentials() {
+    return WiFi.SSID().length() > 0;
+}
+
+void wifiBegin() {
+    WiFi.mode(WIFI_STA);
+    WiFi.begin();
+}
+
+void wifiPortalStart(const char* apName, unsigned long timeoutSec) {
+    if (s_portal) return;
+    s_portal = new WiFiManager();
+    s_portal->setConfigPortalBlocking(false);
+    s_portal->setConfigPortalTimeout(timeoutSec);
+    s_portal->startConfigPortal(apName);
+}
+
+bool wifiPortalProcess() {
+    if (!s_portal) return false;
+    s_portal->process();
+    if (s_portal->getConfigPortalActive()) return true;
+    wifiPortalStop();
+    return false;
+}
+
+void wifiPortalStop() {
+    if (!s_portal) return;
+    if (s_portal->getConfigPortalActive()) s_portal->stopConfigPortal();
+    delete s_portal;
+    s_portal = nullptr;
+}
@@ -0,0 +1,17 @@
+#ifndef WIFI_SETUP_H
+#define WIFI_SETUP_H
+
+#include <Arduino.h>
+
+// WiFiManager pulls in ESP8266WebServer, whose HTTP method enum clashes
+// with ESPAsyncWebServer's, so the captive portal lives in its own
+// translation unit. Nothing here blocks: the portal runs from
+// wifiPortalProcess() in loop(). It serves on port 80, so the async web
+// server has to be stopped while it is open.
+bool wifiHasCredentials();
+void wifiBegin();  // connect with the saved credentials
+void wifiPortalStart(const char* apName, unsigned long timeoutSec);
+bool wifiPortalProcess();  // false once the portal has closed (saved, timed out or stopped)
+void wifiPortalStop();
+
+#endif
@@ -0,0 +1,273 @@
+#include "WindingHistory.h"
+#include "ConfigStore.h"
+#include "EventLog.h"
+#include "HeapMonitor.h"
+#include <time.h>
+
+WindingHistory windingHistory;
+
+static const time_t CLOCK_VALID_AFTER = 1640995200;  // 2022-01-01, before that SNTP has not run
+
+static_assert(sizeof(WindingHistory::Run) == 20, "WindingHistory::Run is a file format");
+
+static size_t slotOffset(uint32_t index) {
+    return 16 + (index % WindingHistory::CAPACITY) * sizeof(WindingHistory::Run);
+}
+
+// Local midnight of the day containing t
+static uint32_t dayStart(uint32_t t) {
+    time_t tt = t;
+    struct tm tm;
+    localtime_r(&tt, &tm);
+    return t - (tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec);
+}
+
+void WindingHistory::begin() {
+    static_assert(sizeof(Header) == 16, "slotOffset() assumes a 16-byte header");
+    hal::fsMkdir(EventLog::DIR);
+    Header hdr;
+    bool valid = hal::fsReadAt(PATH, 0, &hdr, sizeof(hdr)) == sizeof(hdr) && hdr.magic == MAGIC &&
+                 hdr.format == FORMAT_VERSION && hdr.recordSize == sizeof(Run) && hdr.capacity == CAPACITY;
+    _ready = true;
+    if (!valid) {
+        Serial.println("[History] No valid history, starting a new one");
+        hal::fsRemove(PATH);
+        _total = 0;
+        writeHeader();
+    } else {
+        // The header only counts written records, but don't trust a truncated file
+        size_t kept = (hal::fsSize(PATH) - sizeof(Header)) / sizeof(Run);
+        _total = hdr.total;
+        if (_total < CAPACITY && kept < _total) _total = kept;
+    }
+
+    StatsHeader sh;
+    uint8_t buf[sizeof(StatsHeader) + sizeof(_stats)];
+    size_t n = hal::fsReadBytes(STATS_PATH, buf, sizeof(buf));
+    memcpy(&sh, buf, sizeof(sh));
+    if (n == sizeof(buf) && sh.magic == STATS_MAGIC && sh.format == FORMAT_VERSION && sh.length == sizeof(_stats) &&
+        sh.crc == ConfigStore::crc32(buf + sizeof(sh), sizeof(_stats))) {
+        memcpy(_stats, buf + sizeof(sh), sizeof(_stats));
+    } else {
+        rebuildStats();
+    }
+    Serial.printf("[History] %u run(s) recorded, %u kept\n", (unsigned)_total, (unsigned)(_total - first()));
+}
+
+void WindingHistory::start(uint8_t w, Trigger trigger, float rpm, bool clockwise, bool alternate, uint16_t stepsPerRev) {
+    Run& run = _runs[w];
+    run = {};
+    time_t now = hal::now();
+    run.start = now >= CLOCK_VALID_AFTER ? (uint32_t)now : 0;
+    _startMs[w] = hal::millis();
+    run.stepsPerRev = stepsPerRev;
+    run.rpmX10 = (uint16_t)(rpm * 10.0f + 0.5f);
+    run.winder = w;
+    run.trigger = trigger;
+    run.flags = (clockwise ? CLOCKWISE : 0) | (alternate ? ALTERNATE : 0);
+    _open[w] = true;
+}
+
+void WindingHistory::finish(uint8_t w, uint32_t steps, bool aborted) {
+    if (!_open[w]) return;
+    _open[w] = false;
+    Run& run = _runs[w];
+    // A run started before SNTP set the clock is dated back from its end;
+    // if the clock is still unset it stays undated (start = end = 0)
+    time_t now = hal::now();
+    if (now >= CLOCK_VALID_AFTER) {
+        run.end = (uint32_t)now;
+        if (!run.start) run.start = run.end - (hal::millis() - _startMs[w]) / 1000;
+    } else {
+        run.start = 0;
+        run.end = 0;
+    }
+    run.steps = steps;
+    if (aborted) run.flags |= ABORTED;
+    if (!_ready) return;
+    HeapScope heapScope(HeapTag::History);
+
+    // Record first, then the header that counts it
+    if (!hal::fsWriteAt(PATH, slotOffset(_total), &run, sizeof(run))) {
+        Serial.println("[History] Failed to write run");
+        return;
+    }
+    _total++;
+    writeHeader();
+    addToStats(run);
+    saveStats();
+    Serial.printf("[History] Winder %u: run #%u, %u steps%s\n", w, (unsigned)(_total - 1), (unsigned)steps,
+                  aborted ? " (aborted)" : "");
+}
+
+size_t WindingHistory::read(uint32_t index, Run* out, size_t max) const {
+    if (index < first()) index = first();
+    size_t n = 0;
+    while (n < max && index < _total) {
+        // Runs are contiguous up to the end of the slot area
+        size_t chunk = CAPACITY - index % CAPACITY;
+        if (chunk > max - n) chunk = max - n;
+        if (chunk > _total - index) chunk = _total - index;
+        size_t got = hal::fsReadAt(PATH, slotOffset(index), out + n, chunk * sizeof(Run)) / sizeof(Run);
+        n += got;
+        index += got;
+        if (got < chunk) break;
+    }
+    return n;
+}
+
+size_t WindingHistory::exportRecent(uint8_t* buf, size_t len) const {
+    if (!_ready || len < sizeof(Header)) return 0;
+    size_t max = (len - sizeof(Header)) / sizeof(Run);
+    if (max > _total - first()) max = _total - first();
+    size_t n = read(_total - max, (Run*)(buf + sizeof(Header)), max);
+    Header hdr = {MAGIC, FORMAT_VERSION, (uint16_t)sizeof(Run), CAPACITY, 0, (uint32_t)n};
+    memcpy(buf, &hdr, sizeof(hdr));
+    return sizeof(Header) + n * sizeof(Run);
+}
+
+bool WindingHistory::writeHeader() {
+    Header hdr = {MAGIC, FORMAT_VERSION, (uint16_t)sizeof(Run), CAPACITY, 0, _total};
+    return hal::fsWriteAt(PATH, 0, &hdr, sizeof(hdr));
+}
+
+void WindingHistory::addToStats(const Run& run) {
+    if (run.winder >= WINDER_COUNT || run.stepsPerRev == 0) return;
+    WinderStats& s = _stats[run.winder];
+    uint32_t turnsX100 = (uint32_t)((uint64_t)run.steps * 100 / run.stepsPerRev);
+    uint32_t seconds = run.end > run.start ? run.end - run.start : 0;
+    bool aborted = run.flags & ABORTED;
+    s.runs++;
+    s.aborted += aborted;
+    s.turnsX100 += turnsX100;
+    s.seconds += seconds;
+
+    // Days are kept by the run's start; a new day takes the oldest slot,
+    // runs older than every kept day or undated only count toward the totals
+    if (run.start == 0) return;
+    uint32_t day = dayStart(run.start);
+    Day* d = nullptr;
+    for (uint8_t i = 0; i < DAYS; i++) {
+        if (s.days[i].dayStart == day && day != 0) d = &s.days[i];
+    }
+    if (!d && day > s.days[s.lastDay].dayStart) {
+        s.lastDay = (s.lastDay + 1) % DAYS;
+        d = &s.days[s.lastDay];
+        *d = {};
+        d->dayStart = day;
+    }
+    if (!d) return;
+    d->runs++;
+    d->aborted += aborted;
+    d->turnsX100 += turnsX100;
+    d->seconds += seconds;
+}
+
+bool WindingHistory::saveStats() {
+    uint8_t buf[sizeof(StatsHeader) + sizeof(_stats)];
+    StatsHeader sh = {STATS_MAGIC, FORMAT_VERSION, (uint16_t)sizeof(_stats), 0};
+    memcpy(buf + sizeof(sh), _stats, sizeof(_stats));
+    sh.crc = ConfigStore::crc32(buf + sizeof(sh), sizeof(_stats));
+    memcpy(buf, &sh, sizeof(sh));
+    if (!hal::fsWriteBytes(STATS_TMP_PATH, buf, sizeof(buf)) || !hal::fsRename(STATS_TMP_PATH, STATS_PATH)) {
+        Serial.printf("[History] Failed to write %s\n", STATS_PATH);
+        hal::fsRemove(STATS_TMP_PATH);
+        return false;
+    }
+    return true;
+}
+
+// Lifetime totals only cover the runs still kept after a rebuild
+void WindingHistory::rebuildStats() {
+    Serial.println("[History] Rebuilding statistics from the run records");
+    memset(_stats, 0, sizeof(_stats));
+    Run batch[16];
+    uint32_t index = first();
+    size_t n;
+    while ((n = read(index, batch, 16)) > 0) {
+        for (size_t i = 0; i < n; i++) addToStats(batch[i]);
+        index += n;
+    }
+    saveStats();
+}
+
+WindingHistory::Reader::Reader(bool csv, uint32_t after)
+    : _csv(csv), _after(after), _index(windingHistory.first()) {}
+
+int WindingHistory::Reader::formatRun(const Run& run) {
+    const char* trigger = run.trigger == Trigger::Scheduled ? "scheduled" : "manual";
+    const char* direction = run.flags & ALTERNATE ? "both" : run.flags & CLOCKWISE ? "cw" : "ccw";
+    float turns = run.stepsPerRev ? (float)run.steps / run.stepsPerRev : 0;
+    bool aborted = run.flags & ABORTED;
+    if (_csv) {
+        char start[20] = "", end[20] = "";  // empty for undated runs
+        time_t t = run.start;
+        if (t) strftime(start, sizeof(start), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        t = run.end;
+        if (t) strftime(end, sizeof(end), "%Y-%m-%d %H:%M:%S", localtime(&t));
+        return snprintf(_line, LINE_LEN, "%s,%s,%u,%s,%s,%.1f,%u,%.2f,%u\n", start, end, run.winder, trigger,
+                        direction, run.rpmX10 / 10.0f, (unsigned)run.steps, turns, aborted ? 1 : 0);
+    }
+    return snprintf(_line, LINE_LEN,
+                    "%s{\"start\":%u,\"end\":%u,\"winder\":%u,\"trigger\":\"%s\",\"direction\":\"%s\","
+                    "\"rpm\":%.1f,\"steps\":%u,\"turns\":%.2f,\"aborted\":%s}",
+                    _first ? "" : ",", (unsigned)run.start, (unsigned)run.end, run.winder, trigger, direction,
+                    run.rpmX10 / 10.0f, (unsigned)run.steps, turns, aborted ? "true" : "false");
+}
+
+bool WindingHistory::Reader::nextLine() {
+    int n = 0;
+    switch (_part) {
+    case Part::Head:
+        n = snprintf(_line, LINE_LEN, _csv ? "start,end,winder,trigger,direction,rpm,steps,turns,aborted\n"
+                                           : "{\"runs\":[");
+        _part = Part::Runs;
+        break;
+
+    case Part::Runs:
+        for (;;) {
+            if (_batchPos == _batchLen) {
+                // Runs overwritten since the last batch are skipped
+                if (_index < windingHistory.first()) _index = windingHistory.first();
+                _batchLen = windingHistory.read(_index, _batch, 8);
+                _batchPos = 0;
+                _index += _batchLen;
+                if (_batchLen == 0) {
+                    _part = Part::Tail;
+                    return nextLine();
+                }
+            }
+            const Run& run = _batch[_batchPos++];
+            if (run.start <= _after) continue;
+            n = formatRun(run);
+            _first = false;
+            break;
+        }
+        break;
+
+    case Part::Tail:
+        _part = Part::Done;
+        if (_csv) return false;
+        n = snprintf(_line, LINE_LEN, "]}");
+        break;
+
+    case Part::Done:
+        return false;
+    }
+    _lineLen = n < LINE_LEN ? n : LINE_LEN - 1;
+    _lineOff = 0;
+    return true;
+}
+
+size_t WindingHistory::Reader::read(char* buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+        if (_lineOff == _lineLen && !nextLine()) break;
+        size_t avail = _lineLen - _lineOff;
+        size_t chunk = avail < len - n ? avail : len - n;
+        memcpy(buf + n, _line + _lineOff, chunk);
+        _lineOff += chunk;
+        n += chunk;
+    }
+    return n;
+}
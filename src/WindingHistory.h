@@ -0,0 +1,139 @@
+#ifndef WINDING_HISTORY_H
+#define WINDING_HISTORY_H
+
+#include "Hal.h"
+#include "ConfigConstants.h"
+
+// Per-run winding history. Every finished run becomes a fixed 20-byte
+// record in a circular file of CAPACITY slots (PATH: header, then slots),
+// so the oldest runs are overwritten once it is full. Runs are numbered
+// from 0 in the order they were recorded; run n lives in slot n % CAPACITY.
+// Per-winder statistics (lifetime odometer plus the last DAYS days with
+// runs) are updated with each run and kept in STATS_PATH; if that file is
+// missing or invalid they are rebuilt from the records.
+class WindingHistory {
+public:
+    static constexpr const char* PATH = "/log/history.bin";
+    static constexpr const char* STATS_PATH = "/log/history_stats.bin";
+    static constexpr const char* STATS_TMP_PATH = "/log/history_stats.tmp";
+    static const uint32_t MAGIC = 0x48525757;        // "WWRH"
+    static const uint32_t STATS_MAGIC = 0x53525757;  // "WWRS"
+    static const uint16_t FORMAT_VERSION = 1;
+    static const uint16_t CAPACITY = 1024;           // about a year at three runs a day
+    static const uint8_t DAYS = 14;
+
+    enum class Trigger : uint8_t { Manual, Scheduled };
+    enum Flags : uint8_t { CLOCKWISE = 1, ALTERNATE = 2, ABORTED = 4 };
+
+    struct Run {
+        uint32_t start;        // epoch seconds; 0 if the clock was not set by the end
+        uint32_t end;
+        uint32_t steps;        // steps actually made
+        uint16_t stepsPerRev;  // of the step mode used, for turns
+        uint16_t rpmX10;
+        uint8_t winder;
+        Trigger trigger;
+        uint8_t flags;
+        uint8_t reserved;
+    };
+
+    struct Day {
+        uint32_t dayStart;     // local midnight, epoch seconds; 0 = unused
+        uint32_t turnsX100;
+        uint16_t runs;
+        uint16_t aborted;
+        uint32_t seconds;
+    };
+
+    struct WinderStats {
+        uint32_t runs;         // lifetime
+        uint32_t aborted;
+        uint32_t turnsX100;
+        uint32_t seconds;
+        Day days[DAYS];        // ring, days[lastDay] is the newest
+        uint8_t lastDay;
+        uint8_t reserved[3];
+    };
+
+    // Streams the kept runs (oldest first) that started after `after`, as
+    // CSV or as JSON {"runs":[...]}, a few records per read()
+    class Reader {
+    public:
+        static const uint16_t LINE_LEN = 192;
+
+        Reader(bool csv, uint32_t after);
+
+        // Fills buf; returns 0 when done
+        size_t read(char* buf, size_t len);
+
+    private:
+        enum class Part : uint8_t { Head, Runs, Tail, Done };
+
+        bool nextLine();
+        int formatRun(const Run& run);
+
+        bool _csv;
+        uint32_t _after;
+        uint32_t _index;       // next run number to read
+        Part _part = Part::Head;
+        bool _first = true;
+        Run _batch[8];
+        uint8_t _batchLen = 0;
+        uint8_t _batchPos = 0;
+        char _line[LINE_LEN];
+        uint16_t _lineLen = 0;
+        uint16_t _lineOff = 0;
+    };
+
+    // After the filesystem is mounted
+    void begin();
+
+    // A run begins; finish() records it. Starting over an open run drops it.
+    void start(uint8_t w, Trigger trigger, float rpm, bool clockwise, bool alternate, uint16_t stepsPerRev);
+    bool running(uint8_t w) const { return _open[w]; }
+    void finish(uint8_t w, uint32_t steps, bool aborted);
+
+    uint32_t total() const { return _total; }  // runs ever recorded
+    uint32_t first() const { return _total > CAPACITY ? _total - CAPACITY : 0; }  // oldest kept
+    // Up to `max` runs from run number `index` on; older ones are gone
+    size_t read(uint32_t index, Run* out, size_t max) const;
+    // The newest runs that fit in len bytes as a history file of their own,
+    // renumbered from 0; for carrying the history over a filesystem update
+    size_t exportRecent(uint8_t* buf, size_t len) const;
+    const WinderStats& stats(uint8_t w) const { return _stats[w]; }
+
+    static float turns(uint32_t turnsX100) { return turnsX100 / 100.0f; }
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint16_t format;
+        uint16_t recordSize;
+        uint16_t capacity;
+        uint16_t reserved;
+        uint32_t total;
+    };
+
+    struct StatsHeader {
+        uint32_t magic;
+        uint16_t format;
+        uint16_t length;  // sizeof(_stats)
+        uint32_t crc;
+    };
+
+    bool writeHeader();
+    void addToStats(const Run& run);
+    bool saveStats();
+    void rebuildStats();
+
+    Run _runs[WINDER_COUNT];    // open runs
+    unsigned long _startMs[WINDER_COUNT] = {};  // millis() at start, to date runs the clock missed
+    bool _open[WINDER_COUNT] = {};
+    uint32_t _total = 0;
+    WinderStats _stats[WINDER_COUNT] = {};
+    bool _ready = false;
+};
+
+extern WindingHistory windingHistory;
+
+#endif // WINDING_HISTORY_H
@@ -1,491 +1,814 @@
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
-#include <ESP8266WebServer.h>
+#include <ESPAsyncTCP.h>
+#include <ESPAsyncWebServer.h>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
+#include "Hal.h"
 #include "OtaUpdate.h"
 #include "ConfigConstants.h"
 #include "StepperMotorDriver.h"
-#include <WiFiManager.h>
+#include "StepScheduler.h"
+#include "CoilOutput.h"
+#include "WifiSetup.h"
 #include <time.h>
+#include <algorithm>
 #include "NtfyClient.h"
+#include "LoopProfiler.h"
+#include "StaticAssets.h"
+#include "ScheduleConfig.h"
+#include "ConfigStore.h"
+#include "ScheduleIndex.h"
+#include "TaskScheduler.h"
+#include "LiveStatus.h"
+#include "EventLog.h"
+#include "WindingHistory.h"
+#include "JsonStreamWriter.h"
+#include "JsonResponsePool.h"
+#include "HeapMonitor.h"
+#include "UpdateChecker.h"
+#include "BootTimeline.h"
 
 // Define your stepper motor pins here (change as per your wiring)
+#ifdef WINDER_SHIFT_REGISTER
+// 74HC595 chain: winder n on outputs 4n..4n+3 (QA-QD, QE-QH of each chip)
+#define SHIFT_DATA  D7
+#define SHIFT_CLOCK D5
+#define SHIFT_LATCH D6
+#else
+// IN1..IN4 per winder. D5 instead of D4 to avoid the onboard LED; D0 is
+// GPIO16, which is written separately from the other coils.
+const int WINDER_PINS[][4] = {
+  {D1, D2, D3, D5},
+  {D6, D7, D0, D8},
+};
+static_assert(WINDER_COUNT <= sizeof(WINDER_PINS) / sizeof(WINDER_PINS[0]), "not enough GPIOs, use WINDER_SHIFT_REGISTER");
+#endif
+static_assert(WINDER_COUNT >= 1 && WINDER_COUNT <= MAX_WINDERS, "WINDER_COUNT out of range");
 
-#define STEPPER_IN1 D1
-#define STEPPER_IN2 D2
-#define STEPPER_IN3 D3
-#define STEPPER_IN4 D5 // Changed from D4 to D5 to avoid onboard LED
+AsyncWebServer server(80);
+AsyncEventSource liveEvents("/api/live");  // status deltas, see LiveStatus
+WiFiEventHandler wifiGotIpHandler;
+WiFiEventHandler wifiDisconnectedHandler;
+bool wifiUp = false;  // disconnects are logged once, not per reconnect attempt
+bool fsMounted = false;  // without it the API runs on default settings and pages get a 503
 
-ESP8266WebServer server(80);
-StepperMotorDriver stepper(STEPPER_IN1, STEPPER_IN2, STEPPER_IN3, STEPPER_IN4);
+// Network bring-up after setup(), polled from loop() so the web server and
+// the motors run meanwhile: the saved credentials first, the captive portal
+// when there are none or they have not connected within
+// WIFI_PORTAL_AFTER_MS. A portal that times out goes back to the saved
+// credentials instead of restarting.
+enum class NetState : uint8_t { Off, Connecting, Portal, Online };
+NetState netState = NetState::Off;
+unsigned long netStateMs = 0;
+const unsigned long WIFI_PORTAL_AFTER_MS = 60 * 1000UL;
+const unsigned long WIFI_PORTAL_TIMEOUT_S = 180;
+const time_t CLOCK_VALID_AFTER = 1640995200;  // 2022-01-01, before that SNTP has not run
 
 // Forward declarations
-void serveHTML(const char* path);
-String readFile(const char* path);
-bool writeFile(const char* path, const String& content);
-void updateNextWindingTime();
+void serveHTML(AsyncWebServerRequest* request, const char* path);
+void updateNextWindingTime(uint8_t w);
 void loadNextWindingTime();
-void saveLastWindingTime();
-void getWindingParams(int& duration, String& speed);
-void handleRoot();
-void handleSetSchedule();
-void handleWindNow();
-void handleTroubleshooting();
-void handleApiConfig();
-void handleApiHome();
-void handleApiScheduleGet();
-void handleApiSchedulePost();
-void handleApiWindNow();
-void handleApiMotorGet();
-void handleApiMotorPost();
-void handleApiMemory();
-void handleApiUptime();
-void handleApiEvents();
-void handleApiCheckUpdate();
-void handleApiDoUpdate();
-void handleApiStop();
-void handleStaticFile();
-
-// Scheduled winding state
-time_t nextWindingEpoch = 0;
-unsigned long lastScheduleCheck = 0;
-const unsigned long SCHEDULE_CHECK_INTERVAL = 300 * 1000UL; // 300 seconds
-bool scheduledWindingInProgress = false;
-bool manualWindingInProgress = false;
+void saveLastWindingTime(uint8_t w);
+void getWindingParams(uint8_t w, int& duration, String& speed);
+bool applyMotorConfig(uint8_t w, char* motorJson);
+uint8_t winderIndex(AsyncWebServerRequest* request);
+void handleRoot(AsyncWebServerRequest* request);
+void handleSetSchedule(AsyncWebServerRequest* request);
+void handleWindNow(AsyncWebServerRequest* request);
+void handleTroubleshooting(AsyncWebServerRequest* request);
+void handleApiConfig(AsyncWebServerRequest* request);
+void handleApiConfigExport(AsyncWebServerRequest* request);
+void handleApiHome(AsyncWebServerRequest* request);
+void handleApiScheduleGet(AsyncWebServerRequest* request);
+void handleApiSchedulePost(AsyncWebServerRequest* request, char* body);
+void handleApiWindNow(AsyncWebServerRequest* request, char* body);
+void handleApiMotorGet(AsyncWebServerRequest* request);
+void handleApiMotorPost(AsyncWebServerRequest* request, char* body);
+void handleApiMotorStats(AsyncWebServerRequest* request);
+void handleApiMotorStatsReset(AsyncWebServerRequest* request);
+void handleApiMotors(AsyncWebServerRequest* request);
+void handleApiMemory(AsyncWebServerRequest* request);
+void handleApiUptime(AsyncWebServerRequest* request);
+void handleApiNetwork(AsyncWebServerRequest* request);
+void handleApiProfile(AsyncWebServerRequest* request);
+void handleApiEvents(AsyncWebServerRequest* request);
+void handleApiHistory(AsyncWebServerRequest* request);
+void handleApiHistoryStats(AsyncWebServerRequest* request);
+void handleApiCheckUpdate(AsyncWebServerRequest* request);
+void handleApiDoUpdate(AsyncWebServerRequest* request);
+void handleApiStop(AsyncWebServerRequest* request);
+void handleStaticFile(AsyncWebServerRequest* request);
+void checkSchedule();
+void recordFinishedRun(uint8_t w, bool superseded = false);
+void armNextWinding();
+void startScheduledWindings();
+void logHeap();
+void publishLiveStatus();
+void windingTimes(time_t& last, time_t& next);
+void minuteHousekeeping();
+void onJsonPost(const char* uri, void (*handler)(AsyncWebServerRequest*, char*));
+void processDeferredRequests();
+void pollNetwork();
+void finishDoUpdate();
 
-// Helper function implementations
-String readFile(const char* path) {
-  File file = LittleFS.open(path, "r");
-  if (!file) {
-    Serial.printf("[readFile] Failed to open: %s\n", path);
-    return "";
-  }
-  String content = file.readString();
-  file.close();
-  content.trim();
-  return content;
-}
-
-bool writeFile(const char* path, const String& content) {
-  File file = LittleFS.open(path, "w");
-  if (!file) {
-    Serial.printf("[writeFile] Failed to open: %s\n", path);
-    return false;
-  }
-  file.print(content);
-  file.close();
-  return true;
-}
+const unsigned long WINDING_REST_MS = 10 * 1000UL; // pause between CW/CCW blocks
 
-const char* weekdayName(int wday) {
-  static const char* names[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
-  return names[wday % 7];
-}
+// Async handlers run in the TCP stack's context, where blocking calls
+// (TLS fetches, flash writes, delay/yield) are not allowed and the stepper
+// state is owned by loop(). They only change settings in RAM and queue
+// the rest here; loop() finishes it in processDeferredRequests().
+struct PendingWind {
+  bool requested;
+  int duration;
+  float rpm;
+  bool clockwise;
+  bool alternate;
+};
+
+// A settings change waiting for its flash write. The request is answered
+// with the outcome from loop(), or dropped if its client has gone.
+struct PendingSave {
+  bool requested;
+  AsyncWebServerRequest* request;
+};
+void parkForSave(AsyncWebServerRequest* request, PendingSave& save);
+void finishSave(PendingSave& save, bool ok);
 
+// Per-winder state. Winder w has coil slot w, scheduleConfigs[w] and
+// ConfigStore section w, and is addressed as /api/motors/<w>/...
+struct Winder {
+  StepperMotorDriver stepper;
+  ScheduleIndex scheduleIndex;       // rebuilt when the schedule version changes
+  uint32_t scheduleVersionSeen;      // schedule version the index was built from
+  time_t nextWindingEpoch;
+  bool scheduledWindingInProgress;
+  bool manualWindingInProgress;
+  PendingWind pendingWind;
+  PendingSave scheduleSave;
+  PendingSave motorSave;
+  bool stopRequested;
+};
+Winder winders[WINDER_COUNT];
+TaskScheduler::TaskId windingTask = TaskScheduler::NONE;  // fires at the earliest nextWindingEpoch
+const char* MOTORS_PREFIX = "/api/motors/";
+
+AsyncWebServerRequest* pendingDoUpdate = nullptr;
+const size_t MAX_POST_BODY = 1024;
+
+// Helper function implementations
 String formatISO8601(const struct tm& t) {
   char buf[25];
   snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d", t.tm_year+1900, t.tm_mon+1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
   return String(buf);
 }
 
-time_t parseISO8601(const String& iso) {
+String formatEpoch(time_t epoch) {
+  if (epoch == 0) return String();
   struct tm t;
-  if (sscanf(iso.c_str(), "%d-%d-%dT%d:%d:%d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) == 6) {
-    t.tm_year -= 1900;
-    t.tm_mon -= 1;
-    t.tm_isdst = -1;
-    return mktime(&t);
+  localtime_r(&epoch, &t);
+  return formatISO8601(t);
+}
+
+// formatEpoch() without the String, for JSON rendering; "" for 0
+const char* formatEpoch(time_t epoch, char (&buf)[25]) {
+  buf[0] = '\0';
+  if (epoch == 0) return buf;
+  struct tm t;
+  localtime_r(&epoch, &t);
+  snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d", t.tm_year+1900, t.tm_mon+1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+  return buf;
+}
+
+// Fixed replies are sent from the literal without copying it
+void sendJson(AsyncWebServerRequest* request, int code, const char* json) {
+  HeapScope heapScope(HeapTag::Http);
+  bootTimeline.mark(BootPhase::FirstRequest);
+  request->send(request->beginResponse_P(code, "application/json", (const uint8_t*)json, strlen(json)));
+}
+
+// Copies of the data the JSON responses being sent render from: four
+// small slots, and one for the largest (profile, memory, history stats,
+// config export; +8 for the snapshot's padding)
+static constexpr size_t JSON_LARGE_SNAPSHOT = std::max({sizeof(LoopProfiler), sizeof(HeapMonitor::Heap) + sizeof(HeapMonitor) + 8,
+                                                       WINDER_COUNT * sizeof(WindingHistory::WinderStats), sizeof(ConfigStore)});
+static JsonResponsePool<128, 4, JSON_LARGE_SNAPSHOT> jsonResponses;
+
+// JSON responses are chunked: JsonStreamWriter renders every chunk straight
+// into the send buffer from a copy of the data in a pool slot, which is
+// freed when the request goes away. Nothing is allocated per response and
+// every chunk sees the same data; 503 while all slots are in use.
+template <typename Data, typename Render>
+void sendJson(AsyncWebServerRequest* request, int code, const Data& data, Render render) {
+  HeapScope heapScope(HeapTag::Http);
+  auto slot = jsonResponses.take<Data>(data, render);
+  if (!slot) {
+    sendJson(request, 503, "{\"status\":\"error\",\"error\":\"Busy\"}");
+    return;
   }
-  return 0;
+  request->onDisconnect([slot]() { jsonResponses.release(slot); });
+  AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+    [slot](uint8_t* buffer, size_t maxLen, size_t index) -> size_t { return slot->fill(buffer, maxLen, index); });
+  response->setCode(code);
+  bootTimeline.mark(BootPhase::FirstRequest);
+  request->send(response);
 }
 
 void loadNextWindingTime() {
-  String nextWindingStr = readFile("/Config/next_winding.txt");
-  nextWindingEpoch = parseISO8601(nextWindingStr);
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) winders[w].nextWindingEpoch = configStore.nextWinding(w);
+  armNextWinding();
+}
+
+// (Re)schedule one wakeup for the earliest nextWindingEpoch of all winders
+void armNextWinding() {
+  taskScheduler.cancel(windingTask);
+  time_t soonest = 0;
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    time_t t = winders[w].nextWindingEpoch;
+    if (t > 0 && (soonest == 0 || t < soonest)) soonest = t;
+  }
+  if (soonest > 0) windingTask = taskScheduler.at(soonest, startScheduledWindings);
 }
 
-void saveLastWindingTime() {
+void saveLastWindingTime(uint8_t w) {
   time_t now = time(nullptr);
-  struct tm t;
-  localtime_r(&now, &t);
-  String iso = formatISO8601(t);
-  writeFile("/Config/last_winding.txt", iso);
-  Serial.printf("[WINDING] Last winding time saved: %s\n", iso.c_str());
+  if (now < CLOCK_VALID_AFTER) return;  // a run before the clock was set has no date
+  configStore.setLastWinding(w, now);
+  String iso = formatEpoch(now);
+  Serial.printf("[WINDING] Winder %u: last winding time saved: %s\n", w, iso.c_str());
   iso = String();
 }
 
-void getWindingParams(int& duration, String& speed) {
-  String sched = readFile("/Config/schedule.txt");
-  duration = 30;
-  speed = "Medium";
-  if (sched.length() > 0) {
-    StaticJsonDocument<256> doc;
-    DeserializationError err = deserializeJson(doc, sched);
-    if (!err) {
-      if (doc.containsKey("winding_duration")) duration = doc["winding_duration"];
-      if (doc.containsKey("winding_speed")) speed = String(doc["winding_speed"].as<const char*>());
-    }
-    doc.clear();
+void getWindingParams(uint8_t w, int& duration, String& speed) {
+  duration = scheduleConfigs[w].durationMin;
+  speed = scheduleConfigs[w].speed;
+}
+
+// /api/motors/<w>/... addresses winder w; the older un-indexed routes are
+// winder 0. Routes are only registered for valid indices.
+uint8_t winderIndex(AsyncWebServerRequest* request) {
+  const String& url = request->url();
+  if (!url.startsWith(MOTORS_PREFIX)) return 0;
+  return atoi(url.c_str() + strlen(MOTORS_PREFIX));
+}
+
+// Apply per-winder motor settings posted to /api/motor to the config store
+// (RAM); loop() passes the step mode on to the stepper and saves them.
+// Fields left out keep their current value.
+bool applyMotorConfig(uint8_t w, char* motorJson) {
+  StaticJsonDocument<256> doc;
+  DeserializationError err = deserializeJson(doc, motorJson);  // in place, strings point into motorJson
+  if (err) {
+    Serial.println("[MOTOR] Invalid motor config, keeping current settings");
+    return false;
   }
-  sched = String();
+  ConfigStore::MotorSettings motor = configStore.motor(w);
+  if (doc.containsKey("step_mode")) {
+    motor.stepMode = StepperMotorDriver::stepModeFromString(doc["step_mode"].as<const char*>());
+  }
+  motor.dutyCycle = doc["duty_cycle"] | motor.dutyCycle;
+  motor.pulseWidth = doc["pulse_width"] | motor.pulseWidth;
+  configStore.setMotor(w, motor);
+  doc.clear();
+  return true;
 }
 
-void updateNextWindingTime() {
-  String sched = readFile("/Config/schedule.txt");
-  if (sched.length() == 0) return;
-  StaticJsonDocument<512> doc;
-  DeserializationError err = deserializeJson(doc, sched);
-  if (err) return;
-  JsonArray times = doc["winding_times"].as<JsonArray>();
-  JsonObject days = doc["days"].as<JsonObject>();
-  time_t now = time(nullptr);
-  struct tm t;
-  localtime_r(&now, &t);
-  time_t soonest = 0;
-  for (int dayOffset = 0; dayOffset < 8; ++dayOffset) {
-    int wday = (t.tm_wday + dayOffset) % 7;
-    const char* dayName = weekdayName(wday);
-    if (!days[dayName] || !days[dayName].as<bool>()) continue;
-    for (JsonVariant timeObj : times) {
-      // Skip if this time slot is disabled
-      if (timeObj.containsKey("enabled") && !timeObj["enabled"].as<bool>()) continue;
-      
-      int hour = timeObj["hour"];
-      int minute = timeObj["minute"];
-      String ampm = timeObj["ampm"].as<String>();
-      int hour24 = (ampm == "PM" && hour != 12) ? hour + 12 : (ampm == "AM" && hour == 12 ? 0 : hour);
-      struct tm candidate = t;
-      candidate.tm_mday += dayOffset;
-      candidate.tm_hour = hour24;
-      candidate.tm_min = minute;
-      candidate.tm_sec = 0;
-      time_t candidateEpoch = mktime(&candidate);
-      if (candidateEpoch <= now) continue;
-      if (soonest == 0 || candidateEpoch < soonest) soonest = candidateEpoch;
-    }
+// Latest finished and earliest upcoming winding across all winders
+void windingTimes(time_t& last, time_t& next) {
+  last = 0;
+  next = 0;
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    if (configStore.lastWinding(w) > last) last = configStore.lastWinding(w);
+    time_t t = configStore.nextWinding(w);
+    if (t > 0 && (next == 0 || t < next)) next = t;
   }
+}
+
+// Callers re-arm the wakeup with armNextWinding()
+void updateNextWindingTime(uint8_t w) {
+  Winder& winder = winders[w];
+  time_t soonest = winder.scheduleIndex.next(time(nullptr));
   if (soonest > 0) {
-    struct tm soonestTm;
-    localtime_r(&soonest, &soonestTm);
-    String iso = formatISO8601(soonestTm);
-    writeFile("/Config/next_winding.txt", iso);
-    nextWindingEpoch = soonest;
-    Serial.printf("[SCHEDULE] Next winding scheduled for %s\n", iso.c_str());
+    String iso = formatEpoch(soonest);
+    configStore.setNextWinding(w, soonest);
+    winder.nextWindingEpoch = soonest;
+    Serial.printf("[SCHEDULE] Winder %u: next winding scheduled for %s\n", w, iso.c_str());
     iso = String();
   } else {
-    Serial.println("[SCHEDULE] No valid next winding time found.");
+    Serial.printf("[SCHEDULE] Winder %u: no valid next winding time found.\n", w);
+    winder.nextWindingEpoch = 0;
   }
-  
-  // Cleanup
-  doc.clear();
-  sched = String();
 }
 
 // HTML route handlers
-void handleRoot() { serveHTML("/UI/index.html"); }
-void handleSetSchedule() { serveHTML("/UI/setschedule.html"); }
-void handleWindNow() { serveHTML("/UI/windnow.html"); }
-void handleTroubleshooting() { serveHTML("/UI/troubleshooting.html"); }
-
-void serveHTML(const char* path) {
-  File file = LittleFS.open(path, "r");
-  if (!file) {
-    server.send(404, "text/html", "<html><body>File not found</body></html>");
+void handleRoot(AsyncWebServerRequest* request) { serveHTML(request, "/UI/index.html"); }
+void handleSetSchedule(AsyncWebServerRequest* request) { serveHTML(request, "/UI/setschedule.html"); }
+void handleWindNow(AsyncWebServerRequest* request) { serveHTML(request, "/UI/windnow.html"); }
+void handleTroubleshooting(AsyncWebServerRequest* request) { serveHTML(request, "/UI/troubleshooting.html"); }
+
+// Serves a /UI file. The build step stores text assets as <path>.gz only;
+// AsyncFileResponse falls back to that and adds Content-Encoding: gzip.
+void serveHTML(AsyncWebServerRequest* request, const char* path) {
+  HeapScope heapScope(HeapTag::Http);
+  bootTimeline.mark(BootPhase::FirstRequest);
+  if (!fsMounted) {
+    request->send(503, "text/html", "<html><body>File system not mounted. The API still works; "
+                                    "reflash the filesystem image or run an OTA update.</body></html>");
+    return;
+  }
+  String gzPath = String(path) + ".gz";
+  if (!LittleFS.exists(path) && !LittleFS.exists(gzPath)) {
+    request->send(404, "text/html", "<html><body>File not found</body></html>");
     return;
   }
-  server.streamFile(file, "text/html");
-  file.close();
+  
+  const char* etag = staticAssets.etag(path);
+  const char* cacheControl = StaticAssets::cacheControl(path);
+  AsyncWebServerResponse* response;
+  if (etag && request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+    response = request->beginResponse(304);
+  } else {
+    response = request->beginResponse(LittleFS, path, StaticAssets::contentType(path));
+  }
+  if (etag) {
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", cacheControl);
+  }
+  request->send(response);
 }
 
-void handleStaticFile() {
-  String path = "/UI" + server.uri();
+void handleStaticFile(AsyncWebServerRequest* request) {
+  String path = "/UI" + request->url();
   Serial.printf("[handleStaticFile] Serving: %s\n", path.c_str());
-  
-  String contentType = "text/plain";
-  if (path.endsWith(".css")) contentType = "text/css";
-  else if (path.endsWith(".js")) contentType = "application/javascript";
-  else if (path.endsWith(".png")) contentType = "image/png";
-  else if (path.endsWith(".jpg") || path.endsWith(".jpeg")) contentType = "image/jpeg";
-  else if (path.endsWith(".gif")) contentType = "image/gif";
-  else if (path.endsWith(".svg")) contentType = "image/svg+xml";
-  
-  File file = LittleFS.open(path, "r");
-  if (!file) {
-    server.send(404, "text/plain", "File not found");
-    return;
-  }
-  server.streamFile(file, contentType);
-  file.close();
+  serveHTML(request, path.c_str());
 }
 
 // API Endpoints
-void handleApiConfig() {
+void handleApiConfig(AsyncWebServerRequest* request) {
   Serial.println("[API] GET /api/config");
-  yield();
-  StaticJsonDocument<256> doc;
-  doc["ntfy_topic"] = NTFY_TOPIC;
-  doc["wifi_ssid"] = WiFi.SSID();
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+  struct Snapshot { char ssid[33]; } snap;
+  strlcpy(snap.ssid, WiFi.SSID().c_str(), sizeof(snap.ssid));
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    json.beginObject().field("ntfy_topic", NTFY_TOPIC).field("wifi_ssid", s.ssid).endObject();
+  });
 }
 
-void handleApiHome() {
+// All stored settings in the JSON import format, for backup
+void handleApiConfigExport(AsyncWebServerRequest* request) {
+  Serial.println("[API] GET /api/config/export");
+  sendJson(request, 200, configStore, [](JsonStreamWriter& json, const ConfigStore& store) {
+    store.exportJson(json);
+  });
+}
+
+void handleApiHome(AsyncWebServerRequest* request) {
   Serial.println("[API] GET /api/home");
-  yield();
 
-  String lastWindingStr = readFile("/Config/last_winding.txt");
-  String nextWindingStr = readFile("/Config/next_winding.txt");
-  String quantity = readFile("/Config/quantity.txt");
+  struct Snapshot { time_t last, next; bool online; } snap;
+  windingTimes(snap.last, snap.next);
+  snap.online = WiFi.status() == WL_CONNECTED;
 
-  StaticJsonDocument<256> doc;
-  
-  // Connection status
-  doc["connectionStatus"] = (WiFi.status() == WL_CONNECTED) ? "Online" : "Offline";
-  
-  // Last winding time (ISO format from file)
-  if (lastWindingStr.length() > 0) {
-    doc["lastWinding"] = lastWindingStr;
-  }
-  
-  // Next winding time (ISO format from file)
-  if (nextWindingStr.length() > 0) {
-    doc["nextWinding"] = nextWindingStr;
-  } else {
-    doc["nextWinding"] = "Not scheduled";
-  }
-  
-  // Wind remaining (not implemented, placeholder)
-  doc["windRemaining"] = "N/A";
-  
-  // Battery status (not implemented, placeholder)
-  doc["batteryStatus"] = "N/A";
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    char iso[25];
+    json.beginObject();
+    // Connection status
+    json.field("connectionStatus", s.online ? "Online" : "Offline");
+    // Last winding time (ISO format from file)
+    if (s.last) json.field("lastWinding", formatEpoch(s.last, iso));
+    // Next winding time (ISO format from file)
+    json.field("nextWinding", s.next ? formatEpoch(s.next, iso) : "Not scheduled");
+    // Wind remaining and battery status (not implemented, placeholders)
+    json.field("windRemaining", "N/A");
+    json.field("batteryStatus", "N/A");
+    json.endObject();
+  });
+}
 
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
-  
-  // Cleanup
-  doc.clear();
-  lastWindingStr = String();
-  nextWindingStr = String();
-  quantity = String();
-  response = String();
-}
-
-void handleApiScheduleGet() {
-  Serial.println("[API] GET /api/schedule");
-  yield();
-  String scheduleData = readFile("/Config/schedule.txt");
-  if (scheduleData.length() > 0) {
-    StaticJsonDocument<512> doc;
-    DeserializationError err = deserializeJson(doc, scheduleData);
-    if (!err) {
-      if (!doc.containsKey("winding_speed")) {
-        doc["winding_speed"] = "Medium";
-      }
-      String response;
-      serializeJson(doc, response);
-      server.send(200, "application/json", response);
-      doc.clear();
-    } else {
-      server.send(400, "application/json", "{\"status\":\"error\",\"error\":\"Invalid JSON\"}");
-    }
-  } else {
-    server.send(404, "application/json", "{\"error\":\"Schedule not found\"}");
+void handleApiScheduleGet(AsyncWebServerRequest* request) {
+  Serial.printf("[API] GET %s\n", request->url().c_str());
+  const ScheduleConfig& sched = scheduleConfigs[winderIndex(request)];
+  if (sched.version() == 0) {
+    sendJson(request, 404, "{\"error\":\"Schedule not found\"}");
+    return;
   }
-  scheduleData = String();
+  sendJson(request, 200, sched, [](JsonStreamWriter& json, const ScheduleConfig& s) { s.writeJson(json); });
 }
 
-void handleApiSchedulePost() {
-  Serial.println("[API] POST /api/schedule");
-  yield();
-  if (server.hasArg("plain")) {
-    String body = server.arg("plain");
-    StaticJsonDocument<512> doc;
-    DeserializationError err = deserializeJson(doc, body);
-    if (!err) {
-      if (!doc.containsKey("winding_speed")) {
-        doc["winding_speed"] = "Medium";
-      }
-      String out;
-      serializeJson(doc, out);
-      if (writeFile("/Config/schedule.txt", out)) {
-        // Update next winding time after saving schedule
-        updateNextWindingTime();
-        server.send(200, "application/json", "{\"status\":\"ok\"}");
-      } else {
-        server.send(500, "application/json", "{\"status\":\"error\",\"error\":\"Failed to save\"}");
-      }
-      doc.clear();
-      out = String();
+void handleApiSchedulePost(AsyncWebServerRequest* request, char* body) {
+  Serial.printf("[API] POST %s\n", request->url().c_str());
+  uint8_t w = winderIndex(request);
+  if (body && body[0]) {
+    ScheduleConfig parsed;
+    if (!parsed.fromJson(body)) {
+      sendJson(request, 400, "{\"status\":\"error\",\"error\":\"Invalid JSON\"}");
+    } else if (winders[w].scheduleSave.requested) {
+      sendJson(request, 503, "{\"status\":\"error\",\"error\":\"Save in progress\"}");
     } else {
-      server.send(400, "application/json", "{\"status\":\"error\",\"error\":\"Invalid JSON\"}");
+      // Saved and answered by loop()
+      configStore.setSchedule(w, parsed);
+      parkForSave(request, winders[w].scheduleSave);
     }
-    body = String();
   } else {
-    server.send(400, "application/json", "{\"status\":\"error\",\"error\":\"No data\"}");
+    sendJson(request, 400, "{\"status\":\"error\",\"error\":\"No data\"}");
   }
 }
 
-void handleApiWindNow() {
-  Serial.println("[API] POST /api/windnow");
-  yield();
-  if (server.hasArg("plain")) {
-    String body = server.arg("plain");
+void handleApiWindNow(AsyncWebServerRequest* request, char* body) {
+  Serial.printf("[API] POST %s\n", request->url().c_str());
+  uint8_t w = winderIndex(request);
+  if (body && body[0]) {
     StaticJsonDocument<128> doc;
     deserializeJson(doc, body);
     
       int duration = doc["duration"] | 30;
       Serial.printf("[API] Winding for %d minutes\n", duration);
 
-      writeFile("/Config/duration.txt", String(duration));
-
-      String speedStr = "Medium";
-      if (doc.containsKey("speed")) {
-        speedStr = String(doc["speed"].as<const char*>());
-      }
-
+      const char* speedStr = doc["speed"] | "Medium";
       float rpm = StepperMotorDriver::speedStringToRPM(speedStr);
-      Serial.printf("[API] Using winding speed: %s (%.1f RPM)\n", speedStr.c_str(), rpm);
+      Serial.printf("[API] Using winding speed: %s (%.1f RPM)\n", speedStr, rpm);
 
       bool clockwise = true;
-      if (doc.containsKey("direction")) {
-        String dirStr = String(doc["direction"].as<const char*>());
-        if (dirStr == "CCW" || dirStr == "ccw" || dirStr == "counterclockwise") clockwise = false;
-      }
+      bool alternate = false;
+      const char* dirStr = doc["direction"] | "";
+      if (!strcasecmp(dirStr, "ccw") || !strcmp(dirStr, "counterclockwise")) clockwise = false;
+      if (!strcasecmp(dirStr, "both") || !strcmp(dirStr, "alternate")) alternate = true;
 
-      stepper.runForDuration((float)duration, rpm, clockwise);
-      manualWindingInProgress = true;
+      // Started from loop(), which owns the stepper
+      PendingWind& pendingWind = winders[w].pendingWind;
+      pendingWind.duration = duration;
+      pendingWind.rpm = rpm;
+      pendingWind.clockwise = clockwise;
+      pendingWind.alternate = alternate;
+      pendingWind.requested = true;
 
-      server.send(200, "application/json", "{\"status\":\"ok\",\"message\":\"Winding started\"}");
-      
-      // Cleanup
-      doc.clear();
-      speedStr = String();
-      body = String();
-  } else {
-    server.send(400, "application/json", "{\"status\":\"error\",\"error\":\"No data\"}");
+      sendJson(request, 200, "{\"status\":\"ok\",\"message\":\"Winding started\"}");
+    } else {
+    sendJson(request, 400, "{\"status\":\"error\",\"error\":\"No data\"}");
   }
 }
 
-void handleApiStop() {
-  Serial.println("[API] POST /api/stop - Stopping winding");
-  stepper.stop();
-  scheduledWindingInProgress = false;
-  server.send(200, "application/json", "{\"status\":\"ok\",\"message\":\"Winding stopped\"}");
+// /api/stop stops every winder, /api/motors/<w>/stop just one
+void handleApiStop(AsyncWebServerRequest* request) {
+  Serial.printf("[API] POST %s - Stopping winding\n", request->url().c_str());
+  bool all = !request->url().startsWith(MOTORS_PREFIX);
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    if (!all && w != winderIndex(request)) continue;
+    // Stopped by loop(), which owns the stepper
+    winders[w].pendingWind.requested = false;
+    winders[w].stopRequested = true;
+  }
+  sendJson(request, 200, "{\"status\":\"ok\",\"message\":\"Winding stopped\"}");
 }
 
-void handleApiMotorGet() {
-  Serial.println("[API] GET /api/motor");
-  yield();
-  String motorData = readFile("/Config/motor.txt");
-  if (motorData.length() > 0) {
-    server.send(200, "application/json", motorData);
-  } else {
-    server.send(404, "application/json", "{\"error\":\"Motor config not found\"}");
-  }
+void handleApiMotorGet(AsyncWebServerRequest* request) {
+  Serial.printf("[API] GET %s\n", request->url().c_str());
+  const ConfigStore::MotorSettings& motor = configStore.motor(winderIndex(request));
+  sendJson(request, 200, motor, [](JsonStreamWriter& json, const ConfigStore::MotorSettings& m) {
+    json.beginObject()
+        .field("duty_cycle", m.dutyCycle)
+        .field("pulse_width", m.pulseWidth)
+        .field("step_mode", StepperMotorDriver::stepModeToString(m.stepMode))
+        .endObject();
+  });
 }
 
-void handleApiMotorPost() {
-  Serial.println("[API] POST /api/motor");
-  yield();
-  if (server.hasArg("plain")) {
-    String body = server.arg("plain");
-    if (writeFile("/Config/motor.txt", body)) {
-      server.send(200, "application/json", "{\"status\":\"ok\"}");
+void handleApiMotorPost(AsyncWebServerRequest* request, char* body) {
+  Serial.printf("[API] POST %s\n", request->url().c_str());
+  uint8_t w = winderIndex(request);
+  if (body && body[0]) {
+    if (winders[w].motorSave.requested) {
+      sendJson(request, 503, "{\"status\":\"error\",\"error\":\"Save in progress\"}");
+    } else if (!applyMotorConfig(w, body)) {
+      sendJson(request, 400, "{\"status\":\"error\",\"error\":\"Invalid JSON\"}");
     } else {
-      server.send(500, "application/json", "{\"status\":\"error\",\"error\":\"Failed to save\"}");
+      // Saved and answered by loop()
+      parkForSave(request, winders[w].motorSave);
     }
   } else {
-    server.send(400, "application/json", "{\"status\":\"error\",\"error\":\"No data\"}");
+    sendJson(request, 400, "{\"status\":\"error\",\"error\":\"No data\"}");
+  }
+}
+
+void handleApiMotorStats(AsyncWebServerRequest* request) {
+  Serial.printf("[API] GET %s\n", request->url().c_str());
+  const StepperMotorDriver& stepper = winders[winderIndex(request)].stepper;
+  struct Snapshot {
+    uint8_t index;
+    bool running;
+    bool timerMode;
+    StepTimingStats::Summary stats;
+  } snap = {stepper.index(), stepper.isRunning(), stepScheduler.timerMode(), {}};
+  stepper.timingStats().summarize(snap.stats);
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    json.beginObject()
+        .field("index", s.index)
+        .field("running", s.running)
+        .field("timer_mode", s.timerMode)
+        .field("steps", s.stats.steps)
+        .field("window", s.stats.window)
+        .field("late_min_us", s.stats.minUs)
+        .field("late_max_us", s.stats.maxUs)
+        .field("late_mean_us", s.stats.meanUs)
+        .field("late_p99_us", s.stats.p99Us)
+        .field("catchup_bursts", s.stats.catchUpBursts)
+        .field("catchup_cap_hits", s.stats.catchUpCapHits)
+        .endObject();
+  });
+}
+
+void handleApiMotorStatsReset(AsyncWebServerRequest* request) {
+  Serial.printf("[API] POST %s\n", request->url().c_str());
+  winders[winderIndex(request)].stepper.resetTimingStats();
+  sendJson(request, 200, "{\"status\":\"ok\"}");
+}
+
+// Overview of all winders, for picking one in the UI
+void handleApiMotors(AsyncWebServerRequest* request) {
+  Serial.println("[API] GET /api/motors");
+  struct Motor { bool running; StepMode stepMode; time_t last, next; };
+  struct Snapshot { Motor motors[WINDER_COUNT]; } snap;
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    snap.motors[w] = {winders[w].stepper.isRunning(), configStore.motor(w).stepMode,
+                      configStore.lastWinding(w), configStore.nextWinding(w)};
   }
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    char iso[25];
+    json.beginObject().beginArray("motors");
+    for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+      const Motor& m = s.motors[w];
+      json.beginObject()
+          .field("index", w)
+          .field("running", m.running)
+          .field("step_mode", StepperMotorDriver::stepModeToString(m.stepMode))
+          .field("last_winding", formatEpoch(m.last, iso))
+          .field("next_winding", formatEpoch(m.next, iso))
+          .endObject();
+    }
+    json.endArray().endObject();
+  });
 }
 
-void handleApiMemory() {
+void handleApiMemory(AsyncWebServerRequest* request) {
   Serial.println("[API] GET /api/system/memory");
-  yield();
-  StaticJsonDocument<128> doc;
-  doc["free_memory"] = ESP.getFreeHeap();
-  
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+  // Tag counters move with every allocation: the chunks render a copy
+  struct Snapshot { HeapMonitor::Heap heap; HeapMonitor monitor; } snap = {heapMonitor.sample(), heapMonitor};
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    const HeapMonitor::LowWater& boot = s.monitor.sinceBoot();
+    json.beginObject()
+        .field("free_memory", s.heap.free)
+        .field("max_free_block", s.heap.maxBlock)
+        .field("fragmentation", s.heap.fragmentation)
+        .field("min_free_memory", boot.minFree)
+        .field("min_max_free_block", boot.minMaxBlock)
+        .field("max_fragmentation", boot.maxFragmentation)
+        .field("tracking", s.monitor.instrumented() ? "allocation" : "scope")
+        .beginObject("tags");
+    for (uint8_t i = 0; i < (uint8_t)HeapTag::Count; i++) {
+      const HeapMonitor::TagStats& t = s.monitor.tag((HeapTag)i);
+      json.beginObject(HeapMonitor::tagName((HeapTag)i))
+          .field("allocs", t.allocs)
+          .field("frees", t.frees)
+          .field("bytes", t.bytes)
+          .field("live", t.liveBytes)
+          .field("peak", t.peakBytes)
+          .endObject();
+    }
+    // Hourly low-water marks, newest first
+    json.endObject().beginArray("history");
+    for (uint8_t i = 0; i < s.monitor.historyCount(); i++) {
+      const HeapMonitor::LowWater& low = s.monitor.history(i);
+      json.beginObject()
+          .field("start", low.startS)
+          .field("min_free", low.minFree)
+          .field("min_max_free_block", low.minMaxBlock)
+          .field("max_fragmentation", low.maxFragmentation)
+          .endObject();
+    }
+    json.endArray().endObject();
+  });
+  if (request->hasParam("reset") && request->getParam("reset")->value() == "1") heapMonitor.resetTags();
 }
 
-void handleApiUptime() {
+// Uptime, and the ms after start at which each boot phase was reached (null if not yet)
+void handleApiUptime(AsyncWebServerRequest* request) {
   Serial.println("[API] GET /api/system/uptime");
-  yield();
-  StaticJsonDocument<128> doc;
-  doc["uptime"] = millis() / 1000;
-  
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
-}
-
-void handleApiEvents() {
-  Serial.println("[API] GET /api/events");
-  yield();
-  StaticJsonDocument<512> doc;
-  JsonArray events = doc.createNestedArray("events");
-  events.add("System started");
-  events.add("WiFi connected");
-  events.add("Web server started");
-  
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+  struct Snapshot { uint32_t uptime; BootTimeline boot; } snap = {(uint32_t)(millis() / 1000), bootTimeline};
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    json.beginObject().field("uptime", s.uptime).beginObject("boot");
+    for (uint8_t i = 0; i < (uint8_t)BootPhase::Count; i++) {
+      BootPhase phase = (BootPhase)i;
+      if (s.boot.reached(phase)) {
+        json.field(BootTimeline::phaseName(phase), s.boot.at(phase));
+      } else {
+        json.rawField(BootTimeline::phaseName(phase), "null");
+      }
+    }
+    json.endObject().endObject();
+  });
 }
 
-void handleApiCheckUpdate() {
-  String localVersion = OtaUpdate::getLocalVersion();
-  String remoteVersion = OtaUpdate::getRemoteVersion(OTA_VERSION_URL);
-  bool updateAvailable = (remoteVersion.length() > 0 && remoteVersion != localVersion);
-  String response = String("{\"local_version\":\"") + localVersion + "\",\"remote_version\":\"" + remoteVersion + "\",\"update_available\":" + (updateAvailable ? "true" : "false") + "}";
-  server.send(200, "application/json", response);
-  
-  // Cleanup
-  localVersion = String();
-  remoteVersion = String();
-  response = String();
+// Outbound connections: shared HTTP(S) client and ntfy. Times are the
+// average ms to the response headers on new and reused connections.
+void handleApiNetwork(AsyncWebServerRequest* request) {
+  Serial.println("[API] GET /api/system/network");
+  struct Snapshot {
+    hal::HttpStats http;
+    bool open;
+    NtfyClient::Stats ntfy;
+  } snap = {hal::httpStats(), hal::httpConnectionOpen(), ntfy.stats()};
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    json.beginObject()
+        .beginObject("http")
+        .field("requests", s.http.requests)
+        .field("reused", s.http.reused)
+        .field("connects", s.http.connects)
+        .field("resumed", s.http.resumed)
+        .field("cold_ms", s.http.connects ? s.http.coldMs / s.http.connects : 0)
+        .field("warm_ms", s.http.reused ? s.http.warmMs / s.http.reused : 0)
+        .field("open", s.open)
+        .endObject()
+        .beginObject("ntfy")
+        .field("posts", s.ntfy.posts)
+        .field("sent", s.ntfy.sent)
+        .field("failures", s.ntfy.failures)
+        .field("dropped", s.ntfy.dropped)
+        .field("reused", s.ntfy.reused)
+        .endObject()
+        .endObject();
+  });
+}
+
+#ifndef WW_DISABLE_PROFILER
+// Loop profile: per-section counts, mean/max and log2 µs histograms.
+// ?reset=1 clears the counters after reporting.
+static void writeProfileStats(JsonStreamWriter& json, const char* key, const LoopProfiler::Stats& s) {
+  json.beginObject(key)
+      .field("count", s.count)
+      .field("mean_us", s.count ? (uint32_t)(s.totalUs / s.count) : 0)
+      .field("max_us", s.maxUs)
+      .beginArray("hist_log2_us");
+  for (uint8_t b = 0; b < LoopProfiler::BUCKETS; b++) json.value(s.hist[b]);
+  json.endArray().endObject();
+}
+
+void handleApiProfile(AsyncWebServerRequest* request) {
+  Serial.println("[API] GET /api/system/profile");
+  // Rendered from a copy, so ?reset=1 below does not change the response
+  sendJson(request, 200, loopProfiler, [](JsonStreamWriter& json, const LoopProfiler& p) {
+    json.beginObject();
+    writeProfileStats(json, "loop", p.loop());
+    json.beginObject("sections");
+    for (uint8_t i = 0; i < (uint8_t)ProfSection::Count; i++) {
+      ProfSection section = (ProfSection)i;
+      writeProfileStats(json, LoopProfiler::sectionName(section), p.section(section));
+    }
+    json.endObject().endObject();
+  });
+  if (request->hasParam("reset") && request->getParam("reset")->value() == "1") loopProfiler.reset();
+}
+#endif
+
+// ?format=csv|json&after=<epoch>: every kept run started after `after`, streamed
+void handleApiHistory(AsyncWebServerRequest* request) {
+  bool csv = !request->hasParam("format") || request->getParam("format")->value() != "json";
+  uint32_t after = request->hasParam("after") ? strtoul(request->getParam("after")->value().c_str(), nullptr, 10) : 0;
+  Serial.printf("[API] GET /api/history (%s, after %u)\n", csv ? "csv" : "json", (unsigned)after);
+
+  std::shared_ptr<WindingHistory::Reader> reader = std::make_shared<WindingHistory::Reader>(csv, after);
+  AsyncWebServerResponse* response = request->beginChunkedResponse(csv ? "text/csv" : "application/json",
+    [reader](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+      return reader->read((char*)buffer, maxLen);
+    });
+  if (csv) response->addHeader("Content-Disposition", "attachment; filename=\"winding-history.csv\"");
+  request->send(response);
 }
 
-void handleApiDoUpdate() {
-  // Get the remote version first
-  String remoteVersion = OtaUpdate::getRemoteVersion(OTA_VERSION_URL);
-  if (remoteVersion.length() == 0) {
+// Lifetime odometer and recent days per winder
+void handleApiHistoryStats(AsyncWebServerRequest* request) {
+  Serial.println("[API] GET /api/history/stats");
+  struct Snapshot { WindingHistory::WinderStats winders[WINDER_COUNT]; } snap;
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) snap.winders[w] = windingHistory.stats(w);
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    json.beginObject().beginArray("winders");
+    for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+      const WindingHistory::WinderStats& stats = s.winders[w];
+      json.beginObject()
+          .field("winder", w)
+          .field("runs", stats.runs)
+          .field("aborted", stats.aborted)
+          .field("turns", WindingHistory::turns(stats.turnsX100))
+          .field("minutes", stats.seconds / 60)
+          .beginArray("days");
+      // Newest first
+      for (uint8_t i = 0; i < WindingHistory::DAYS; i++) {
+        const WindingHistory::Day& day = stats.days[(stats.lastDay + WindingHistory::DAYS - i) % WindingHistory::DAYS];
+        if (day.dayStart == 0) continue;
+        char date[11];
+        time_t t = day.dayStart;
+        strftime(date, sizeof(date), "%Y-%m-%d", localtime(&t));
+        json.beginObject()
+            .field("date", date)
+            .field("runs", day.runs)
+            .field("aborted", day.aborted)
+            .field("turns", WindingHistory::turns(day.turnsX100))
+            .field("minutes", day.seconds / 60)
+            .endObject();
+      }
+      json.endArray().endObject();
+    }
+    json.endArray().endObject();
+  });
+}
+
+// ?after=<seq>&limit=<n>: one page, streamed; pass "next" as after for the next page
+void handleApiEvents(AsyncWebServerRequest* request) {
+  uint32_t after = request->hasParam("after") ? strtoul(request->getParam("after")->value().c_str(), nullptr, 10) : 0;
+  long limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : 50;
+  if (limit < 1) limit = 1;
+  if (limit > 200) limit = 200;
+  Serial.printf("[API] GET /api/events after=%u limit=%ld\n", (unsigned)after, limit);
+
+  std::shared_ptr<EventLog::Reader> reader = std::make_shared<EventLog::Reader>(after, (uint16_t)limit);
+  request->sendChunked("application/json", [reader](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+    return reader->read((char*)buffer, maxLen);
+  });
+}
+
+// Answers from the last background check; ?refresh=1 asks loop() for a
+// new one, whose result a later request picks up
+void handleApiCheckUpdate(AsyncWebServerRequest* request) {
+  if (request->hasParam("refresh") && request->getParam("refresh")->value() == "1") {
+    updateChecker.requestRefresh();
+  }
+  struct Snapshot {
+    UpdateChecker::Result result;
+    bool available;
+    unsigned long ageS;
+  } snap = {updateChecker.result(), updateChecker.updateAvailable(),
+            (millis() - updateChecker.result().checkedMs) / 1000};
+  sendJson(request, 200, snap, [](JsonStreamWriter& json, const Snapshot& s) {
+    json.beginObject()
+        .field("local_version", s.result.local)
+        .field("remote_version", s.result.remote)
+        .field("update_available", s.available);
+    if (s.result.checked) {
+      json.field("checked_age", s.ageS);
+    } else {
+      json.rawField("checked_age", "null");
+    }
+    json.field("checking", s.result.refreshing && !s.result.deferred)
+        .field("deferred", s.result.deferred)
+        .field("last_code", s.result.lastCode)
+        .endObject();
+  });
+}
+
+void handleApiDoUpdate(AsyncWebServerRequest* request) {
+  if (pendingDoUpdate) {
+    sendJson(request, 503, "{\"status\":\"error\",\"error\":\"Update already requested\"}");
+    return;
+  }
+  pendingDoUpdate = request;
+  request->onDisconnect([]() { pendingDoUpdate = nullptr; });
+}
+
+void finishDoUpdate() {
+  HeapScope heapScope(HeapTag::Ota);
+  // Fresh version first; unchanged since the last check it is a 304
+  if (!updateChecker.checkNow()) {
     Serial.println("[OTA] Failed to fetch remote version");
-    server.send(500, "application/json", "{\"status\":\"error\",\"error\":\"Failed to fetch remote version\"}");
-    remoteVersion = String();
+    eventLog.add(EventLog::Type::OtaFailed);
+    if (pendingDoUpdate) sendJson(pendingDoUpdate, 500, "{\"status\":\"error\",\"error\":\"Failed to fetch remote version\"}");
+    pendingDoUpdate = nullptr;
     return;
   }
   
-  Serial.printf("[OTA] Updating from local version to remote version: %s\n", remoteVersion.c_str());
-  remoteVersion = String();  // Free memory before OTA
+  char version[32];
+  strlcpy(version, updateChecker.result().remote, sizeof(version));
+  Serial.printf("[OTA] Updating from local version to remote version: %s\n", version);
+  eventLog.add(EventLog::Type::OtaStart);
   
   // Send response before starting OTA (connection will be lost during update)
-  server.send(200, "application/json", "{\"status\":\"starting\"}");
-  server.handleClient();
-  delay(500);
+  if (pendingDoUpdate) sendJson(pendingDoUpdate, 200, "{\"status\":\"starting\"}");
+  pendingDoUpdate = nullptr;
+  delay(500);  // lets the TCP stack flush the response
   
-  // Stop motor if running
-  if (stepper.isRunning()) {
-    Serial.println("[OTA] Stopping motor for OTA update...");
-    stepper.stop();
+  // Stop motors if running
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    if (!winders[w].stepper.isRunning()) continue;
+    Serial.printf("[OTA] Stopping motor %u for OTA update...\n", w);
+    winders[w].stepper.stop();
     delay(100);
   }
   
   // Stop web server to free resources
   Serial.println("[OTA] Stopping web server...");
-  server.stop();
+  server.end();
   delay(100);
   
-  // Close LittleFS to free resources
-  Serial.println("[OTA] Closing file system...");
-  LittleFS.end();
-  delay(100);
+  // The filesystem image replaces the logs; the settings are carried over
+  configStore.flush();
+  eventLog.flush();
   
   // Disable WiFi sleep for stable connection during OTA
   Serial.println("[OTA] Disabling WiFi sleep mode...");
@@ -494,156 +817,475 @@ void handleApiDoUpdate() {
   
   Serial.printf("[OTA] WiFi RSSI: %d dBm\n", WiFi.RSSI());
   
-  // Update firmware (this will reboot automatically on success)
-  Serial.println("[OTA] Starting firmware update...");
-  bool fwOk = OtaUpdate::updateFirmware(OTA_BIN_URL);
-  
-  // If firmware update succeeded, it would have rebooted. If we're here, it failed.
-  if (!fwOk) {
-    Serial.println("[OTA] Firmware update failed. Restarting web server...");
-    server.begin();
+  Serial.println("[OTA] Starting firmware and filesystem update...");
+  if (OtaUpdate::updateAll(version)) {
+    Serial.println("[OTA] Update complete, restarting...");
+    Serial.flush();
+    ESP.restart();
+    return;
   }
+  Serial.println("[OTA] Update failed. Restarting web server...");
+  eventLog.add(EventLog::Type::OtaFailed);
+  server.begin();
 }
 
-void setup() {
-  Serial.begin(115200);
-  Serial.println("[setup] Booting...");
-  Serial.println("[setup] Waiting 5 seconds after boot...");
-  delay(5000);
-
-  WiFiManager wifiManager;
-  wifiManager.setTimeout(180);
-  if (!wifiManager.autoConnect("WatchWinder-Setup")) {
-    Serial.println("[setup] Failed to connect and no config provided. Rebooting...");
-    delay(3000);
-    ESP.restart();
+// Parks a POST until loop() has saved its change. Callers answer 503 while
+// an earlier change to the same settings is still waiting.
+void parkForSave(AsyncWebServerRequest* request, PendingSave& save) {
+  save.requested = true;
+  save.request = request;
+  request->onDisconnect([&save, request]() {
+    if (save.request == request) save.request = nullptr;
+  });
+}
+
+// Answers the parked request, if its client is still there
+void finishSave(PendingSave& save, bool ok) {
+  if (save.request) {
+    sendJson(save.request, ok ? 200 : 500, ok ? "{\"status\":\"ok\"}" : "{\"status\":\"error\",\"error\":\"Failed to save\"}");
   }
+  save = {};
+}
+
+// Blocking work queued by the async handlers, run from loop()
+void processDeferredRequests() {
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    Winder& winder = winders[w];
+    if (winder.scheduleSave.requested) {
+      bool ok = configStore.flush();
+      if (ok) {
+        // checkSchedule() sees the new version and recomputes the next winding time
+        ScheduleConfig saved;
+        configStore.getSchedule(w, saved);
+        scheduleConfigs[w].replace(saved);
+        eventLog.add(EventLog::Type::ScheduleSaved, w);
+      } else {
+        configStore.setSchedule(w, scheduleConfigs[w]);
+      }
+      finishSave(winder.scheduleSave, ok);
+    }
+    if (winder.motorSave.requested) {
+      winder.stepper.setStepMode(configStore.motor(w).stepMode);
+      finishSave(winder.motorSave, configStore.flush());
+    }
+    if (winder.stopRequested) {
+      winder.stopRequested = false;
+      winder.stepper.stop();
+      winder.scheduledWindingInProgress = false;
+    }
 
-  Serial.print("[setup] Connected! IP address: ");
-  Serial.println(WiFi.localIP());
+    PendingWind& pendingWind = winder.pendingWind;
+    if (!pendingWind.requested) continue;
+    pendingWind.requested = false;
+    configStore.setManualDuration(w, pendingWind.duration);
+    recordFinishedRun(w, true);
+    if (pendingWind.alternate) {
+      winder.stepper.runAlternatingForDuration((float)pendingWind.duration, pendingWind.rpm, WINDING_REST_MS);
+    } else {
+      winder.stepper.runForDuration((float)pendingWind.duration, pendingWind.rpm, pendingWind.clockwise);
+    }
+    winder.manualWindingInProgress = true;
+    windingHistory.start(w, WindingHistory::Trigger::Manual, pendingWind.rpm, pendingWind.clockwise,
+                         pendingWind.alternate, winder.stepper.stepsPerRev());
+    eventLog.add(EventLog::Type::ManualStart, w, pendingWind.duration);
+  }
+  if (pendingDoUpdate) finishDoUpdate();
+}
 
-  NtfyClient ntfy(NTFY_TOPIC);
-  String msg = String("") + NTFY_MSG_STARTUP_PREFIX + WiFi.localIP().toString() + NTFY_MSG_STARTUP_SUFFIX + String("");
-  ntfy.send(msg);
+// POST handlers get the raw body, NUL-terminated and writable so it can be
+// parsed in place (nullptr when there is none). ESPAsyncWebServer delivers
+// bodies in chunks before the request callback, so collect them in the
+// request's _tempObject (freed with the request).
+void onJsonPost(const char* uri, void (*handler)(AsyncWebServerRequest*, char*)) {
+  server.on(uri, HTTP_POST,
+    [handler](AsyncWebServerRequest* request) {
+      if (request->contentLength() > MAX_POST_BODY) {
+        request->send(413, "text/plain", "Body too large");
+        return;
+      }
+      HeapScope heapScope(HeapTag::Http);
+      handler(request, (char*)request->_tempObject);
+    },
+    nullptr,
+    [](AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+      if (total > MAX_POST_BODY) return;
+      if (index == 0) request->_tempObject = calloc(total + 1, 1);
+      if (!request->_tempObject) return;
+      memcpy((uint8_t*)request->_tempObject + index, data, len);
+    });
+}
 
-  configTime(5.5 * 3600, 0, "pool.ntp.org", "time.nist.gov");  // IST is UTC+5:30
-  Serial.print("[setup] Waiting for NTP time sync (India/Kolkata)...");
-  time_t now = time(nullptr);
-  while (now < 1640995200) {
-    delay(500);
-    Serial.print(".");
-    now = time(nullptr);
+#if defined(WW_BENCH_COILS) && !defined(WINDER_SHIFT_REGISTER)
+// Cycles per step on winder 0's pins: the old four digitalWrite() calls
+// against one port write from the CoilOutput masks. The coils toggle far
+// too fast for the motor to move.
+void benchCoils() {
+  const int steps = 1000;
+  const int* pins = WINDER_PINS[0];
+  uint32_t start = ESP.getCycleCount();
+  for (int i = 0; i < steps; i++) {
+    for (int n = 0; n < 4; n++) digitalWrite(pins[n], (FullStepMode::kSequence[i & 3] >> n) & 1);
   }
-  Serial.println(" done.");
+  uint32_t oldCycles = ESP.getCycleCount() - start;
+  start = ESP.getCycleCount();
+  for (int i = 0; i < steps; i++) {
+    coilOutput.set(0, FullStepMode::kSequence[i & 3]);
+    coilOutput.commit();
+  }
+  uint32_t newCycles = ESP.getCycleCount() - start;
+  coilOutput.set(0, 0);
+  coilOutput.commit();
+  Serial.printf("[BENCH] Coil write: %u cycles/step with digitalWrite, %u with port masks\n",
+                (unsigned)(oldCycles / steps), (unsigned)(newCycles / steps));
+}
+#endif
 
-  if (!LittleFS.begin()) {
-    Serial.println("[setup] Failed to mount file system");
-    return;
+void setup() {
+  Serial.begin(115200);
+  Serial.println("[setup] Booting...");
+  heapMonitor.begin();
+  // Kept in RAM until the file system is mounted
+  eventLog.add(EventLog::Type::Boot, EventLog::NO_WINDER, ESP.getResetInfoPtr()->reason);
+  wifiGotIpHandler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP&) {
+    wifiUp = true;
+    eventLog.add(EventLog::Type::WifiConnected);
+    bootTimeline.mark(BootPhase::WifiConnected);
+  });
+  wifiDisconnectedHandler = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected& event) {
+    if (!wifiUp) return;
+    wifiUp = false;
+    eventLog.add(EventLog::Type::WifiDisconnected, EventLog::NO_WINDER, event.reason);
+  });
+
+  // Coil outputs first, so the motors stay off while the rest comes up
+#ifdef WINDER_SHIFT_REGISTER
+  coilOutput.beginShiftRegister(SHIFT_DATA, SHIFT_CLOCK, SHIFT_LATCH, WINDER_COUNT);
+#else
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    coilOutput.attachPins(w, WINDER_PINS[w][0], WINDER_PINS[w][1], WINDER_PINS[w][2], WINDER_PINS[w][3]);
   }
-  Serial.println("[setup] LittleFS mounted successfully");
-  
-  // Sync firmware version to file if different
-  String localVer = OtaUpdate::getLocalVersion();
-  if (localVer != FIRMWARE_VERSION) {
-    Serial.printf("[setup] Version mismatch! File: %s, Firmware: %s\n", localVer.c_str(), FIRMWARE_VERSION);
-    Serial.println("[setup] Updating version file...");
-    OtaUpdate::setLocalVersion(FIRMWARE_VERSION);
+#ifdef WW_BENCH_COILS
+  benchCoils();
+#endif
+#endif
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) stepScheduler.add(winders[w].stepper);
+
+  // Filesystem, settings and web server first; WiFi and the clock come up
+  // from loop() (pollNetwork(), SNTP). Until the clock is set, scheduled
+  // windings wait (TaskScheduler re-arms them on clockChanged()).
+  // Without a file system the network, API and motors still come up (on
+  // default settings, logs kept in RAM) so the device stays reachable, e.g.
+  // for an OTA update that brings the filesystem image back.
+  fsMounted = LittleFS.begin();
+  if (fsMounted) {
+    Serial.println("[setup] LittleFS mounted successfully");
+    bootTimeline.mark(BootPhase::FsMounted);
+    eventLog.begin();
+    windingHistory.begin();
+    staticAssets.load();
+
+    // Sync firmware version to file if different
+    String localVer = OtaUpdate::getLocalVersion();
+    if (localVer != FIRMWARE_VERSION) {
+      Serial.printf("[setup] Version mismatch! File: %s, Firmware: %s\n", localVer.c_str(), FIRMWARE_VERSION);
+      Serial.println("[setup] Updating version file...");
+      OtaUpdate::setLocalVersion(FIRMWARE_VERSION);
+    } else {
+      Serial.printf("[setup] Firmware version: %s\n", FIRMWARE_VERSION);
+    }
   } else {
-    Serial.printf("[setup] Firmware version: %s\n", FIRMWARE_VERSION);
+    Serial.println("[setup] Failed to mount file system, continuing without it");
   }
+  updateChecker.begin(FIRMWARE_VERSION);
   
+  configStore.setFsAvailable(fsMounted);
+  configStore.begin();
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    ScheduleConfig sched;
+    configStore.getSchedule(w, sched);
+    scheduleConfigs[w].replace(sched);
+    winders[w].scheduleIndex.build(scheduleConfigs[w]);
+    winders[w].scheduleVersionSeen = scheduleConfigs[w].version();
+    winders[w].stepper.setStepMode(configStore.motor(w).stepMode);
+  }
   loadNextWindingTime();
+  bootTimeline.mark(BootPhase::ConfigLoaded);
   
-  Dir dir = LittleFS.openDir("/");
-  while (dir.next()) {
-    Serial.print("  FILE: ");
-    Serial.print(dir.fileName());
-    Serial.print("  SIZE: ");
-    Serial.println(dir.fileSize());
+  // Step from the timer1 ISR so web/FS/TLS work in loop() can't cause jitter
+  stepScheduler.setTimerMode(true);
+  
+  // Periodic jobs; their cost shows up in the profiler's schedule section
+  taskScheduler.every(5000, logHeap);
+  taskScheduler.every(60000, minuteHousekeeping);
+  taskScheduler.every(LiveStatus::INTERVAL_MS, publishLiveStatus);
+  
+  if (fsMounted) {
+    Dir dir = LittleFS.openDir("/");
+    while (dir.next()) {
+      Serial.print("  FILE: ");
+      Serial.print(dir.fileName());
+      Serial.print("  SIZE: ");
+      Serial.println(dir.fileSize());
+    }
   }
   
-  server.on("/", handleRoot);
-  server.on("/index.html", handleRoot);
-  server.on("/setschedule.html", handleSetSchedule);
-  server.on("/windnow.html", handleWindNow);
-  server.on("/troubleshooting.html", handleTroubleshooting);
+  server.on("/", HTTP_GET, handleRoot);
+  server.on("/index.html", HTTP_GET, handleRoot);
+  server.on("/setschedule.html", HTTP_GET, handleSetSchedule);
+  server.on("/windnow.html", HTTP_GET, handleWindNow);
+  server.on("/troubleshooting.html", HTTP_GET, handleTroubleshooting);
   
+  // A route also matches "<uri>/...", so register longer URIs first
   server.on("/api/home", HTTP_GET, handleApiHome);
   server.on("/api/schedule", HTTP_GET, handleApiScheduleGet);
-  server.on("/api/schedule", HTTP_POST, handleApiSchedulePost);
-  server.on("/api/windnow", HTTP_POST, handleApiWindNow);
+  onJsonPost("/api/schedule", handleApiSchedulePost);
+  onJsonPost("/api/windnow", handleApiWindNow);
+  server.on("/api/motor/stats/reset", HTTP_POST, handleApiMotorStatsReset);
+  server.on("/api/motor/stats", HTTP_GET, handleApiMotorStats);
   server.on("/api/motor", HTTP_GET, handleApiMotorGet);
-  server.on("/api/motor", HTTP_POST, handleApiMotorPost);
+  onJsonPost("/api/motor", handleApiMotorPost);
+  server.on("/api/config/export", HTTP_GET, handleApiConfigExport);
   server.on("/api/config", HTTP_GET, handleApiConfig);
   server.on("/api/system/memory", HTTP_GET, handleApiMemory);
   server.on("/api/system/uptime", HTTP_GET, handleApiUptime);
+  server.on("/api/system/network", HTTP_GET, handleApiNetwork);
+#ifndef WW_DISABLE_PROFILER
+  server.on("/api/system/profile", HTTP_GET, handleApiProfile);
+#endif
   server.on("/api/events", HTTP_GET, handleApiEvents);
+  server.on("/api/history/stats", HTTP_GET, handleApiHistoryStats);
+  server.on("/api/history", HTTP_GET, handleApiHistory);
   server.on("/api/check_update", HTTP_GET, handleApiCheckUpdate);
   server.on("/api/do_update", HTTP_POST, handleApiDoUpdate);
   server.on("/api/stop", HTTP_POST, handleApiStop);
+
+  // Per-winder routes; the un-indexed ones above address winder 0
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    String base = String(MOTORS_PREFIX) + w;
+    server.on((base + "/stats/reset").c_str(), HTTP_POST, handleApiMotorStatsReset);
+    server.on((base + "/stats").c_str(), HTTP_GET, handleApiMotorStats);
+    server.on((base + "/schedule").c_str(), HTTP_GET, handleApiScheduleGet);
+    onJsonPost((base + "/schedule").c_str(), handleApiSchedulePost);
+    onJsonPost((base + "/windnow").c_str(), handleApiWindNow);
+    server.on((base + "/stop").c_str(), HTTP_POST, handleApiStop);
+    server.on(base.c_str(), HTTP_GET, handleApiMotorGet);
+    onJsonPost(base.c_str(), handleApiMotorPost);
+  }
+  server.on("/api/motors", HTTP_GET, handleApiMotors);
+
+  // Live status stream; a new client gets every field in the next update
+  liveEvents.onConnect([](AsyncEventSourceClient* client) { liveStatus.reset(); });
+  server.addHandler(&liveEvents);
   
-  server.on("/css/styles.css", handleStaticFile);
+  server.on("/css/styles.css", HTTP_GET, handleStaticFile);
   server.onNotFound(handleStaticFile);
   
   server.begin();
   Serial.println("[setup] HTTP server started");
+  bootTimeline.mark(BootPhase::ServerStarted);
+
+  // Wall-clock wakeups (scheduled windings) follow NTP steps
+  hal::onClockSet([]() {
+    static bool logged = false;  // SNTP re-syncs are routine
+    if (!logged) eventLog.add(EventLog::Type::ClockSet);
+    logged = true;
+    bootTimeline.mark(BootPhase::ClockSet);
+    taskScheduler.clockChanged();
+  });
+  configTime(5.5 * 3600, 0, "pool.ntp.org", "time.nist.gov");  // IST is UTC+5:30, syncs once WiFi is up
+
+  if (wifiHasCredentials()) wifiBegin();
+  netState = NetState::Connecting;
+  netStateMs = millis();
 }
 
-void loop() {
-  server.handleClient();
-  stepper.update();
-  
-  unsigned long nowMillis = millis();
-  time_t nowEpoch = time(nullptr);
-  unsigned long checkInterval = SCHEDULE_CHECK_INTERVAL;
-  if (nextWindingEpoch > 0 && nowEpoch < nextWindingEpoch) {
-    unsigned long diff = (unsigned long)(nextWindingEpoch - nowEpoch) * 1000UL;
-    if (diff < SCHEDULE_CHECK_INTERVAL) checkInterval = diff;
-  }
-  if (nowMillis - lastScheduleCheck > checkInterval) {
-    lastScheduleCheck = nowMillis;
-    if (nextWindingEpoch > 0 && nowEpoch >= nextWindingEpoch && !scheduledWindingInProgress) {
-      // Calculate and update next winding time BEFORE starting
-      Serial.println("[SCHEDULE] Calculating next winding time before starting...");
-      updateNextWindingTime();
-      
-      int duration;
-      String speed;
-      getWindingParams(duration, speed);
-      speed = "Fast";  // Hardcoded to Fast for scheduled winding
-      float rpm = StepperMotorDriver::speedStringToRPM(speed);
-      Serial.printf("[SCHEDULE] Starting scheduled winding: %d min, %s (%.1f RPM)\n", duration, speed.c_str(), rpm);
-      stepper.runForDuration((float)duration, rpm, true);
-      scheduledWindingInProgress = true;
+void enterNetState(NetState state) {
+  netState = state;
+  netStateMs = millis();
+}
+
+void onNetworkUp() {
+  Serial.printf("[WiFi] Connected! IP address: %s\n", WiFi.localIP().toString().c_str());
+  ntfy.sendf(NTFY_MSG_STARTUP_PREFIX "%s" NTFY_MSG_STARTUP_SUFFIX, WiFi.localIP().toString().c_str());
+  enterNetState(NetState::Online);
+}
+
+// Once online, the SDK reconnects by itself
+void pollNetwork() {
+  switch (netState) {
+  case NetState::Off:
+  case NetState::Online:
+    return;
+
+  case NetState::Connecting:
+    if (WiFi.status() == WL_CONNECTED) {
+      onNetworkUp();
+    } else if (!wifiHasCredentials() || millis() - netStateMs > WIFI_PORTAL_AFTER_MS) {
+      Serial.println("[WiFi] Not connected, opening the setup portal");
+      server.end();  // the portal serves on port 80
+      wifiPortalStart("WatchWinder-Setup", WIFI_PORTAL_TIMEOUT_S);
+      enterNetState(NetState::Portal);
+    }
+    return;
+
+  case NetState::Portal:
+    // Done when credentials were saved, it timed out, or the saved network came back
+    if (wifiPortalProcess() && WiFi.status() != WL_CONNECTED) return;
+    wifiPortalStop();
+    server.begin();
+    if (WiFi.status() == WL_CONNECTED) {
+      onNetworkUp();
+    } else {
+      Serial.println("[WiFi] Setup portal closed, retrying the saved network");
+      wifiBegin();
+      enterNetState(NetState::Connecting);
     }
+    return;
   }
-  if (scheduledWindingInProgress && !stepper.isRunning()) {
-    Serial.println("[SCHEDULE] Scheduled winding finished.");
-    scheduledWindingInProgress = false;
-    saveLastWindingTime();
+}
+
+// Start every winder whose scheduled time has come, then re-arm for the next
+void startScheduledWindings() {
+  windingTask = TaskScheduler::NONE;
+  time_t now = time(nullptr);
+  bool busy = false;
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    Winder& winder = winders[w];
+    if (winder.nextWindingEpoch == 0 || winder.nextWindingEpoch > now) continue;
+    if (winder.scheduledWindingInProgress) {
+      // Previous scheduled run still going; start as soon as it ends
+      busy = true;
+      continue;
+    }
+    
+    // Calculate and update next winding time BEFORE starting
+    Serial.printf("[SCHEDULE] Winder %u: calculating next winding time before starting...\n", w);
+    updateNextWindingTime(w);
+    
+    int duration;
+    String speed;
+    getWindingParams(w, duration, speed);
+    speed = "Fast";  // Hardcoded to Fast for scheduled winding
+    float rpm = StepperMotorDriver::speedStringToRPM(speed.c_str());
+    Serial.printf("[SCHEDULE] Winder %u: starting scheduled winding: %d min, %s (%.1f RPM)\n", w, duration, speed.c_str(), rpm);
+    recordFinishedRun(w, true);
+    winder.stepper.runForDuration((float)duration, rpm, true);
+    winder.scheduledWindingInProgress = true;
+    windingHistory.start(w, WindingHistory::Trigger::Scheduled, rpm, true, false, winder.stepper.stepsPerRev());
+    eventLog.add(EventLog::Type::ScheduledStart, w, duration);
   }
-  
-  if (manualWindingInProgress && !stepper.isRunning()) {
-    Serial.println("[MANUAL] Manual winding finished.");
-    manualWindingInProgress = false;
-    saveLastWindingTime();
+  if (busy) {
+    taskScheduler.cancel(windingTask);
+    windingTask = taskScheduler.after(1000, startScheduledWindings);
+  } else {
+    armNextWinding();
+  }
+}
+
+// Adds winder w's run to the history once it has ended, or right away
+// when a new run replaces it
+void recordFinishedRun(uint8_t w, bool superseded) {
+  if (!windingHistory.running(w)) return;
+  const StepperMotorDriver& stepper = winders[w].stepper;
+  if (stepper.isRunning() && !superseded) return;
+  windingHistory.finish(w, stepper.stepsDone(), stepper.isRunning() || stepper.stoppedEarly());
+}
+
+// Record finished runs, and follow schedule changes
+void checkSchedule() {
+  bool rearm = false;
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    Winder& winder = winders[w];
+    recordFinishedRun(w);
+    // The next winding needs the date; a change before the clock is set waits for it
+    if (scheduleConfigs[w].version() != winder.scheduleVersionSeen && time(nullptr) >= CLOCK_VALID_AFTER) {
+      winder.scheduleVersionSeen = scheduleConfigs[w].version();
+      winder.scheduleIndex.build(scheduleConfigs[w]);
+      updateNextWindingTime(w);
+      rearm = true;
+    }
+    
+    if (winder.scheduledWindingInProgress && !winder.stepper.isRunning()) {
+      Serial.printf("[SCHEDULE] Winder %u: scheduled winding finished.\n", w);
+      winder.scheduledWindingInProgress = false;
+      saveLastWindingTime(w);
+    }
+    
+    if (winder.manualWindingInProgress && !winder.stepper.isRunning()) {
+      Serial.printf("[MANUAL] Winder %u: manual winding finished.\n", w);
+      winder.manualWindingInProgress = false;
+      saveLastWindingTime(w);
+    }
   }
+  if (rearm) armNextWinding();
+}
+
+void logHeap() {
+  HeapMonitor::Heap heap = heapMonitor.sample();
+  Serial.printf("[loop] Running... Free heap: %u, max block: %u, fragmentation: %u%%\n", heap.free, heap.maxBlock,
+                heap.fragmentation);
+}
+
+// Pushes what changed since the last update to /api/live clients
+void publishLiveStatus() {
+  if (liveEvents.count() == 0) return;
+  HeapScope heapScope(HeapTag::Live);
+  LiveStatus::Snapshot snap = {};
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) {
+    const StepperMotorDriver& stepper = winders[w].stepper;
+    snap.motors[w] = {stepper.isRunning(), stepper.totalSteps(), stepper.stepsLeft(), stepper.secondsLeft()};
+  }
+  time_t last, next;
+  windingTimes(last, next);
+  snap.lastWinding = (uint32_t)last;
+  snap.nextWinding = (uint32_t)next;
+  snap.freeHeap = ESP.getFreeHeap();
   
-  yield();
+  static char buf[LiveStatus::MAX_LEN];
+  if (liveStatus.delta(snap, buf, sizeof(buf))) liveEvents.send(buf, "status");
+}
+
+void minuteHousekeeping() {
+  ESP.wdtFeed();  // Feed watchdog
+#ifndef WW_DISABLE_PROFILER
+  loopProfiler.dump();
+#endif
+}
+
+void loop() {
+  PROFILE_LOOP();
+  {
+    PROFILE_SECTION(ProfSection::HttpServer);
+    processDeferredRequests();
+  }
+  {
+    PROFILE_SECTION(ProfSection::Stepper);
+    stepScheduler.poll();
+  }
   
-  // Periodic heap monitoring and garbage collection
-  static unsigned long lastPrint = 0;
-  static unsigned long lastGC = 0;
-  unsigned long now = millis();
+  {
+    PROFILE_SECTION(ProfSection::Schedule);
+    taskScheduler.run();
+    checkSchedule();
+  }
   
-  if (now - lastPrint > 5000) {
-    Serial.printf("[loop] Running... Free heap: %u\n", ESP.getFreeHeap());
-    lastPrint = now;
+  {
+    PROFILE_SECTION(ProfSection::Notify);
+    pollNetwork();
+    ntfy.poll();
+    hal::httpPoll();
   }
   
-  // Force periodic WiFi stack cleanup every 60 seconds
-  if (now - lastGC > 60000) {
-    ESP.wdtFeed();  // Feed watchdog
-    lastGC = now;
+  {
+    PROFILE_SECTION(ProfSection::Yield);
+    yield();
   }
-}
\ No newline at end of file
+  
+  PROFILE_SECTION(ProfSection::Housekeeping);
+  configStore.poll();
+  eventLog.poll();
+  // The version check blocks on TLS; hold it off while a motor runs
+  bool motorRunning = false;
+  for (uint8_t w = 0; w < WINDER_COUNT; w++) motorRunning |= winders[w].stepper.isRunning();
+  updateChecker.poll(!motorRunning);
+}
@@ -0,0 +1,16 @@
+#ifdef HAL_NATIVE
+
+#include "Arduino.h"
+#include <stdarg.h>
+
+HardwareSerial Serial;
+
+int HardwareSerial::printf(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vprintf(fmt, args);
+    va_end(args);
+    return n;
+}
+
+#endif // HAL_NATIVE
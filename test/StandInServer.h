@@ -0,0 +1,236 @@
+// Local HTTP/1.1 stand-in server for the native tests, on its own threads,
+// which are left out of the fake heap's accounting.
+// GET serves files with Range support; POST answers with a queued status
+// (200 once the queue is empty). Connections are kept alive unless a
+// reply says otherwise. A GET path with a drop offset closes the
+// connection once that byte is reached, `times` times (-1 = always).
+#ifndef STAND_IN_SERVER_H
+#define STAND_IN_SERVER_H
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "HalNative.h"
+
+class StandInServer {
+public:
+    struct Request {
+        int connection;     // accepted connections so far, from 1
+        std::string method;
+        std::string path;
+        size_t from;        // Range start, 0 without one
+        std::string body;
+    };
+
+    struct Reply {
+        int code;
+        bool close;         // Connection: close
+    };
+
+    void start() {
+        _listen = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(_listen, (sockaddr*)&addr, sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(_listen, (sockaddr*)&addr, &len);
+        _port = ntohs(addr.sin_port);
+        listen(_listen, 4);
+        _thread = std::thread([this] {
+            hal::native::heapIgnoreThread();
+            run();
+        });
+    }
+
+    void stop() {
+        shutdown(_listen, SHUT_RDWR);
+        close(_listen);
+        _thread.join();
+        closeConnections();
+    }
+
+    // Closes every open connection, as a server dropping idle clients does
+    void closeConnections() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int fd : _open) shutdown(fd, SHUT_RDWR);
+    }
+    int openConnections() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return (int)_open.size();
+    }
+
+    uint16_t port() const { return _port; }
+    std::string url(const char* path) const { return "http://127.0.0.1:" + std::to_string(_port) + path; }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _files.clear();
+        _drops.clear();
+        _replies.clear();
+        _log.clear();
+    }
+    void put(const std::string& path, const std::string& body) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _files[path] = body;
+    }
+    void drop(const std::string& path, size_t at, int times) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _drops[path] = {at, times};
+    }
+    // Answer for the next POST
+    void queueReply(int code, bool close = false) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _replies.push_back({code, close});
+    }
+    std::vector<Request> log() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _log;
+    }
+    // Requests for path starting at byte `from`
+    int count(const std::string& path, size_t from = 0) {
+        int n = 0;
+        for (const Request& r : log()) n += r.path == path && r.from == from;
+        return n;
+    }
+
+private:
+    struct Drop {
+        size_t at;
+        int times;
+    };
+
+    // A thread per connection, so a client that keeps one open idle does
+    // not hold up the next
+    void run() {
+        int fd;
+        int connection = 0;
+        while ((fd = accept(_listen, nullptr, nullptr)) >= 0) {
+            connection++;
+            // Head and body go out in separate sends; without this Nagle
+            // holds the body for the client's delayed ACK
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _open.push_back(fd);
+            }
+            std::thread([this, fd, connection] {
+                hal::native::heapIgnoreThread();
+                std::string in;
+                while (serve(fd, connection, in)) {}
+                std::lock_guard<std::mutex> lock(_mutex);
+                _open.erase(std::find(_open.begin(), _open.end(), fd));
+                close(fd);
+            }).detach();
+        }
+    }
+
+    // One request; false to close the connection
+    bool serve(int fd, int connection, std::string& in) {
+        char buf[1024];
+        size_t end;
+        while ((end = in.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) return false;
+            in.append(buf, n);
+        }
+        std::string head = in.substr(0, end + 2);
+        in.erase(0, end + 4);
+        Request req = {connection, head.substr(0, head.find(' ')), "", 0, ""};
+        size_t sp = head.find(' ');
+        req.path = head.substr(sp + 1, head.find(' ', sp + 1) - sp - 1);
+        size_t range = head.find("Range: bytes=");
+        if (range != std::string::npos) req.from = strtoul(head.c_str() + range + 13, nullptr, 10);
+        size_t lenPos = head.find("Content-Length: ");
+        size_t bodyLen = lenPos == std::string::npos ? 0 : strtoul(head.c_str() + lenPos + 16, nullptr, 10);
+        while (in.size() < bodyLen) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) return false;
+            in.append(buf, n);
+        }
+        req.body = in.substr(0, bodyLen);
+        in.erase(0, bodyLen);
+
+        std::string body;
+        bool found = false;
+        Drop drop = {0, 0};
+        Reply reply = {200, false};
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _log.push_back(req);
+            if (req.method == "POST") {
+                found = true;
+                if (!_replies.empty()) {
+                    reply = _replies.front();
+                    _replies.pop_front();
+                }
+            } else if (_files.count(req.path)) {
+                found = true;
+                body = _files[req.path];
+                auto d = _drops.find(req.path);
+                if (d != _drops.end() && d->second.times != 0 && d->second.at >= req.from) {
+                    drop = d->second;
+                    if (d->second.times > 0) d->second.times--;
+                }
+            }
+        }
+
+        char out[256];
+        if (!found) {
+            snprintf(out, sizeof(out), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+            return sendAll(fd, out, strlen(out));
+        }
+        if (req.method == "POST") {
+            snprintf(out, sizeof(out), "HTTP/1.1 %d Reply\r\nContent-Length: 2\r\n%s\r\nok", reply.code,
+                     reply.close ? "Connection: close\r\n" : "");
+            return sendAll(fd, out, strlen(out)) && !reply.close;
+        }
+        size_t from = req.from;
+        if (from > 0) {
+            snprintf(out, sizeof(out),
+                     "HTTP/1.1 206 Partial Content\r\nContent-Length: %zu\r\nContent-Range: bytes %zu-%zu/%zu\r\n\r\n",
+                     body.size() - from, from, body.size() - 1, body.size());
+        } else {
+            snprintf(out, sizeof(out), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", body.size());
+        }
+        size_t stop = drop.times ? drop.at : body.size();
+        if (!sendAll(fd, out, strlen(out)) || !sendAll(fd, body.data() + from, stop - from)) return false;
+        return stop == body.size();
+    }
+
+    static bool sendAll(int fd, const char* data, size_t len) {
+        while (len > 0) {
+            ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    int _listen = -1;
+    uint16_t _port = 0;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::map<std::string, std::string> _files;
+    std::map<std::string, Drop> _drops;
+    std::deque<Reply> _replies;
+    std::vector<Request> _log;
+    std::vector<int> _open;
+};
+
+#endif // STAND_IN_SERVER_H
@@ -0,0 +1,90 @@
+// BootTimeline: each phase recorded once at the fake clock's ms, and Ready
+// (with its boot_ready event) once server, WiFi and clock are all up,
+// whatever order they come in
+#include <unity.h>
+#include "HalNative.h"
+#include "BootTimeline.h"
+#include "EventLog.h"
+
+using namespace hal::native;
+
+static int readyEvents() {
+    eventLog.flush();
+    EventLog::Entry entries[EventLog::RAM_SLOTS];
+    size_t n = eventLog.readAfter(0, entries, EventLog::RAM_SLOTS);
+    int ready = 0;
+    for (size_t i = 0; i < n; i++) ready += entries[i].type == EventLog::Type::BootReady;
+    return ready;
+}
+
+void setUp(void) {
+    reset();
+    eventLog = EventLog();
+    eventLog.begin();
+}
+
+void tearDown(void) {}
+
+void test_phases_are_recorded_once(void) {
+    BootTimeline boot;
+    TEST_ASSERT_FALSE(boot.reached(BootPhase::FsMounted));
+    advanceMicros(120 * 1000UL);
+    boot.mark(BootPhase::FsMounted);
+    advanceMicros(80 * 1000UL);
+    boot.mark(BootPhase::FsMounted);  // a later remount does not move it
+    boot.mark(BootPhase::ConfigLoaded);
+    TEST_ASSERT_TRUE(boot.reached(BootPhase::FsMounted));
+    TEST_ASSERT_EQUAL_UINT32(120, boot.at(BootPhase::FsMounted));
+    TEST_ASSERT_EQUAL_UINT32(200, boot.at(BootPhase::ConfigLoaded));
+    TEST_ASSERT_FALSE(boot.reached(BootPhase::FirstRequest));
+}
+
+// The server answers long before WiFi and the clock: the first request
+// can come from the setup portal or a cached client
+void test_server_and_first_request_before_network(void) {
+    BootTimeline boot;
+    advanceMicros(300 * 1000UL);
+    boot.mark(BootPhase::ServerStarted);
+    advanceMicros(50 * 1000UL);
+    boot.mark(BootPhase::FirstRequest);
+    advanceMicros(50 * 1000UL);
+    boot.mark(BootPhase::FirstRequest);
+    TEST_ASSERT_EQUAL_UINT32(350, boot.at(BootPhase::FirstRequest));
+    TEST_ASSERT_FALSE(boot.reached(BootPhase::Ready));
+}
+
+void test_ready_once_server_wifi_and_clock_are_up(void) {
+    BootTimeline boot;
+    boot.mark(BootPhase::ServerStarted);
+    advanceMicros(4000 * 1000UL);
+    boot.mark(BootPhase::ClockSet);  // the order they come in does not matter
+    TEST_ASSERT_FALSE(boot.reached(BootPhase::Ready));
+    advanceMicros(1500 * 1000UL);
+    boot.mark(BootPhase::WifiConnected);
+    TEST_ASSERT_TRUE(boot.reached(BootPhase::Ready));
+    TEST_ASSERT_EQUAL_UINT32(5500, boot.at(BootPhase::Ready));
+    TEST_ASSERT_EQUAL(1, readyEvents());
+
+    // A reconnect later on changes nothing
+    advanceMicros(60000 * 1000UL);
+    boot.mark(BootPhase::WifiConnected);
+    boot.mark(BootPhase::ClockSet);
+    TEST_ASSERT_EQUAL_UINT32(5500, boot.at(BootPhase::Ready));
+    TEST_ASSERT_EQUAL(1, readyEvents());
+}
+
+void test_phase_names(void) {
+    TEST_ASSERT_EQUAL_STRING("fs_mounted", BootTimeline::phaseName(BootPhase::FsMounted));
+    TEST_ASSERT_EQUAL_STRING("first_request", BootTimeline::phaseName(BootPhase::FirstRequest));
+    TEST_ASSERT_EQUAL_STRING("ready", BootTimeline::phaseName(BootPhase::Ready));
+    TEST_ASSERT_EQUAL_STRING("?", BootTimeline::phaseName(BootPhase::Count));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_phases_are_recorded_once);
+    RUN_TEST(test_server_and_first_request_before_network);
+    RUN_TEST(test_ready_once_server_wifi_and_clock_are_up);
+    RUN_TEST(test_phase_names);
+    return UNITY_END();
+}
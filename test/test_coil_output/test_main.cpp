@@ -0,0 +1,77 @@
+// CoilOutput: one port write per step from the precomputed masks, against
+// the previous four digitalWrite() calls through the step sequence table.
+// Only the write counts are checked here: a fake pin write costs next to
+// nothing, so host timings say nothing about the device. -DWW_BENCH_COILS
+// measures cycles per step on the device.
+#include <unity.h>
+#include "HalNative.h"
+#include "CoilOutput.h"
+#include "StepModes.h"
+
+using namespace hal::native;
+
+static const int PINS[4] = {5, 4, 14, 12};
+static const uint32_t COIL_MASK = (1UL << 5) | (1UL << 4) | (1UL << 14) | (1UL << 12);
+static const int STEPS = 200000;
+
+static CoilOutput coils;
+
+// The old stepMotor(): one write per coil, read through the table each time
+static void stepOld(uint8_t phase) {
+    for (int n = 0; n < 4; n++) hal::gpioWrite(PINS[n], (FullStepMode::kSequence[phase] >> n) & 1);
+}
+
+static void stepNew(uint8_t phase) {
+    coils.set(0, FullStepMode::kSequence[phase]);
+    coils.commit();
+}
+
+template <typename Step>
+static unsigned long writesPerStep(Step step) {
+    unsigned long before = gpioPortWrites();
+    for (int i = 0; i < STEPS; i++) step(i & (FullStepMode::kPhases - 1));
+    return (gpioPortWrites() - before) / STEPS;
+}
+
+void setUp(void) {
+    reset();
+    coils = CoilOutput();
+    coils.attachPins(0, PINS[0], PINS[1], PINS[2], PINS[3]);
+}
+
+void tearDown(void) {}
+
+void test_each_phase_is_one_port_write(void) {
+    for (uint8_t phase = 0; phase < FullStepMode::kPhases; phase++) {
+        unsigned long before = gpioPortWrites();
+        stepNew(phase);
+        TEST_ASSERT_EQUAL_UINT32(1, gpioPortWrites() - before);
+        for (int n = 0; n < 4; n++) TEST_ASSERT_EQUAL((FullStepMode::kSequence[phase] >> n) & 1, gpioPin(PINS[n]));
+    }
+    coils.set(0, 0);
+    coils.commit();
+    TEST_ASSERT_EQUAL_UINT32(0, gpioPort() & COIL_MASK);
+}
+
+// GPIO16 is outside the port register and is written on its own
+void test_gpio16_falls_back_to_a_pin_write(void) {
+    coils.attachPins(0, 5, 4, 14, 16);
+    coils.set(0, 0b1001);
+    coils.commit();
+    TEST_ASSERT_TRUE(gpioPin(5));
+    TEST_ASSERT_TRUE(gpioPin(16));
+    TEST_ASSERT_FALSE(gpioPin(4));
+}
+
+void test_port_writes_per_step(void) {
+    TEST_ASSERT_EQUAL_UINT32(4, writesPerStep(stepOld));
+    TEST_ASSERT_EQUAL_UINT32(1, writesPerStep(stepNew));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_each_phase_is_one_port_write);
+    RUN_TEST(test_gpio16_falls_back_to_a_pin_write);
+    RUN_TEST(test_port_writes_per_step);
+    return UNITY_END();
+}
@@ -0,0 +1,154 @@
+// ConfigStore: binary record on the fake filesystem, reload, coalesced
+// writes, CRC checks and the format 1 upgrade
+#include <unity.h>
+#include "HalNative.h"
+#include "ConfigStore.h"
+
+using namespace hal::native;
+
+static std::string& file(const char* path) {
+    return files()[path];
+}
+
+void setUp(void) {
+    reset();
+}
+
+void tearDown(void) {}
+
+void test_crc32_check_value(void) {
+    TEST_ASSERT_EQUAL_UINT32(0xCBF43926, ConfigStore::crc32((const uint8_t*)"123456789", 9));
+}
+
+void test_missing_file_starts_from_defaults(void) {
+    ConfigStore store;
+    TEST_ASSERT_FALSE(store.begin());
+    TEST_ASSERT_EQUAL(1, (int)files().count(ConfigStore::PATH));
+    TEST_ASSERT_EQUAL(0, (int)files().count(ConfigStore::TMP_PATH));
+    TEST_ASSERT_FALSE(store.dirty());
+    TEST_ASSERT_EQUAL(30, store.manualDuration(0));
+    TEST_ASSERT_TRUE(store.motor(0).stepMode == StepMode::Full);
+    TEST_ASSERT_EQUAL(0, (long)store.lastWinding(0));
+}
+
+void test_settings_survive_reload(void) {
+    ConfigStore store;
+    store.begin();
+    ScheduleConfig sched;
+    sched.durationMin = 45;
+    strlcpy(sched.speed, "Fast", sizeof(sched.speed));
+    sched.times[0] = {7, 30, false, true};
+    sched.times[1] = {9, 15, true, false};
+    sched.timeCount = 2;
+    sched.dayMask = 0x3E;
+    store.setSchedule(WINDER_COUNT - 1, sched);
+    store.setMotor(0, {StepMode::Half, 80, 1200});
+    store.setLastWinding(0, 1700000000);
+    TEST_ASSERT_TRUE(store.flush());
+
+    ConfigStore reloaded;
+    TEST_ASSERT_TRUE(reloaded.begin());
+    ScheduleConfig got;
+    reloaded.getSchedule(WINDER_COUNT - 1, got);
+    TEST_ASSERT_EQUAL(45, got.durationMin);
+    TEST_ASSERT_EQUAL_STRING("Fast", got.speed);
+    TEST_ASSERT_EQUAL(2, got.timeCount);
+    TEST_ASSERT_EQUAL(0x3E, got.dayMask);
+    TEST_ASSERT_EQUAL(15, got.times[1].minute);
+    TEST_ASSERT_TRUE(got.times[1].pm);
+    TEST_ASSERT_FALSE(got.times[1].enabled);
+    TEST_ASSERT_TRUE(reloaded.motor(0).stepMode == StepMode::Half);
+    TEST_ASSERT_EQUAL(80, reloaded.motor(0).dutyCycle);
+    TEST_ASSERT_EQUAL(1200, reloaded.motor(0).pulseWidth);
+    TEST_ASSERT_EQUAL(1700000000L, (long)reloaded.lastWinding(0));
+}
+
+// Runtime state is written once it has been unchanged for COALESCE_MS
+void test_runtime_changes_are_coalesced(void) {
+    ConfigStore store;
+    store.begin();
+    uint32_t writes = store.writes();
+    store.setLastWinding(0, 1700000000);
+    advanceMicros(1000000);
+    store.setNextWinding(0, 1700086400);
+    store.setManualDuration(0, 12);
+    store.poll();
+    TEST_ASSERT_EQUAL_UINT32(writes, store.writes());
+    TEST_ASSERT_TRUE(store.dirty());
+    advanceMicros(ConfigStore::COALESCE_MS * 1000UL);
+    store.poll();
+    TEST_ASSERT_EQUAL_UINT32(writes + 1, store.writes());
+    TEST_ASSERT_FALSE(store.dirty());
+    // Setting the same value again is not a change
+    store.setManualDuration(0, 12);
+    TEST_ASSERT_FALSE(store.dirty());
+}
+
+// Without a filesystem the changes stay in RAM and nothing is retried
+// until it is back; then the next poll writes them
+void test_no_filesystem_defers_writes(void) {
+    ConfigStore store;
+    store.setFsAvailable(false);
+    TEST_ASSERT_FALSE(store.begin());
+    TEST_ASSERT_EQUAL(0, (int)files().count(ConfigStore::PATH));
+    store.setManualDuration(0, 12);
+    for (int i = 0; i < 10; i++) {
+        advanceMicros(ConfigStore::COALESCE_MS * 1000UL);
+        store.poll();
+    }
+    TEST_ASSERT_FALSE(store.flush());
+    TEST_ASSERT_EQUAL_UINT32(0, store.writes());
+    TEST_ASSERT_TRUE(store.dirty());
+    TEST_ASSERT_EQUAL(0, (int)files().size());
+
+    store.setFsAvailable(true);
+    store.poll();
+    TEST_ASSERT_EQUAL_UINT32(1, store.writes());
+    TEST_ASSERT_FALSE(store.dirty());
+    ConfigStore reloaded;
+    TEST_ASSERT_TRUE(reloaded.begin());
+    TEST_ASSERT_EQUAL(12, reloaded.manualDuration(0));
+}
+
+void test_corrupt_record_is_rejected(void) {
+    ConfigStore store;
+    store.begin();
+    store.setManualDuration(0, 99);
+    store.flush();
+    file(ConfigStore::PATH)[20] ^= 0x01;
+
+    ConfigStore reloaded;
+    TEST_ASSERT_FALSE(reloaded.begin());
+    TEST_ASSERT_EQUAL(30, reloaded.manualDuration(0));
+    // and the defaults were written back as a valid record
+    ConfigStore again;
+    TEST_ASSERT_TRUE(again.begin());
+}
+
+// A single-winder record (format 1) loads into winder 0 and is rewritten
+void test_format1_record_is_upgraded(void) {
+    uint8_t winder[48] = {};
+    uint32_t last = 1690000000;
+    memcpy(winder, &last, 4);
+    winder[10] = 17;  // manualDurationMin
+    uint32_t header[4] = {ConfigStore::MAGIC, 1 | (48u << 16), 7, ConfigStore::crc32(winder, sizeof(winder))};
+    file(ConfigStore::PATH) = std::string((const char*)header, sizeof(header)) + std::string((const char*)winder, sizeof(winder));
+
+    ConfigStore store;
+    TEST_ASSERT_TRUE(store.begin());
+    TEST_ASSERT_EQUAL(1690000000L, (long)store.lastWinding(0));
+    TEST_ASSERT_EQUAL(17, store.manualDuration(0));
+    TEST_ASSERT_GREATER_THAN(sizeof(header) + sizeof(winder), file(ConfigStore::PATH).size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_crc32_check_value);
+    RUN_TEST(test_missing_file_starts_from_defaults);
+    RUN_TEST(test_settings_survive_reload);
+    RUN_TEST(test_runtime_changes_are_coalesced);
+    RUN_TEST(test_no_filesystem_defers_writes);
+    RUN_TEST(test_corrupt_record_is_rejected);
+    RUN_TEST(test_format1_record_is_upgraded);
+    return UNITY_END();
+}
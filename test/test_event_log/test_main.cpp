@@ -0,0 +1,168 @@
+// EventLog: RAM ring, batched appends, numbering across boots, rotation
+// and the paged JSON reader, on the fake filesystem
+#include <unity.h>
+#include "HalNative.h"
+#include "EventLog.h"
+#include <string>
+
+using namespace hal::native;
+typedef EventLog::Type Type;
+
+static size_t fileEntries(const char* path) {
+    return files().count(path) ? files()[path].size() / sizeof(EventLog::Entry) : 0;
+}
+
+// Drains a Reader with a small buffer, like the chunked response does
+static std::string readPage(uint32_t after, uint16_t limit) {
+    EventLog::Reader reader(after, limit);
+    std::string out;
+    char buf[37];
+    size_t n;
+    while ((n = reader.read(buf, sizeof(buf))) > 0) out.append(buf, n);
+    return out;
+}
+
+void setUp(void) {
+    reset();
+}
+
+void tearDown(void) {}
+
+void test_entries_are_written_in_batches(void) {
+    EventLog log;
+    log.begin();
+    for (uint8_t i = 0; i < EventLog::FLUSH_BATCH - 1; i++) log.add(Type::WindComplete, 0, i);
+    log.poll();
+    TEST_ASSERT_EQUAL(0, (int)fileEntries(EventLog::PATH));
+    log.add(Type::WindComplete, 0, 99);
+    log.poll();
+    TEST_ASSERT_EQUAL(EventLog::FLUSH_BATCH, (int)fileEntries(EventLog::PATH));
+    TEST_ASSERT_EQUAL_UINT32(1, log.stats().flushes);
+}
+
+void test_single_entry_waits_at_most_flush_ms(void) {
+    EventLog log;
+    log.begin();
+    log.add(Type::ClockSet);
+    advanceMicros((EventLog::FLUSH_MS - 1) * 1000UL);
+    log.poll();
+    TEST_ASSERT_EQUAL(0, (int)fileEntries(EventLog::PATH));
+    advanceMicros(1000);
+    log.poll();
+    TEST_ASSERT_EQUAL(1, (int)fileEntries(EventLog::PATH));
+}
+
+// Entries logged before the filesystem is up are renumbered after the
+// last one on file, and the boot count goes up
+void test_numbering_continues_across_boots(void) {
+    EventLog first;
+    first.begin();
+    first.add(Type::Boot);
+    first.add(Type::WifiConnected);
+    first.flush();
+
+    EventLog second;
+    second.add(Type::Boot);
+    second.begin();
+    second.add(Type::ClockSet);
+    second.flush();
+    TEST_ASSERT_EQUAL_UINT32(4, second.lastSeq());
+    EventLog::Entry e[4];
+    TEST_ASSERT_EQUAL(4, (int)second.readAfter(0, e, 4));
+    TEST_ASSERT_EQUAL_UINT32(3, e[2].seq);
+    TEST_ASSERT_EQUAL(e[0].boot + 1, e[2].boot);
+}
+
+void test_full_ring_drops_new_entries(void) {
+    EventLog log;
+    for (int i = 0; i < EventLog::RAM_SLOTS + 5; i++) log.add(Type::WindComplete, 0, i);
+    TEST_ASSERT_EQUAL_UINT32(5, log.stats().dropped);
+    TEST_ASSERT_EQUAL_UINT32(EventLog::RAM_SLOTS, log.stats().logged);
+    log.begin();
+    log.flush();
+    EventLog::Entry e;
+    TEST_ASSERT_EQUAL(1, (int)log.readAfter(EventLog::RAM_SLOTS - 1, &e, 1));
+    TEST_ASSERT_EQUAL_INT32(EventLog::RAM_SLOTS - 1, e.value);  // no holes: the newest kept is the last added
+}
+
+void test_clock_before_sntp_is_recorded_as_zero(void) {
+    EventLog log;
+    log.begin();
+    log.add(Type::Boot);
+    setEpoch(1700000000);
+    log.add(Type::ClockSet);
+    log.flush();
+    EventLog::Entry e[2];
+    TEST_ASSERT_EQUAL(2, (int)log.readAfter(0, e, 2));
+    TEST_ASSERT_EQUAL_UINT32(0, e[0].time);
+    TEST_ASSERT_EQUAL_UINT32(1700000000, e[1].time);
+}
+
+void test_full_file_rotates_to_old_path(void) {
+    EventLog log;
+    log.begin();
+    const size_t perFile = EventLog::MAX_FILE_BYTES / sizeof(EventLog::Entry);
+    for (size_t i = 0; i < perFile + 8; i++) {
+        log.add(Type::WindComplete, 0, (int32_t)i);
+        if (i % 8 == 7) TEST_ASSERT_TRUE(log.flush());
+    }
+    TEST_ASSERT_EQUAL((int)perFile, (int)fileEntries(EventLog::OLD_PATH));
+    TEST_ASSERT_EQUAL(8, (int)fileEntries(EventLog::PATH));
+    // Readers continue from the old file into the current one
+    EventLog::Entry e;
+    TEST_ASSERT_EQUAL(1, (int)log.readAfter(0, &e, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, e.seq);
+    TEST_ASSERT_EQUAL(1, (int)log.readAfter(perFile, &e, 1));
+    TEST_ASSERT_EQUAL_UINT32(perFile + 1, e.seq);
+}
+
+void test_partial_trailing_entry_is_dropped(void) {
+    EventLog log;
+    log.begin();
+    log.add(Type::Boot);
+    log.add(Type::ClockSet);
+    log.flush();
+    files()[EventLog::PATH].append("\x01\x02\x03", 3);  // power cut mid-append
+
+    EventLog next;
+    next.begin();
+    TEST_ASSERT_EQUAL(2 * sizeof(EventLog::Entry), files()[EventLog::PATH].size());
+    TEST_ASSERT_EQUAL_UINT32(2, next.lastSeq());
+}
+
+// The reader pages through the global log with a seq cursor
+void test_reader_pages_json(void) {
+    eventLog.begin();
+    uint32_t base = eventLog.lastSeq();
+    eventLog.add(Type::ManualStart, 0, 30);
+    eventLog.add(Type::WindComplete, 0, 9000);
+    eventLog.add(Type::OtaStart);
+    eventLog.flush();
+
+    std::string page = readPage(base, 2);
+    char expect[512];
+    snprintf(expect, sizeof(expect),
+             "{\"events\":[{\"seq\":%u,\"time\":0,\"boot\":1,\"type\":\"manual_start\",\"winder\":0,\"value\":30,"
+             "\"text\":\"Winder 0: manual winding started, 30 min\"},"
+             "{\"seq\":%u,\"time\":0,\"boot\":1,\"type\":\"wind_complete\",\"winder\":0,\"value\":9000,"
+             "\"text\":\"Winder 0: winding complete, 9000 steps\"}],\"next\":%u,\"more\":true}",
+             base + 1, base + 2, base + 2);
+    TEST_ASSERT_EQUAL_STRING(expect, page.c_str());
+
+    page = readPage(base + 2, 2);
+    TEST_ASSERT_TRUE(page.find("\"type\":\"ota_start\"") != std::string::npos);
+    TEST_ASSERT_TRUE(page.find("\"more\":false}") != std::string::npos);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_entries_are_written_in_batches);
+    RUN_TEST(test_single_entry_waits_at_most_flush_ms);
+    RUN_TEST(test_numbering_continues_across_boots);
+    RUN_TEST(test_full_ring_drops_new_entries);
+    RUN_TEST(test_clock_before_sntp_is_recorded_as_zero);
+    RUN_TEST(test_full_file_rotates_to_old_path);
+    RUN_TEST(test_partial_trailing_entry_is_dropped);
+    RUN_TEST(test_reader_pages_json);
+    return UNITY_END();
+}
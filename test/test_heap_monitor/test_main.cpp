@@ -0,0 +1,202 @@
+// HeapMonitor on the instrumented native allocator: per-tag accounting,
+// the per-scope fallback the ESP8266 uses, low-water history, and a
+// three-day soak of the subsystems that allocate from loop()
+#include <unity.h>
+#include "HalNative.h"
+#include "HeapMonitor.h"
+#include "ConfigStore.h"
+#include "EventLog.h"
+#include "NtfyClient.h"
+#include "WindingHistory.h"
+#include <utility>
+
+using namespace hal::native;
+
+void setUp(void) {
+    reset();
+    heapMonitor = HeapMonitor();
+    heapMonitor.begin();
+}
+
+void tearDown(void) {}
+
+void test_allocations_are_charged_to_the_current_tag(void) {
+    char* kept;
+    {
+        HeapScope scope(HeapTag::Ntfy);
+        kept = new char[100];
+        delete[] new char[40];
+        {
+            HeapScope inner(HeapTag::Config);
+            delete[] new char[24];
+        }
+    }
+    const HeapMonitor::TagStats& ntfy = heapMonitor.tag(HeapTag::Ntfy);
+    TEST_ASSERT_TRUE(heapMonitor.instrumented());
+    TEST_ASSERT_EQUAL_UINT32(2, ntfy.allocs);
+    TEST_ASSERT_EQUAL_UINT32(1, ntfy.frees);
+    TEST_ASSERT_EQUAL_UINT32(140, ntfy.bytes);
+    TEST_ASSERT_EQUAL_INT32(100, ntfy.liveBytes);
+    TEST_ASSERT_EQUAL_UINT32(140, ntfy.peakBytes);
+    TEST_ASSERT_EQUAL_UINT32(24, heapMonitor.tag(HeapTag::Config).bytes);
+    TEST_ASSERT_EQUAL_INT32(0, heapMonitor.tag(HeapTag::Config).liveBytes);
+
+    // Freed outside the scope, still credited to the tag it was made under
+    delete[] kept;
+    TEST_ASSERT_EQUAL_INT32(0, heapMonitor.tag(HeapTag::Ntfy).liveBytes);
+    TEST_ASSERT_EQUAL_UINT32(2, heapMonitor.tag(HeapTag::Ntfy).frees);
+}
+
+void test_reset_keeps_blocks_still_held(void) {
+    char* kept;
+    {
+        HeapScope scope(HeapTag::Http);
+        kept = new char[64];
+        delete[] new char[500];
+    }
+    heapMonitor.resetTags();
+    const HeapMonitor::TagStats& http = heapMonitor.tag(HeapTag::Http);
+    TEST_ASSERT_EQUAL_UINT32(0, http.allocs);
+    TEST_ASSERT_EQUAL_UINT32(0, http.bytes);
+    TEST_ASSERT_EQUAL_INT32(64, http.liveBytes);
+    TEST_ASSERT_EQUAL_UINT32(64, http.peakBytes);
+    delete[] kept;
+    TEST_ASSERT_EQUAL_INT32(0, heapMonitor.tag(HeapTag::Http).liveBytes);
+}
+
+// Without allocator hooks (the ESP8266) a scope is charged the change in
+// free heap across it
+void test_scopes_charge_net_change_without_hooks(void) {
+    hal::setAllocHooks(nullptr, nullptr);
+    heapMonitor = HeapMonitor();
+    setHeap(30000);
+    TEST_ASSERT_FALSE(heapMonitor.instrumented());
+    char* kept;
+    {
+        HeapScope scope(HeapTag::Events);
+        kept = new char[200];
+        delete[] new char[1000];
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, heapMonitor.tag(HeapTag::Events).allocs);
+    TEST_ASSERT_EQUAL_UINT32(200, heapMonitor.tag(HeapTag::Events).bytes);
+    {
+        HeapScope scope(HeapTag::Events);
+        delete[] kept;
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, heapMonitor.tag(HeapTag::Events).frees);
+    TEST_ASSERT_EQUAL_INT32(0, heapMonitor.tag(HeapTag::Events).liveBytes);
+}
+
+void test_low_water_history_per_hour(void) {
+    setHeap(30000, 20000);
+    HeapMonitor::Heap heap = heapMonitor.sample();
+    TEST_ASSERT_EQUAL_UINT32(30000, heap.free);
+    TEST_ASSERT_EQUAL_UINT32(20000, heap.maxBlock);
+    TEST_ASSERT_EQUAL_UINT8(34, heap.fragmentation);
+
+    // A dip within the first hour, then a quiet second hour
+    char* burst = new char[12000];
+    heapMonitor.sample();
+    delete[] burst;
+    advanceMicros(HeapMonitor::PERIOD_MS * 1000UL);
+    heapMonitor.sample();
+    TEST_ASSERT_EQUAL(2, heapMonitor.historyCount());
+    TEST_ASSERT_EQUAL_UINT32(30000, heapMonitor.history(0).minFree);
+    TEST_ASSERT_EQUAL_UINT32(18000, heapMonitor.history(1).minFree);
+    TEST_ASSERT_EQUAL_UINT32(18000, heapMonitor.history(1).minMaxBlock);
+    TEST_ASSERT_EQUAL_UINT8(34, heapMonitor.history(1).maxFragmentation);
+    TEST_ASSERT_EQUAL_UINT8(34, heapMonitor.history(0).maxFragmentation);
+    TEST_ASSERT_EQUAL_UINT32(18000, heapMonitor.sinceBoot().minFree);
+    TEST_ASSERT_EQUAL_UINT32(HeapMonitor::PERIOD_MS / 1000, heapMonitor.history(0).startS);
+
+    // The ring keeps the last HISTORY hours
+    for (uint8_t h = 0; h < HeapMonitor::HISTORY; h++) {
+        advanceMicros(HeapMonitor::PERIOD_MS * 1000UL);
+        heapMonitor.sample();
+    }
+    TEST_ASSERT_EQUAL(HeapMonitor::HISTORY, heapMonitor.historyCount());
+    TEST_ASSERT_EQUAL_UINT32(30000, heapMonitor.history(HeapMonitor::HISTORY - 1).minFree);
+    TEST_ASSERT_EQUAL_UINT32(18000, heapMonitor.sinceBoot().minFree);
+}
+
+// Three days of 5 s loop() ticks: a status request every tick, a config
+// write and an event every minute, a winding run and a notification every
+// hour with WiFi down (so ntfy keeps a full queue). In steady state no tag
+// may keep growing and every hour's low-water mark matches the first
+// full day's.
+void test_soak_has_no_growth(void) {
+    static const unsigned long TICK_MS = 5000;
+    static const unsigned long TICKS_PER_HOUR = HeapMonitor::PERIOD_MS / TICK_MS;
+    setWifiConnected(false);
+    setHeap(40000);
+    configStore = ConfigStore();
+    configStore.begin();
+    eventLog = EventLog();
+    eventLog.begin();
+    windingHistory = WindingHistory();
+    windingHistory.begin();
+    NtfyClient client("127.0.0.1", 80, "topic");
+    String response;
+
+    int32_t liveAfterDay1[(uint8_t)HeapTag::Count] = {};
+    size_t heapAfterDay1 = 0;
+    uint32_t day1MinFree = 0;
+    for (unsigned long tick = 0; tick < 3 * 24 * TICKS_PER_HOUR; tick++) {
+        advanceMicros(TICK_MS * 1000UL);
+        {
+            // The response buffer stays with the request until the next tick
+            HeapScope scope(HeapTag::Http);
+            String body;
+            body.reserve(512);
+            body += "{\"free\":";
+            body += String((unsigned long)hal::heapFree());
+            body += ",\"uptime\":";
+            body += String(hal::millis() / 1000);
+            body += "}";
+            response = std::move(body);
+        }
+        if (tick % 12 == 0) {
+            configStore.setLastWinding(0, hal::millis() / 1000);
+            eventLog.add(EventLog::Type::WifiDisconnected, EventLog::NO_WINDER, (int32_t)tick);
+        }
+        if (tick % TICKS_PER_HOUR == 0) {
+            windingHistory.start(0, WindingHistory::Trigger::Scheduled, 10.0f, true, true, 2048);
+            windingHistory.finish(0, 20480, false);
+            client.sendf("wound %lu", tick);
+        }
+        configStore.poll();
+        eventLog.poll();
+        client.poll();
+        heapMonitor.sample();
+
+        if (tick + 1 == 24 * TICKS_PER_HOUR) {
+            for (uint8_t t = 0; t < (uint8_t)HeapTag::Count; t++) liveAfterDay1[t] = heapMonitor.tag((HeapTag)t).liveBytes;
+            heapAfterDay1 = heapAllocated();
+            day1MinFree = heapMonitor.sinceBoot().minFree;
+        }
+    }
+
+    for (uint8_t t = 0; t < (uint8_t)HeapTag::Count; t++) {
+        if (heapMonitor.tag((HeapTag)t).liveBytes != liveAfterDay1[t]) {
+            printf("  %s: %d bytes held after day 1, %d after day 3\n", HeapMonitor::tagName((HeapTag)t),
+                   (int)liveAfterDay1[t], (int)heapMonitor.tag((HeapTag)t).liveBytes);
+        }
+        TEST_ASSERT_EQUAL_INT32(liveAfterDay1[t], heapMonitor.tag((HeapTag)t).liveBytes);
+    }
+    TEST_ASSERT_EQUAL(heapAfterDay1, heapAllocated());
+    for (uint8_t h = 0; h < HeapMonitor::HISTORY; h++) {
+        TEST_ASSERT_EQUAL_UINT32(day1MinFree, heapMonitor.history(h).minFree);
+    }
+    printf("  soak: %u bytes held, low water %u of 40000 free, %u http requests\n", (unsigned)heapAllocated(),
+           (unsigned)heapMonitor.sinceBoot().minFree, (unsigned)heapMonitor.tag(HeapTag::Http).allocs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_allocations_are_charged_to_the_current_tag);
+    RUN_TEST(test_reset_keeps_blocks_still_held);
+    RUN_TEST(test_scopes_charge_net_change_without_hooks);
+    RUN_TEST(test_low_water_history_per_hour);
+    RUN_TEST(test_soak_has_no_growth);
+    return UNITY_END();
+}
@@ -0,0 +1,141 @@
+// The shared outbound HTTP connection against a local stand-in server:
+// keep-alive reuse, the idle timeout, retrying a socket the server closed,
+// and per-request latency and heap, cold versus warm. The native client
+// has no TLS, so session resumption and the TLS buffer sizes are only
+// measurable on the device (GET /api/system/network).
+#include <unity.h>
+#include "HalNative.h"
+#include "HeapMonitor.h"
+#include "../StandInServer.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace hal::native;
+
+static StandInServer server;
+static const std::string VERSION(64, 'v');
+
+static bool collect(void* ctx, size_t, const uint8_t* data, size_t len) {
+    ((std::string*)ctx)->append((const char*)data, len);
+    return true;
+}
+
+static int get(const char* path, std::string& body) {
+    body.clear();
+    return hal::httpGetRange(server.url(path).c_str(), 0, collect, &body);
+}
+
+void setUp(void) {
+    reset();
+    server.clear();
+    server.put("/version.txt", VERSION);
+    heapMonitor = HeapMonitor();
+    heapMonitor.begin();
+}
+
+void tearDown(void) {}
+
+void test_requests_share_one_connection(void) {
+    std::string body;
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL(200, get("/version.txt", body));
+        TEST_ASSERT_TRUE(body == VERSION);
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, hal::httpStats().requests);
+    TEST_ASSERT_EQUAL_UINT32(1, hal::httpStats().connects);
+    TEST_ASSERT_EQUAL_UINT32(4, hal::httpStats().reused);
+    std::vector<StandInServer::Request> log = server.log();
+    TEST_ASSERT_EQUAL(log.front().connection, log.back().connection);
+}
+
+void test_idle_connection_is_closed(void) {
+    std::string body;
+    get("/version.txt", body);
+    advanceMicros(hal::HTTP_IDLE_MS * 1000UL);
+    hal::httpPoll();
+    TEST_ASSERT_TRUE(hal::httpConnectionOpen());
+    advanceMicros(1000);
+    hal::httpPoll();
+    TEST_ASSERT_FALSE(hal::httpConnectionOpen());
+    TEST_ASSERT_EQUAL(200, get("/version.txt", body));
+    TEST_ASSERT_EQUAL_UINT32(2, hal::httpStats().connects);
+}
+
+// A kept-alive socket the server has dropped fails on first use and is
+// retried once on a new connection
+void test_socket_closed_by_server_is_retried(void) {
+    std::string body;
+    get("/version.txt", body);
+    server.closeConnections();
+    while (server.openConnections()) usleep(100);
+    TEST_ASSERT_EQUAL(200, get("/version.txt", body));
+    TEST_ASSERT_TRUE(body == VERSION);
+    TEST_ASSERT_EQUAL_UINT32(2, hal::httpStats().connects);
+    TEST_ASSERT_EQUAL_UINT32(2, hal::httpStats().requests);
+    TEST_ASSERT_EQUAL(2, server.count("/version.txt"));
+}
+
+void test_failed_host_does_not_poison_the_next_request(void) {
+    std::string body;
+    get("/version.txt", body);
+    TEST_ASSERT_EQUAL(404, get("/missing", body));
+    TEST_ASSERT_EQUAL(200, get("/version.txt", body));
+    TEST_ASSERT_TRUE(body == VERSION);
+}
+
+// Per request: real time to the whole body, and the heap held afterwards
+// and allocated on the way. A cold request connects first.
+struct Cost {
+    long medianUs;
+    int32_t heldBytes;
+    uint32_t allocBytes;
+};
+
+static Cost measure(bool cold, int n) {
+    std::vector<long> us;
+    std::string body;
+    body.reserve(VERSION.size());
+    heapMonitor.resetTags();
+    for (int i = 0; i < n; i++) {
+        if (cold) {
+            advanceMicros((hal::HTTP_IDLE_MS + 1) * 1000UL);
+            hal::httpPoll();
+        }
+        auto start = std::chrono::steady_clock::now();
+        {
+            HeapScope scope(HeapTag::Ota);
+            get("/version.txt", body);
+        }
+        us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(us.begin(), us.end());
+    const HeapMonitor::TagStats& ota = heapMonitor.tag(HeapTag::Ota);
+    return {us[n / 2], ota.liveBytes, ota.bytes / n};
+}
+
+void test_cold_versus_warm(void) {
+    static const int N = 300;
+    Cost cold = measure(true, N);
+    Cost warm = measure(false, N);  // the first reuses the last cold connection
+    printf("  cold: %ld us, %u bytes allocated per request\n", cold.medianUs, (unsigned)cold.allocBytes);
+    printf("  warm: %ld us, %u bytes allocated per request\n", warm.medianUs, (unsigned)warm.allocBytes);
+    TEST_ASSERT_EQUAL_UINT32(N, hal::httpStats().connects);
+    TEST_ASSERT_EQUAL_UINT32(N, hal::httpStats().reused);
+    // Nothing is kept between requests either way
+    TEST_ASSERT_EQUAL_INT32(0, cold.heldBytes);
+    TEST_ASSERT_EQUAL_INT32(0, warm.heldBytes);
+}
+
+int main() {
+    server.start();
+    UNITY_BEGIN();
+    RUN_TEST(test_requests_share_one_connection);
+    RUN_TEST(test_idle_connection_is_closed);
+    RUN_TEST(test_socket_closed_by_server_is_retried);
+    RUN_TEST(test_failed_host_does_not_poison_the_next_request);
+    RUN_TEST(test_cold_versus_warm);
+    int failures = UNITY_END();
+    server.stop();
+    return failures;
+}
@@ -0,0 +1,256 @@
+// JSON response rendering, before and after: the chunked response used to
+// capture a by-value snapshot in its std::function, which allocated it on
+// the heap; sendJson() now copies the data into a fixed JsonResponsePool
+// slot and the filler only captures the slot. Soaks both over the
+// /api/system/profile and /api/system/memory documents and reports heap
+// use and render work per response, and checks the pool's slots.
+#include <unity.h>
+#include "HalNative.h"
+#include "HeapMonitor.h"
+#include "JsonResponsePool.h"
+#include "LoopProfiler.h"
+#include <chrono>
+#include <functional>
+#include <string>
+
+using namespace hal::native;
+
+// Send-buffer space per callback: one 536-byte segment with the default
+// lwIP build on the ESP8266
+static const size_t CHUNK = 536;
+static const int SOAK = 2000;
+
+struct Cost {
+    uint32_t allocs;     // per response
+    uint32_t bytes;      // allocated per response
+    size_t rendered;     // bytes produced by the writer, all passes
+    int32_t live;        // still allocated after the soak
+    double usPerResponse;
+};
+
+static void writeProfileStats(JsonStreamWriter& json, const char* key, const LoopProfiler::Stats& s) {
+    json.beginObject(key)
+        .field("count", s.count)
+        .field("mean_us", s.count ? (uint32_t)(s.totalUs / s.count) : 0)
+        .field("max_us", s.maxUs)
+        .beginArray("hist_log2_us");
+    for (uint8_t b = 0; b < LoopProfiler::BUCKETS; b++) json.value(s.hist[b]);
+    json.endArray().endObject();
+}
+
+static void renderProfile(JsonStreamWriter& json, const LoopProfiler& p) {
+    json.beginObject();
+    writeProfileStats(json, "loop", p.loop());
+    json.beginObject("sections");
+    for (uint8_t i = 0; i < (uint8_t)ProfSection::Count; i++) {
+        ProfSection section = (ProfSection)i;
+        writeProfileStats(json, LoopProfiler::sectionName(section), p.section(section));
+    }
+    json.endObject().endObject();
+}
+
+static void renderMemory(JsonStreamWriter& json, const HeapMonitor& m) {
+    json.beginObject().beginObject("tags");
+    for (uint8_t i = 0; i < (uint8_t)HeapTag::Count; i++) {
+        const HeapMonitor::TagStats& t = m.tag((HeapTag)i);
+        json.beginObject(HeapMonitor::tagName((HeapTag)i))
+            .field("allocs", t.allocs)
+            .field("frees", t.frees)
+            .field("bytes", t.bytes)
+            .field("live", t.liveBytes)
+            .field("peak", t.peakBytes)
+            .endObject();
+    }
+    json.endObject().beginArray("history");
+    for (uint8_t i = 0; i < m.historyCount(); i++) {
+        const HeapMonitor::LowWater& low = m.history(i);
+        json.beginObject()
+            .field("start", low.startS)
+            .field("min_free", low.minFree)
+            .field("min_max_free_block", low.minMaxBlock)
+            .field("max_fragmentation", low.maxFragmentation)
+            .endObject();
+    }
+    json.endArray().endObject();
+}
+
+// Drains a chunk filler into out, CHUNK bytes per call as the TCP stack
+// asks; every call renders the whole document, so adds calls * length to
+// rendered
+static void drain(const std::function<size_t(uint8_t*, size_t, size_t)>& filler, std::string& out, size_t& rendered) {
+    uint8_t segment[CHUNK];
+    size_t n, calls = 1;
+    while ((n = filler(segment, sizeof(segment), out.size())) > 0) {
+        out.append((char*)segment, n);
+        calls++;
+    }
+    rendered += calls * out.size();
+}
+
+// Before: snapshot copied into the callback
+template <typename Data, typename Render>
+static void sendCaptured(const Data& live, Render render, std::string& out, size_t& rendered) {
+    HeapScope heapScope(HeapTag::Http);
+    std::function<size_t(uint8_t*, size_t, size_t)> filler =
+        [snapshot = live, render](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            JsonStreamWriter json((char*)buffer, maxLen, index);
+            render(json, snapshot);
+            return json.written();
+        };
+    drain(filler, out, rendered);
+}
+
+// After: copied into a pool slot; the filler captures the slot's address
+typedef JsonResponsePool<128, 4, 640> Pool;
+static Pool pool;
+
+template <typename Data, typename Render>
+static void sendPooled(const Data& live, Render render, std::string& out, size_t& rendered) {
+    HeapScope heapScope(HeapTag::Http);
+    const Pool::Slot* slot = pool.take<Data>(live, render);
+    TEST_ASSERT_NOT_NULL(slot);
+    std::function<size_t(uint8_t*, size_t, size_t)> filler =
+        [slot](uint8_t* buffer, size_t maxLen, size_t index) -> size_t { return slot->fill(buffer, maxLen, index); };
+    drain(filler, out, rendered);
+    pool.release(slot);  // on disconnect, on the device
+}
+
+// Sends the document SOAK times; out keeps its capacity, so only the
+// sender's own allocations are charged to HeapTag::Http
+template <typename Send>
+static Cost soak(Send send, std::string& out) {
+    out.reserve(1 << 16);
+    heapMonitor.resetTags();
+    size_t rendered = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SOAK; i++) {
+        out.clear();
+        send(out, rendered);
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    const HeapMonitor::TagStats& http = heapMonitor.tag(HeapTag::Http);
+    return {http.allocs / SOAK, http.bytes / SOAK, rendered / SOAK, http.liveBytes, (double)us / SOAK};
+}
+
+static void report(const char* name, const Cost& c, size_t len) {
+    char line[160];
+    snprintf(line, sizeof(line), "%s: %u B document, %u alloc / %u B per response, %u B rendered, %.1f us",
+             name, (unsigned)len, (unsigned)c.allocs, (unsigned)c.bytes, (unsigned)c.rendered, c.usPerResponse);
+    TEST_MESSAGE(line);
+}
+
+// Soaks one document both ways and checks output, heap use and render work
+template <typename Data, typename Render>
+static void compare(const char* name, const Data& data, Render render) {
+    std::string oldBody, newBody;
+    Cost before = soak([&](std::string& out, size_t& r) { sendCaptured(data, render, out, r); }, oldBody);
+    Cost after = soak([&](std::string& out, size_t& r) { sendPooled(data, render, out, r); }, newBody);
+    TEST_MESSAGE(name);
+    report("  before (snapshot captured in the filler)", before, oldBody.size());
+    report("  after (snapshot in a pool slot)", after, newBody.size());
+
+    TEST_ASSERT_EQUAL_STRING(oldBody.c_str(), newBody.c_str());
+    TEST_ASSERT_EQUAL_INT32(0, before.live);  // nothing left behind
+    TEST_ASSERT_EQUAL_INT32(0, after.live);
+    TEST_ASSERT_EQUAL(0, pool.inUse());
+    size_t len = newBody.size();
+    TEST_ASSERT_TRUE(len > CHUNK);
+    // The captured snapshot was a heap allocation per response; the slot is not
+    TEST_ASSERT_TRUE(before.allocs >= 1);
+    TEST_ASSERT_TRUE(before.bytes >= sizeof(Data));
+    TEST_ASSERT_EQUAL_UINT32(0, after.allocs);
+    TEST_ASSERT_EQUAL_UINT32(0, after.bytes);
+    // Same render work both ways: the document once per chunk, plus the
+    // final call that finds nothing left
+    size_t chunks = (len + CHUNK - 1) / CHUNK;
+    TEST_ASSERT_EQUAL((chunks + 1) * len, before.rendered);
+    TEST_ASSERT_EQUAL((chunks + 1) * len, after.rendered);
+}
+
+void setUp(void) {
+    reset();
+    heapMonitor = HeapMonitor();
+    heapMonitor.begin();
+    loopProfiler.reset();
+}
+
+void tearDown(void) {}
+
+void test_profile_response(void) {
+    // A busy profile: every histogram bucket and counter in use
+    for (uint32_t i = 0; i < 20000; i++) {
+        loopProfiler.recordLoop(i * 37 % 70000);
+        for (uint8_t s = 0; s < (uint8_t)ProfSection::Count; s++) loopProfiler.record((ProfSection)s, (i + s) * 131 % 70000);
+    }
+    compare("/api/system/profile", loopProfiler, renderProfile);
+}
+
+void test_memory_response(void) {
+    // A day of hourly low-water marks
+    setHeap(40000, 30000);
+    for (uint8_t h = 0; h < HeapMonitor::HISTORY; h++) {
+        heapMonitor.sample();
+        advanceMicros(HeapMonitor::PERIOD_MS * 1000UL);
+    }
+    // Rendered from a copy: the soak itself moves the live tag counters
+    HeapMonitor frozen = heapMonitor;
+    compare("/api/system/memory", frozen, renderMemory);
+}
+
+struct Small {
+    uint32_t value;
+};
+
+static void renderSmall(JsonStreamWriter& json, const Small& s) {
+    json.beginObject().field("value", s.value).endObject();
+}
+
+// Small copies fill the small slots, then the large one; large copies
+// only fit the large one
+void test_pool_slots(void) {
+    Small small = {1};
+    const Pool::Slot* slots[Pool::SLOTS];
+    for (uint8_t i = 0; i < Pool::SLOTS; i++) TEST_ASSERT_NOT_NULL(slots[i] = pool.take<Small>(small, renderSmall));
+    TEST_ASSERT_EQUAL(Pool::SLOTS, pool.inUse());
+    TEST_ASSERT_NULL(pool.take<Small>(small, renderSmall));
+
+    pool.release(slots[0]);
+    TEST_ASSERT_NULL(pool.take<LoopProfiler>(loopProfiler, renderProfile));
+    TEST_ASSERT_TRUE(pool.take<Small>(small, renderSmall) == slots[0]);
+    pool.release(slots[Pool::SLOTS - 1]);
+    TEST_ASSERT_TRUE(pool.take<LoopProfiler>(loopProfiler, renderProfile) == slots[Pool::SLOTS - 1]);
+
+    for (const Pool::Slot* slot : slots) pool.release(slot);
+    TEST_ASSERT_EQUAL(0, pool.inUse());
+}
+
+// Chunks of any size join up, and come from the copy taken with the slot
+// whatever happens to the data afterwards
+void test_chunks_render_the_copy(void) {
+    for (uint32_t i = 0; i < 1000; i++) loopProfiler.recordLoop(i * 53 % 70000);
+    char whole[2048];
+    JsonStreamWriter json(whole, sizeof(whole));
+    renderProfile(json, loopProfiler);
+    std::string expected(whole, json.length());
+
+    const Pool::Slot* slot = pool.take<LoopProfiler>(loopProfiler, renderProfile);
+    TEST_ASSERT_NOT_NULL(slot);
+    std::string out;
+    uint8_t chunk[97];
+    size_t n;
+    while ((n = slot->fill(chunk, sizeof(chunk), out.size())) > 0) {
+        out.append((char*)chunk, n);
+        loopProfiler.recordLoop(12345);  // loop() runs between chunks
+    }
+    pool.release(slot);
+    TEST_ASSERT_TRUE(out == expected);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_profile_response);
+    RUN_TEST(test_memory_response);
+    RUN_TEST(test_pool_slots);
+    RUN_TEST(test_chunks_render_the_copy);
+    return UNITY_END();
+}
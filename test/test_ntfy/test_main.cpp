@@ -0,0 +1,148 @@
+// NtfyClient against a local HTTP stand-in over real non-blocking sockets:
+// coalescing, retry with backoff, connection reuse and a full queue.
+// poll() is driven like loop() while the fake clock advances.
+#include <unity.h>
+#include "HalNative.h"
+#include "NtfyClient.h"
+#include "../StandInServer.h"
+#include <chrono>
+#include <functional>
+
+using namespace hal::native;
+
+static StandInServer server;
+
+// loop() passes 1 ms apart on the fake clock; a short real sleep lets the
+// server thread answer. Returns the slowest poll() in µs of real time.
+static long pump(NtfyClient& client, unsigned long ms) {
+    long slowest = 0;
+    for (unsigned long i = 0; i < ms; i++) {
+        advanceMicros(1000);
+        auto start = std::chrono::steady_clock::now();
+        client.poll();
+        long us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        if (us > slowest) slowest = us;
+        usleep(100);
+    }
+    return slowest;
+}
+
+// Pumps until done() or maxMs have passed; returns the fake ms taken
+static unsigned long pumpUntil(NtfyClient& client, std::function<bool()> done, unsigned long maxMs) {
+    unsigned long ms = 0;
+    while (!done() && ms < maxMs) {
+        pump(client, 1);
+        ms++;
+    }
+    return ms;
+}
+
+static int posts() {
+    int n = 0;
+    for (const StandInServer::Request& r : server.log()) n += r.method == "POST";
+    return n;
+}
+
+void setUp(void) {
+    reset();
+    server.clear();
+}
+
+void tearDown(void) {}
+
+void test_burst_goes_out_as_one_post(void) {
+    NtfyClient client("127.0.0.1", server.port(), "topic");
+    client.send("first");
+    pump(client, 500);
+    client.send("second");
+    client.sendf("third %d", 3);
+    pump(client, NtfyClient::COALESCE_MS - 100);
+    TEST_ASSERT_EQUAL(0, posts());  // still settling
+    long slowest = pump(client, 500);
+    TEST_ASSERT_TRUE(client.idle());
+    TEST_ASSERT_EQUAL(1, posts());
+    StandInServer::Request req = server.log()[0];
+    TEST_ASSERT_EQUAL_STRING("/topic", req.path.c_str());
+    TEST_ASSERT_EQUAL_STRING("first\nsecond\nthird 3", req.body.c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, client.stats().posts);
+    TEST_ASSERT_EQUAL_UINT32(3, client.stats().sent);
+    TEST_ASSERT_TRUE(slowest < 5000);  // never blocks loop() on the network
+}
+
+void test_failed_post_is_retried_after_backoff(void) {
+    NtfyClient client("127.0.0.1", server.port(), "topic");
+    server.queueReply(503);
+    server.queueReply(500);
+    client.send("hello");
+    pumpUntil(client, [&] { return client.stats().failures == 1; }, NtfyClient::COALESCE_MS + 500);
+    TEST_ASSERT_EQUAL(1, posts());
+    // First retry RETRY_BASE_MS after the failure, the second twice that
+    unsigned long waited = pumpUntil(client, [] { return posts() == 2; }, 3 * NtfyClient::RETRY_BASE_MS);
+    TEST_ASSERT_TRUE(waited >= NtfyClient::RETRY_BASE_MS && waited < NtfyClient::RETRY_BASE_MS + 100);
+    pumpUntil(client, [&] { return client.stats().failures == 2; }, 500);
+    waited = pumpUntil(client, [] { return posts() == 3; }, 3 * NtfyClient::RETRY_BASE_MS);
+    TEST_ASSERT_TRUE(waited >= 2 * NtfyClient::RETRY_BASE_MS && waited < 2 * NtfyClient::RETRY_BASE_MS + 100);
+    pumpUntil(client, [&] { return client.idle(); }, 500);
+    TEST_ASSERT_TRUE(client.idle());
+    TEST_ASSERT_EQUAL_UINT32(2, client.stats().failures);
+    TEST_ASSERT_EQUAL_UINT32(1, client.stats().sent);
+    TEST_ASSERT_EQUAL_STRING("hello", server.log()[2].body.c_str());
+}
+
+void test_kept_alive_connection_is_reused(void) {
+    NtfyClient client("127.0.0.1", server.port(), "topic");
+    client.send("one");
+    pump(client, NtfyClient::COALESCE_MS + 200);
+    client.send("two");
+    pump(client, NtfyClient::COALESCE_MS + 200);
+    TEST_ASSERT_EQUAL(2, posts());
+    std::vector<StandInServer::Request> log = server.log();
+    TEST_ASSERT_EQUAL(log[0].connection, log[1].connection);
+    TEST_ASSERT_EQUAL_UINT32(1, client.stats().reused);
+
+    // After KEEPALIVE_MS the connection is closed and the next POST reconnects
+    pump(client, NtfyClient::KEEPALIVE_MS + 100);
+    client.send("three");
+    pump(client, NtfyClient::COALESCE_MS + 200);
+    log = server.log();
+    TEST_ASSERT_EQUAL(3, (int)log.size());
+    TEST_ASSERT_NOT_EQUAL(log[1].connection, log[2].connection);
+}
+
+void test_server_closing_is_not_reused(void) {
+    NtfyClient client("127.0.0.1", server.port(), "topic");
+    server.queueReply(200, true);
+    client.send("one");
+    pump(client, NtfyClient::COALESCE_MS + 200);
+    client.send("two");
+    pump(client, NtfyClient::COALESCE_MS + 200);
+    std::vector<StandInServer::Request> log = server.log();
+    TEST_ASSERT_EQUAL(2, (int)log.size());
+    TEST_ASSERT_NOT_EQUAL(log[0].connection, log[1].connection);
+    TEST_ASSERT_EQUAL_UINT32(0, client.stats().reused);
+    TEST_ASSERT_EQUAL_UINT32(0, client.stats().failures);
+}
+
+void test_full_queue_drops_messages(void) {
+    NtfyClient client("127.0.0.1", server.port(), "topic");
+    for (uint8_t i = 0; i < NtfyClient::SLOTS; i++) TEST_ASSERT_TRUE(client.sendf("msg %u", i));
+    TEST_ASSERT_FALSE(client.send("one too many"));
+    TEST_ASSERT_EQUAL_UINT32(1, client.stats().dropped);
+    // A full queue does not wait for the burst to settle
+    pump(client, 100);
+    TEST_ASSERT_EQUAL(1, posts());
+    TEST_ASSERT_EQUAL_UINT32(NtfyClient::SLOTS, client.stats().sent);
+}
+
+int main() {
+    server.start();
+    UNITY_BEGIN();
+    RUN_TEST(test_burst_goes_out_as_one_post);
+    RUN_TEST(test_failed_post_is_retried_after_backoff);
+    RUN_TEST(test_kept_alive_connection_is_reused);
+    RUN_TEST(test_server_closing_is_not_reused);
+    RUN_TEST(test_full_queue_drops_messages);
+    int failures = UNITY_END();
+    server.stop();
+    return failures;
+}
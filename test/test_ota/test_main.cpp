@@ -0,0 +1,184 @@
+// OTA end to end: OtaUpdate::updateAll() against a local HTTP/1.1
+// stand-in server (real sockets through hal::httpGetRange()) and the fake
+// flash. Covers a download resumed after a dropped connection, an MD5
+// mismatch, and a filesystem failure after the firmware was staged.
+#include <unity.h>
+#include "HalNative.h"
+#include "ConfigStore.h"
+#include "EventLog.h"
+#include "OtaUpdate.h"
+#include "WindingHistory.h"
+#include "../StandInServer.h"
+
+using namespace hal::native;
+using hal::FlashTarget;
+
+static StandInServer server;
+
+// Deterministic images; MD5s from md5sum
+static std::string pattern(size_t len, uint8_t mul, uint8_t add) {
+    std::string s(len, '\0');
+    for (size_t i = 0; i < len; i++) s[i] = (char)(i * mul + add);
+    return s;
+}
+static const std::string FIRMWARE = pattern(20000, 7, 3);
+static const std::string FILESYSTEM = pattern(12000, 13, 5);
+static const char* FIRMWARE_MD5 = "6633ba8338d338dc3f3b642b440364ac";
+static const char* FILESYSTEM_MD5 = "4584016ac5a34e18f7be479b468de4cf";
+static const std::string SETTINGS = "stored settings record";
+
+static bool update() {
+    return OtaUpdate::updateAll("2.0.0", server.url("/firmware.bin.gz").c_str(), server.url("/littlefs.bin").c_str());
+}
+
+void setUp(void) {
+    reset();
+    server.clear();
+    server.put("/firmware.bin.gz", FIRMWARE);
+    server.put("/firmware.bin.gz.md5", std::string(FIRMWARE_MD5) + "  firmware.bin.gz\n");
+    server.put("/littlefs.bin", FILESYSTEM);
+    server.put("/littlefs.bin.md5", FILESYSTEM_MD5);
+    setHeap(40960, 0);  // the server's copies of the images are not the device's
+
+    // A device with settings, 300 recorded runs and a few hundred events
+    files()[ConfigStore::PATH] = SETTINGS;
+    files()["/Config/version.txt"] = "1.0.0";
+    eventLog.begin();
+    windingHistory.begin();
+    for (int i = 0; i < 300; i++) {
+        windingHistory.start(0, WindingHistory::Trigger::Scheduled, 10, true, false, 4096);
+        windingHistory.finish(0, 4096 + i, false);
+        eventLog.add(EventLog::Type::WindComplete, 0, i);
+        if (i % 8 == 7) eventLog.flush();
+    }
+}
+
+void tearDown(void) {}
+
+void test_update_carries_settings_and_recent_logs_over(void) {
+    uint32_t lastSeq = eventLog.lastSeq();
+    const WindingHistory::WinderStats stats = windingHistory.stats(0);
+    TEST_ASSERT_TRUE(update());
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Firmware) == FIRMWARE);
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Filesystem) == FILESYSTEM);
+    TEST_ASSERT_EQUAL_STRING("2.0.0", files()["/Config/version.txt"].c_str());
+    TEST_ASSERT_TRUE(files()[ConfigStore::PATH] == SETTINGS);
+
+    // What the new firmware finds after the restart
+    WindingHistory history;
+    history.begin();
+    const size_t keptRuns = (OtaUpdate::KEEP_RUNS_BYTES - 16) / sizeof(WindingHistory::Run);
+    TEST_ASSERT_EQUAL_UINT32(keptRuns, history.total());
+    WindingHistory::Run newest;
+    TEST_ASSERT_EQUAL(1, (int)history.read(history.total() - 1, &newest, 1));
+    TEST_ASSERT_EQUAL_UINT32(4096 + 299, newest.steps);
+    TEST_ASSERT_EQUAL_UINT32(stats.runs, history.stats(0).runs);  // lifetime totals kept whole
+
+    EventLog log;
+    log.begin();
+    TEST_ASSERT_EQUAL_UINT32(lastSeq, log.lastSeq());
+    EventLog::Entry oldest;
+    const size_t keptEvents = OtaUpdate::KEEP_EVENTS_BYTES / sizeof(EventLog::Entry);
+    TEST_ASSERT_EQUAL(1, (int)log.readAfter(0, &oldest, 1));
+    TEST_ASSERT_EQUAL_UINT32(lastSeq - keptEvents + 1, oldest.seq);
+    TEST_ASSERT_FALSE(files().count(EventLog::OLD_PATH));
+}
+
+void test_dropped_download_resumes_from_last_byte(void) {
+    server.drop("/firmware.bin.gz", 5000, 1);
+    server.drop("/littlefs.bin", 7000, 1);
+    TEST_ASSERT_TRUE(update());
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Firmware) == FIRMWARE);
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Filesystem) == FILESYSTEM);
+    TEST_ASSERT_EQUAL(1, server.count("/firmware.bin.gz", 0));
+    TEST_ASSERT_EQUAL(1, server.count("/firmware.bin.gz", 5000));
+    TEST_ASSERT_EQUAL(1, server.count("/littlefs.bin", 7000));
+}
+
+void test_md5_mismatch_commits_nothing(void) {
+    server.put("/firmware.bin.gz.md5", "00000000000000000000000000000000");
+    TEST_ASSERT_FALSE(update());
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Firmware).empty());
+    TEST_ASSERT_FALSE(flashOpen());
+    // The filesystem was never touched
+    TEST_ASSERT_EQUAL(0, server.count("/littlefs.bin", 0));
+    TEST_ASSERT_EQUAL_STRING("1.0.0", files()["/Config/version.txt"].c_str());
+    TEST_ASSERT_TRUE(files()[ConfigStore::PATH] == SETTINGS);
+}
+
+// The filesystem breaks off for good half way: the staged firmware must
+// not run on what is left, and the kept files are written back
+void test_filesystem_failure_discards_staged_firmware(void) {
+    server.drop("/littlefs.bin", 6000, -1);
+    TEST_ASSERT_FALSE(update());
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Firmware).empty());
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Filesystem).empty());
+    TEST_ASSERT_FALSE(flashOpen());
+    TEST_ASSERT_EQUAL(OtaUpdate::MAX_STALLS, server.count("/littlefs.bin", 6000));  // the first drop made progress
+    TEST_ASSERT_FALSE(files().count("/Config/version.txt"));  // not recorded as 2.0.0
+    TEST_ASSERT_TRUE(files()[ConfigStore::PATH] == SETTINGS);
+    // The running history was reloaded from the rewritten file and keeps recording
+    const size_t keptRuns = (OtaUpdate::KEEP_RUNS_BYTES - 16) / sizeof(WindingHistory::Run);
+    TEST_ASSERT_EQUAL_UINT32(keptRuns, windingHistory.total());
+    windingHistory.start(0, WindingHistory::Trigger::Manual, 10, true, false, 4096);
+    windingHistory.finish(0, 1, false);
+    WindingHistory::Run newest;
+    TEST_ASSERT_EQUAL(1, (int)windingHistory.read(keptRuns, &newest, 1));
+    TEST_ASSERT_EQUAL_UINT32(1, newest.steps);
+}
+
+void test_missing_filesystem_image_discards_staged_firmware(void) {
+    server.put("/littlefs.bin.md5", "");
+    TEST_ASSERT_FALSE(update());
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Firmware).empty());
+    // Nothing was flashed, so the files are as they were
+    TEST_ASSERT_EQUAL_STRING("1.0.0", files()["/Config/version.txt"].c_str());
+    TEST_ASSERT_EQUAL_UINT32(300, windingHistory.total());
+}
+
+// Too little memory for the logs beside the download: the settings and
+// statistics are carried over, the runs are not, and the loss is logged
+void test_low_memory_drops_runs_and_logs_it(void) {
+    setHeap(40960, OtaUpdate::KEEP_EVENTS_BYTES + OtaUpdate::MIN_BLOCK_BYTES + 512);
+    const WindingHistory::WinderStats stats = windingHistory.stats(0);
+    TEST_ASSERT_TRUE(update());
+    TEST_ASSERT_TRUE(files()[ConfigStore::PATH] == SETTINGS);
+
+    WindingHistory history;
+    history.begin();
+    TEST_ASSERT_EQUAL_UINT32(0, history.total());
+    TEST_ASSERT_EQUAL_UINT32(stats.runs, history.stats(0).runs);
+
+    EventLog log;
+    log.begin();
+    EventLog::Entry entries[128];
+    size_t n = log.readAfter(0, entries, 128);
+    TEST_ASSERT_EQUAL(OtaUpdate::KEEP_EVENTS_BYTES / sizeof(EventLog::Entry) + 1, n);
+    TEST_ASSERT_TRUE(entries[n - 1].type == EventLog::Type::OtaStateLost);
+    TEST_ASSERT_EQUAL(OtaUpdate::KEPT_RUNS, entries[n - 1].value);
+}
+
+// Not even the settings fit beside the download: nothing is fetched
+void test_no_memory_for_settings_changes_nothing(void) {
+    setHeap(40960, OtaUpdate::MIN_BLOCK_BYTES);
+    TEST_ASSERT_FALSE(update());
+    TEST_ASSERT_EQUAL(0, server.count("/firmware.bin.gz.md5"));
+    TEST_ASSERT_TRUE(flashImage(FlashTarget::Firmware).empty());
+    TEST_ASSERT_EQUAL_STRING("1.0.0", files()["/Config/version.txt"].c_str());
+    TEST_ASSERT_EQUAL_UINT32(300, windingHistory.total());
+}
+
+int main() {
+    server.start();
+    UNITY_BEGIN();
+    RUN_TEST(test_update_carries_settings_and_recent_logs_over);
+    RUN_TEST(test_dropped_download_resumes_from_last_byte);
+    RUN_TEST(test_md5_mismatch_commits_nothing);
+    RUN_TEST(test_filesystem_failure_discards_staged_firmware);
+    RUN_TEST(test_missing_filesystem_image_discards_staged_firmware);
+    RUN_TEST(test_low_memory_drops_runs_and_logs_it);
+    RUN_TEST(test_no_memory_for_settings_changes_nothing);
+    int failures = UNITY_END();
+    server.stop();
+    return failures;
+}
@@ -0,0 +1,81 @@
+// ScheduleConfig::fromJson against ArduinoJson itself: a full schedule
+// (MAX_TIMES times, every day) must fit the parse documents, in place and
+// from a String, and serialize back to the same JSON
+#include <unity.h>
+#include "HalNative.h"
+#include "ScheduleConfig.h"
+#include <string.h>
+
+using namespace hal::native;
+
+static const char FULL[] =
+    "{\"winding_duration\":45,\"winding_speed\":\"Fast\",\"winding_times\":["
+    "{\"hour\":7,\"minute\":30,\"ampm\":\"AM\",\"enabled\":true},"
+    "{\"hour\":12,\"minute\":0,\"ampm\":\"PM\",\"enabled\":true},"
+    "{\"hour\":6,\"minute\":15,\"ampm\":\"PM\",\"enabled\":false},"
+    "{\"hour\":11,\"minute\":45,\"ampm\":\"PM\",\"enabled\":true}],"
+    "\"days\":{\"Monday\":true,\"Tuesday\":true,\"Wednesday\":true,\"Thursday\":true,"
+    "\"Friday\":true,\"Saturday\":true,\"Sunday\":true}}";
+
+static void assertFull(const ScheduleConfig& sched) {
+    TEST_ASSERT_EQUAL(45, sched.durationMin);
+    TEST_ASSERT_EQUAL_STRING("Fast", sched.speed);
+    TEST_ASSERT_EQUAL(ScheduleConfig::MAX_TIMES, sched.timeCount);
+    TEST_ASSERT_EQUAL(7, sched.times[0].hour24());
+    TEST_ASSERT_EQUAL(12, sched.times[1].hour24());
+    TEST_ASSERT_EQUAL(18, sched.times[2].hour24());
+    TEST_ASSERT_FALSE(sched.times[2].enabled);
+    TEST_ASSERT_EQUAL(23, sched.times[3].hour24());
+    TEST_ASSERT_EQUAL(45, sched.times[3].minute);
+    TEST_ASSERT_EQUAL_HEX8(0x7F, sched.dayMask);
+}
+
+void setUp(void) {
+    reset();
+}
+
+void tearDown(void) {}
+
+void test_full_schedule_parses_in_place(void) {
+    char body[sizeof(FULL)];
+    memcpy(body, FULL, sizeof(FULL));
+    ScheduleConfig sched;
+    TEST_ASSERT_TRUE(sched.fromJson(body));
+    assertFull(sched);
+}
+
+void test_full_schedule_parses_from_string(void) {
+    ScheduleConfig sched;
+    TEST_ASSERT_TRUE(sched.fromJson(String(FULL)));
+    assertFull(sched);
+}
+
+void test_full_schedule_round_trips(void) {
+    ScheduleConfig sched;
+    TEST_ASSERT_TRUE(sched.fromJson(String(FULL)));
+    char out[sizeof(FULL) + 64];
+    JsonStreamWriter json(out, sizeof(out));
+    sched.writeJson(json);
+    out[json.length()] = '\0';
+
+    ScheduleConfig again;
+    TEST_ASSERT_TRUE(again.fromJson(out));
+    assertFull(again);
+}
+
+void test_invalid_json_leaves_schedule_untouched(void) {
+    ScheduleConfig sched;
+    sched.durationMin = 10;
+    char body[] = "{\"winding_duration\":";
+    TEST_ASSERT_FALSE(sched.fromJson(body));
+    TEST_ASSERT_EQUAL(10, sched.durationMin);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_full_schedule_parses_in_place);
+    RUN_TEST(test_full_schedule_parses_from_string);
+    RUN_TEST(test_full_schedule_round_trips);
+    RUN_TEST(test_invalid_json_leaves_schedule_untouched);
+    return UNITY_END();
+}
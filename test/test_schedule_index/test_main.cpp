@@ -0,0 +1,227 @@
+// ScheduleIndex::next() on fixed dates, in UTC and across DST changes, and
+// against the per-day mktime() loop it replaced on randomized schedules
+#include <unity.h>
+#include <time.h>
+#include <random>
+#include <vector>
+#include "ScheduleIndex.h"
+
+static void setTz(const char* tz) {
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+// Local wall-clock time to epoch
+static time_t local(int year, int mon, int mday, int hour, int min) {
+    struct tm t = {};
+    t.tm_year = year - 1900;
+    t.tm_mon = mon - 1;
+    t.tm_mday = mday;
+    t.tm_hour = hour;
+    t.tm_min = min;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
+static ScheduleConfig schedule(uint8_t dayMask, std::initializer_list<ScheduleConfig::WindingTime> times) {
+    ScheduleConfig s;
+    s.dayMask = dayMask;
+    for (const ScheduleConfig::WindingTime& t : times) s.times[s.timeCount++] = t;
+    return s;
+}
+
+void setUp(void) {
+    setTz("UTC0");
+}
+
+void tearDown(void) {}
+
+void test_empty_schedule_has_no_next(void) {
+    ScheduleIndex index;
+    index.build(schedule(0x7F, {{7, 30, false, false}}));
+    TEST_ASSERT_EQUAL(0, index.size());
+    TEST_ASSERT_EQUAL(0, (long)index.next(local(2024, 1, 1, 8, 0)));
+    index.build(schedule(0, {{7, 30, false, true}}));
+    TEST_ASSERT_EQUAL(0, (long)index.next(local(2024, 1, 1, 8, 0)));
+}
+
+void test_daily_time_is_next_day_once_passed(void) {
+    ScheduleIndex index;
+    index.build(schedule(0x7F, {{7, 30, false, true}}));
+    TEST_ASSERT_EQUAL(7, index.size());
+    TEST_ASSERT_EQUAL((long)local(2024, 1, 1, 7, 30), (long)index.next(local(2024, 1, 1, 6, 0)));
+    TEST_ASSERT_EQUAL((long)local(2024, 1, 2, 7, 30), (long)index.next(local(2024, 1, 1, 8, 0)));
+}
+
+void test_next_is_strictly_after_now(void) {
+    ScheduleIndex index;
+    index.build(schedule(0x7F, {{7, 30, false, true}}));
+    TEST_ASSERT_EQUAL((long)local(2024, 1, 2, 7, 30), (long)index.next(local(2024, 1, 1, 7, 30)));
+}
+
+void test_twelve_am_and_pm(void) {
+    ScheduleIndex index;
+    index.build(schedule(0x7F, {{12, 0, false, true}, {12, 15, true, true}}));
+    TEST_ASSERT_EQUAL((long)local(2024, 1, 1, 12, 15), (long)index.next(local(2024, 1, 1, 1, 0)));
+    TEST_ASSERT_EQUAL((long)local(2024, 1, 2, 0, 0), (long)index.next(local(2024, 1, 1, 13, 0)));
+}
+
+void test_weekday_mask_and_week_wrap(void) {
+    ScheduleIndex index;
+    // Sundays only; 2024-01-01 is a Monday
+    index.build(schedule(1 << 0, {{9, 0, false, true}, {6, 45, true, true}}));
+    TEST_ASSERT_EQUAL(1 << 0, index.dayMask());
+    TEST_ASSERT_EQUAL((long)local(2024, 1, 7, 9, 0), (long)index.next(local(2024, 1, 1, 8, 0)));
+    TEST_ASSERT_EQUAL((long)local(2024, 1, 7, 18, 45), (long)index.next(local(2024, 1, 7, 9, 0)));
+    TEST_ASSERT_EQUAL((long)local(2024, 1, 14, 9, 0), (long)index.next(local(2024, 1, 7, 19, 0)));
+}
+
+void test_duplicate_times_collapse(void) {
+    ScheduleIndex index;
+    index.build(schedule(1 << 1, {{8, 0, false, true}, {8, 0, false, true}}));
+    TEST_ASSERT_EQUAL(1, index.size());
+}
+
+// A slot keeps its local time across DST changes (CET/CEST, 2024-03-31
+// and 2024-10-27)
+void test_slot_keeps_local_time_across_dst(void) {
+    setTz("CET-1CEST,M3.5.0,M10.5.0/3");
+    ScheduleIndex index;
+    index.build(schedule(0x7F, {{7, 30, false, true}}));
+    time_t spring = index.next(local(2024, 3, 30, 8, 0));
+    TEST_ASSERT_EQUAL((long)local(2024, 3, 31, 7, 30), (long)spring);
+    TEST_ASSERT_EQUAL(23 * 3600L + 30 * 60L - 3600L, (long)(spring - local(2024, 3, 30, 8, 0)));
+    time_t autumn = index.next(local(2024, 10, 26, 8, 0));
+    TEST_ASSERT_EQUAL((long)local(2024, 10, 27, 7, 30), (long)autumn);
+    TEST_ASSERT_EQUAL(24 * 3600L + 3600L - 30 * 60L, (long)(autumn - local(2024, 10, 26, 8, 0)));
+}
+
+// A slot in the skipped hour (02:30 on 2024-03-31) still fires that day
+// and only once; in the repeated hour the first 02:30 is taken
+void test_slot_in_dst_gap_and_overlap(void) {
+    setTz("CET-1CEST,M3.5.0,M10.5.0/3");
+    ScheduleIndex index;
+    index.build(schedule(0x7F, {{2, 30, false, true}}));
+    time_t now = local(2024, 3, 31, 1, 0);
+    time_t gap = index.next(now);
+    TEST_ASSERT_GREATER_THAN((long)now, (long)gap);
+    TEST_ASSERT_LESS_OR_EQUAL((long)now + 3 * 3600L, (long)gap);
+    TEST_ASSERT_EQUAL((long)local(2024, 4, 1, 2, 30), (long)index.next(gap));
+
+    now = local(2024, 10, 27, 1, 0);  // CEST
+    TEST_ASSERT_EQUAL((long)now + 90 * 60L, (long)index.next(now));
+    // Between the two 02:30s the slot has run and is next due tomorrow,
+    // whichever occurrence mktime() resolves it to
+    now += 2 * 3600L;  // 02:00 CET
+    TEST_ASSERT_EQUAL((long)local(2024, 10, 28, 2, 30), (long)index.next(now));
+}
+
+// The loop updateNextWindingTime() ran before the index: every slot on each
+// of the next 8 days through mktime(). Two changes so it answers the same
+// question: tm_isdst = -1 (the old code kept today's flag, which put every
+// slot past a DST change an hour off), and in a repeated hour the first
+// occurrence, as next() documents.
+static time_t perDayLoop(const ScheduleConfig& sched, time_t now) {
+    struct tm t;
+    localtime_r(&now, &t);
+    time_t soonest = 0;
+    for (int dayOffset = 0; dayOffset < 8; ++dayOffset) {
+        int wday = (t.tm_wday + dayOffset) % 7;
+        if (!sched.dayEnabled(wday)) continue;
+        for (uint8_t i = 0; i < sched.timeCount; i++) {
+            if (!sched.times[i].enabled) continue;
+            struct tm candidate = t;
+            candidate.tm_mday += dayOffset;
+            candidate.tm_hour = sched.times[i].hour24();
+            candidate.tm_min = sched.times[i].minute;
+            candidate.tm_sec = 0;
+            candidate.tm_isdst = -1;
+            time_t candidateEpoch = mktime(&candidate);
+            time_t hourEarlier = candidateEpoch - 3600;
+            struct tm earlier;
+            localtime_r(&hourEarlier, &earlier);
+            if (earlier.tm_hour == candidate.tm_hour && earlier.tm_min == candidate.tm_min) candidateEpoch = hourEarlier;
+            if (candidateEpoch <= now) continue;
+            if (soonest == 0 || candidateEpoch < soonest) soonest = candidateEpoch;
+        }
+    }
+    return soonest;
+}
+
+// Instants where the UTC offset changes, 2020-2026, found hour by hour
+static std::vector<time_t> dstChanges(time_t from, time_t to) {
+    std::vector<time_t> changes;
+    struct tm t;
+    localtime_r(&from, &t);
+    long offset = t.tm_gmtoff;
+    for (time_t at = from; at < to; at += 3600) {
+        localtime_r(&at, &t);
+        if (t.tm_gmtoff != offset) changes.push_back(at);
+        offset = t.tm_gmtoff;
+    }
+    return changes;
+}
+
+// Random schedules and instants in four zones, half of the instants within
+// a day of a DST change. Minutes are often on the hour or half hour so
+// slots land in skipped and repeated hours.
+void test_matches_per_day_loop_on_random_schedules(void) {
+    static const char* zones[] = {
+        "IST-5:30",
+        "EST5EDT,M3.2.0,M11.1.0",
+        "CET-1CEST,M3.5.0,M10.5.0/3",
+        "AEST-10AEDT,M10.1.0,M4.1.0/3",
+    };
+    static const int RUNS_PER_ZONE = 20000;
+    std::mt19937 rng(20240331);
+    const time_t from = 1577836800;  // 2020-01-01 UTC
+    const time_t to = 1798761600;    // 2027-01-01 UTC
+    int checked = 0, mismatches = 0;
+    for (const char* zone : zones) {
+        setTz(zone);
+        std::vector<time_t> changes = dstChanges(from, to);
+        for (int run = 0; run < RUNS_PER_ZONE; run++) {
+            ScheduleConfig sched;
+            sched.dayMask = rng() % 128;
+            sched.timeCount = 1 + rng() % ScheduleConfig::MAX_TIMES;
+            for (uint8_t i = 0; i < sched.timeCount; i++) {
+                static const uint8_t minutes[] = {0, 30};
+                sched.times[i] = {(uint8_t)(1 + rng() % 12), (uint8_t)(rng() % 2 ? minutes[rng() % 2] : rng() % 60),
+                                  rng() % 2 == 0, rng() % 8 != 0};
+            }
+            time_t now;
+            if (!changes.empty() && rng() % 2) {
+                now = changes[rng() % changes.size()] - 26 * 3600 + rng() % (52 * 3600);
+            } else {
+                now = from + rng() % (to - from);
+            }
+            ScheduleIndex index;
+            index.build(sched);
+            time_t expected = perDayLoop(sched, now);
+            time_t actual = index.next(now);
+            checked++;
+            if (actual != expected) {
+                if (mismatches++ < 5) {
+                    printf("  %s now=%ld mask=%02x: expected %ld got %ld\n", zone, (long)now, sched.dayMask,
+                           (long)expected, (long)actual);
+                }
+            }
+        }
+    }
+    printf("  %d randomized checks, %d mismatches\n", checked, mismatches);
+    TEST_ASSERT_EQUAL(0, mismatches);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_schedule_has_no_next);
+    RUN_TEST(test_daily_time_is_next_day_once_passed);
+    RUN_TEST(test_next_is_strictly_after_now);
+    RUN_TEST(test_twelve_am_and_pm);
+    RUN_TEST(test_weekday_mask_and_week_wrap);
+    RUN_TEST(test_duplicate_times_collapse);
+    RUN_TEST(test_slot_keeps_local_time_across_dst);
+    RUN_TEST(test_slot_in_dst_gap_and_overlap);
+    RUN_TEST(test_matches_per_day_loop_on_random_schedules);
+    return UNITY_END();
+}
@@ -0,0 +1,88 @@
+// StaticAssets: the ETag manifest written by scripts/build_fs.py, lookups
+// for If-None-Match, and the headers chosen per file type
+#include <unity.h>
+#include "HalNative.h"
+#include "StaticAssets.h"
+
+using namespace hal::native;
+
+void setUp(void) {
+    reset();
+}
+
+void tearDown(void) {}
+
+void test_manifest_is_loaded(void) {
+    files()[StaticAssets::MANIFEST_PATH] =
+        "/UI/assets/images/Home.png 652bad60cebafa0f\n"
+        "/UI/css/styles.css a4d4b731b67de952\n"
+        "/UI/index.html e0e9aae0002e3892\n";
+    StaticAssets assets;
+    TEST_ASSERT_EQUAL(3, assets.load());
+    TEST_ASSERT_EQUAL_STRING("\"a4d4b731b67de952\"", assets.etag("/UI/css/styles.css"));
+    TEST_ASSERT_EQUAL_STRING("\"e0e9aae0002e3892\"", assets.etag("/UI/index.html"));
+    TEST_ASSERT_NULL(assets.etag("/UI/windnow.html"));
+    TEST_ASSERT_NULL(assets.etag("/UI/css/styles.css.gz"));
+}
+
+void test_missing_manifest_serves_without_etags(void) {
+    StaticAssets assets;
+    TEST_ASSERT_EQUAL(0, assets.load());
+    TEST_ASSERT_NULL(assets.etag("/UI/index.html"));
+}
+
+void test_malformed_lines_are_skipped(void) {
+    std::string longPath = "/UI/" + std::string(StaticAssets::PATH_LEN, 'a') + ".html";
+    files()[StaticAssets::MANIFEST_PATH] =
+        "/UI/no-etag.html\n" +
+        longPath + " 0123456789abcdef\n"
+        "/UI/long-etag.html 0123456789abcdef01\n"
+        "/UI/last.html 0123456789abcdef";  // no final newline
+    StaticAssets assets;
+    TEST_ASSERT_EQUAL(1, assets.load());
+    TEST_ASSERT_EQUAL_STRING("\"0123456789abcdef\"", assets.etag("/UI/last.html"));
+    TEST_ASSERT_NULL(assets.etag("/UI/long-etag.html"));
+}
+
+void test_table_is_capped(void) {
+    std::string manifest;
+    for (int i = 0; i < StaticAssets::MAX_ENTRIES + 4; i++) {
+        manifest += "/UI/page" + std::to_string(i) + ".html 0123456789abcdef\n";
+    }
+    files()[StaticAssets::MANIFEST_PATH] = manifest;
+    StaticAssets assets;
+    TEST_ASSERT_EQUAL(StaticAssets::MAX_ENTRIES, assets.load());
+    TEST_ASSERT_NOT_NULL(assets.etag("/UI/page0.html"));
+    TEST_ASSERT_NULL(assets.etag(("/UI/page" + std::to_string(StaticAssets::MAX_ENTRIES) + ".html").c_str()));
+}
+
+void test_reload_replaces_entries(void) {
+    files()[StaticAssets::MANIFEST_PATH] = "/UI/index.html 1111111111111111\n";
+    StaticAssets assets;
+    assets.load();
+    files()[StaticAssets::MANIFEST_PATH] = "/UI/windnow.html 2222222222222222\n";
+    TEST_ASSERT_EQUAL(1, assets.load());
+    TEST_ASSERT_NULL(assets.etag("/UI/index.html"));
+    TEST_ASSERT_EQUAL_STRING("\"2222222222222222\"", assets.etag("/UI/windnow.html"));
+}
+
+void test_headers_per_file_type(void) {
+    TEST_ASSERT_EQUAL_STRING("text/html", StaticAssets::contentType("/UI/index.html"));
+    TEST_ASSERT_EQUAL_STRING("text/css", StaticAssets::contentType("/UI/css/styles.css"));
+    TEST_ASSERT_EQUAL_STRING("image/png", StaticAssets::contentType("/UI/assets/images/Home.png"));
+    TEST_ASSERT_EQUAL_STRING("text/plain", StaticAssets::contentType("/UI/etags.txt"));
+    // Pages revalidate; versioned assets are cached for good
+    TEST_ASSERT_EQUAL_STRING("no-cache", StaticAssets::cacheControl("/UI/setschedule.html"));
+    TEST_ASSERT_EQUAL_STRING("public, max-age=31536000, immutable", StaticAssets::cacheControl("/UI/css/styles.css"));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_manifest_is_loaded);
+    RUN_TEST(test_missing_manifest_serves_without_etags);
+    RUN_TEST(test_malformed_lines_are_skipped);
+    RUN_TEST(test_table_is_capped);
+    RUN_TEST(test_reload_replaces_entries);
+    RUN_TEST(test_headers_per_file_type);
+    return UNITY_END();
+}
@@ -0,0 +1,113 @@
+// Every step's time against a reference timeline, read off the fake
+// timer1 one microsecond at a time. Timer mode must hit each deadline no
+// matter how long loop() stalls; polled mode is shown for comparison.
+#include <unity.h>
+#include "HalNative.h"
+#include "StepperMotorDriver.h"
+#include "StepScheduler.h"
+#include "CoilOutput.h"
+#include <math.h>
+#include <vector>
+
+using namespace hal::native;
+
+static StepperMotorDriver motorA;
+static StepperMotorDriver motorB;
+
+// Step n (from 1) of a cruise at `periodUs` is due n periods after start
+struct Timeline {
+    std::vector<unsigned long> at;  // µs after start, one per step
+
+    double maxLateUs(double periodUs) const {
+        double worst = 0;
+        for (size_t i = 0; i < at.size(); i++) worst = fmax(worst, at[i] - (i + 1) * periodUs);
+        return worst;
+    }
+    double maxEarlyUs(double periodUs) const {
+        double worst = 0;
+        for (size_t i = 0; i < at.size(); i++) worst = fmax(worst, (i + 1) * periodUs - at[i]);
+        return worst;
+    }
+};
+
+// Runs both motors for `us`, calling loop() (poll) every `loopUs` except
+// during a `stallUs` stall every `stallEveryUs`, and records each step
+static void run(unsigned long us, unsigned long loopUs, unsigned long stallUs, unsigned long stallEveryUs,
+                Timeline& a, Timeline& b) {
+    unsigned long nextLoop = 0;
+    for (unsigned long t = 1; t <= us; t++) {
+        advanceMicros(1);
+        if (t >= nextLoop) {
+            stepScheduler.poll();
+            nextLoop = t + loopUs;
+            if (stallEveryUs && t % stallEveryUs < loopUs) nextLoop += stallUs;
+        }
+        while (a.at.size() < motorA.stepsDone()) a.at.push_back(t);
+        while (b.at.size() < motorB.stepsDone()) b.at.push_back(t);
+    }
+}
+
+static void startBoth(bool timerMode) {
+    motorA.stop();
+    motorB.stop();
+    stepScheduler.setTimerMode(false);
+    reset();
+    stepScheduler.setTimerMode(timerMode);
+    motorA.setStepMode(StepMode::Full);
+    motorB.setStepMode(StepMode::Half);
+    motorA.setAcceleration(0);
+    motorB.setAcceleration(0);
+    motorA.setSpeed(15);  // 60e6 / (15 * 2048) = 1953.125 µs per step
+    motorB.setSpeed(7);   // 60e6 / (7 * 4096) = 2092.634 µs per step
+    motorA.start(1000, true);
+    motorB.start(900, false);
+}
+
+static const double PERIOD_A = 60e6 / (15 * 2048);
+static const double PERIOD_B = 60e6 / (7 * 4096.0);
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// loop() stalls 40 ms every 100 ms, as a TLS handshake or flash write would
+void test_timer_mode_steps_on_every_deadline(void) {
+    startBoth(true);
+    Timeline a, b;
+    run(2100000, 1000, 40000, 100000, a, b);
+    TEST_ASSERT_EQUAL(1000, (int)a.at.size());
+    TEST_ASSERT_EQUAL(900, (int)b.at.size());
+    // Never late; early only by the batching window that shares one port write
+    TEST_ASSERT_TRUE(a.maxLateUs(PERIOD_A) < 1.0);
+    TEST_ASSERT_TRUE(b.maxLateUs(PERIOD_B) < 1.0);
+    TEST_ASSERT_TRUE(a.maxEarlyUs(PERIOD_A) <= StepScheduler::BATCH_WINDOW_US);
+    TEST_ASSERT_TRUE(b.maxEarlyUs(PERIOD_B) <= StepScheduler::BATCH_WINDOW_US);
+    char line[120];
+    snprintf(line, sizeof(line), "timer mode: max late %.2f / %.2f us, max early %.2f / %.2f us",
+             a.maxLateUs(PERIOD_A), b.maxLateUs(PERIOD_B), a.maxEarlyUs(PERIOD_A), b.maxEarlyUs(PERIOD_B));
+    TEST_MESSAGE(line);
+}
+
+// The same stalls in polled mode: steps wait for loop() and then catch up
+void test_polled_mode_is_late_by_the_stall(void) {
+    startBoth(false);
+    Timeline a, b;
+    run(2200000, 1000, 40000, 100000, a, b);
+    TEST_ASSERT_EQUAL(1000, (int)a.at.size());
+    TEST_ASSERT_EQUAL(900, (int)b.at.size());
+    TEST_ASSERT_TRUE(a.maxLateUs(PERIOD_A) > 30000);
+    TEST_ASSERT_TRUE(a.maxLateUs(PERIOD_A) < 41000 + PERIOD_A);
+    char line[120];
+    snprintf(line, sizeof(line), "polled mode: max late %.0f / %.0f us", a.maxLateUs(PERIOD_A), b.maxLateUs(PERIOD_B));
+    TEST_MESSAGE(line);
+}
+
+int main() {
+    coilOutput.attachPins(0, 5, 4, 14, 12);
+    coilOutput.attachPins(1, 13, 15, 2, 0);
+    stepScheduler.add(motorA);
+    stepScheduler.add(motorB);
+    UNITY_BEGIN();
+    RUN_TEST(test_timer_mode_steps_on_every_deadline);
+    RUN_TEST(test_polled_mode_is_late_by_the_stall);
+    return UNITY_END();
+}
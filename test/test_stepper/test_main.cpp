@@ -0,0 +1,171 @@
+// StepperMotorDriver programs stepped by StepScheduler from the fake
+// timer1 in HalNative: step counts, cruise timing, dwells and stop().
+#include <unity.h>
+#include "HalNative.h"
+#include "StepperMotorDriver.h"
+#include "StepScheduler.h"
+#include "CoilOutput.h"
+
+using namespace hal::native;
+
+static StepperMotorDriver motor;
+static const uint32_t COIL_MASK = (1UL << 5) | (1UL << 4) | (1UL << 14) | (1UL << 12);
+
+// Runs the fake clock in 10 ms slices until the program ends
+static unsigned long runToEnd(unsigned long limitMs) {
+    unsigned long ms = 0;
+    while (motor.isRunning() && ms < limitMs) {
+        advanceMicros(10000);
+        stepScheduler.poll();
+        ms += 10;
+    }
+    stepScheduler.poll();  // finishMove(): release
+    return ms;
+}
+
+void setUp(void) {
+    motor.stop();
+    stepScheduler.setTimerMode(false);
+    reset();
+    stepScheduler.setTimerMode(true);
+    motor.setStepMode(StepMode::Full);
+    motor.setAcceleration(0);
+    motor.setSpeed(15);
+}
+
+void tearDown(void) {}
+
+void test_move_makes_requested_steps_and_releases(void) {
+    motor.start(200, true);
+    TEST_ASSERT_TRUE(motor.isRunning());
+    TEST_ASSERT_EQUAL_UINT32(200, motor.totalSteps());
+    runToEnd(5000);
+    TEST_ASSERT_FALSE(motor.isRunning());
+    TEST_ASSERT_EQUAL_UINT32(200, motor.stepsDone());
+    TEST_ASSERT_FALSE(motor.stoppedEarly());
+    TEST_ASSERT_EQUAL_UINT32(0, gpioPort() & COIL_MASK);
+}
+
+// 15 RPM full step is 1953.125 µs per step; the fraction is carried, so
+// step n is due at n * 1953.125 µs with no drift
+void test_cruise_steps_on_exact_deadlines(void) {
+    const uint32_t steps = 1024;
+    motor.start(steps, true);
+    unsigned long last = (unsigned long)(steps * 1953.125);
+    advanceMicros(last - 1);
+    TEST_ASSERT_EQUAL_UINT32(steps - 1, motor.stepsDone());
+    advanceMicros(1);
+    TEST_ASSERT_EQUAL_UINT32(steps, motor.stepsDone());
+    TEST_ASSERT_FALSE(motor.isRunning());
+    StepTimingStats::Summary stats;
+    motor.timingStats().summarize(stats);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.maxUs);  // timer mode steps on the deadline
+}
+
+void test_ramp_starts_slower_than_cruise(void) {
+    motor.setAcceleration(1000);
+    motor.start(400, true);
+    advanceMicros(10 * 1953);
+    TEST_ASSERT_LESS_THAN(10, motor.stepsDone());
+    runToEnd(10000);
+    TEST_ASSERT_EQUAL_UINT32(400, motor.stepsDone());
+}
+
+void test_half_step_doubles_steps_per_rev(void) {
+    motor.setStepMode(StepMode::Half);
+    TEST_ASSERT_EQUAL(4096, motor.stepsPerRev());
+    motor.runForDuration(0.1f, 10, true);
+    TEST_ASSERT_EQUAL_UINT32(4096, motor.totalSteps());
+    runToEnd(10000);
+    TEST_ASSERT_EQUAL_UINT32(4096, motor.stepsDone());
+}
+
+// Whole CW/CCW minute cycles plus a shorter tail: the motion adds up to
+// the requested duration, the rests come on top
+void test_alternating_motion_matches_duration(void) {
+    motor.runAlternatingForDuration(5.5f, 15, 10000);
+    TEST_ASSERT_EQUAL_UINT32(15 * 2048 * 11 / 2, motor.totalSteps());
+    unsigned long ms = runToEnd(20 * 60000UL);
+    TEST_ASSERT_EQUAL_UINT32(15 * 2048 * 11 / 2, motor.stepsDone());
+    // 5.5 min of motion and 5 rests of 10 s (two per cycle, one in the tail)
+    TEST_ASSERT_UINT32_WITHIN(20, 330000 + 50000, ms);
+}
+
+void test_short_alternating_run_is_one_cycle(void) {
+    motor.runAlternatingForDuration(1.0f, 10, 0);
+    TEST_ASSERT_EQUAL_UINT32(10 * 2048, motor.totalSteps());
+    runToEnd(5 * 60000UL);
+    TEST_ASSERT_EQUAL_UINT32(10 * 2048, motor.stepsDone());
+}
+
+// A dwell longer than 2^32 µs (~71.6 min) must not wrap
+void test_long_dwell_is_not_truncated(void) {
+    motor.clearProgram();
+    TEST_ASSERT_TRUE(motor.queueDwell(100 * 60000UL));
+    TEST_ASSERT_TRUE(motor.queueMove(10, 15, true));
+    TEST_ASSERT_TRUE(motor.startProgram(1));
+    advanceMicros(99 * 60000000UL);
+    TEST_ASSERT_TRUE(motor.isRunning());
+    TEST_ASSERT_EQUAL_UINT32(0, motor.stepsDone());
+    unsigned long ms = runToEnd(2 * 60000UL);
+    TEST_ASSERT_EQUAL_UINT32(10, motor.stepsDone());
+    TEST_ASSERT_UINT32_WITHIN(10, 60020, ms);  // the last minute of dwell, then 10 steps
+}
+
+// A program repeated until stop() has no total or ETA, even with a tail
+void test_endless_program_has_no_totals(void) {
+    motor.clearProgram();
+    TEST_ASSERT_TRUE(motor.queueMove(100, 15, true));
+    TEST_ASSERT_TRUE(motor.queueMove(50, 15, false));
+    TEST_ASSERT_TRUE(motor.startProgram(0, 1));
+    TEST_ASSERT_EQUAL_UINT32(0, motor.totalSteps());
+    advanceMicros(500000);
+    TEST_ASSERT_TRUE(motor.isRunning());
+    TEST_ASSERT_EQUAL_UINT32(0, motor.stepsLeft());
+    TEST_ASSERT_EQUAL_UINT32(0, motor.secondsLeft());
+    advanceMicros(1000000);
+    TEST_ASSERT_TRUE(motor.stepsDone() > 100);  // the first move repeats
+    TEST_ASSERT_TRUE(motor.isRunning());
+    motor.stop();
+}
+
+void test_stop_ends_program_early(void) {
+    motor.start(2000, true);
+    advanceMicros(100000);
+    motor.stop();
+    TEST_ASSERT_FALSE(motor.isRunning());
+    TEST_ASSERT_TRUE(motor.stoppedEarly());
+    uint32_t done = motor.stepsDone();
+    TEST_ASSERT_UINT32_WITHIN(1, 51, done);
+    advanceMicros(100000);
+    TEST_ASSERT_EQUAL_UINT32(done, motor.stepsDone());
+    TEST_ASSERT_EQUAL_UINT32(0, gpioPort() & COIL_MASK);
+}
+
+// Polled stepping catches up on steps missed while loop() was busy
+void test_polled_mode_catches_up(void) {
+    stepScheduler.setTimerMode(false);
+    motor.start(100, true);
+    advanceMicros(20 * 1953 + 1000);  // loop() stalled for 20 steps
+    stepScheduler.poll();
+    TEST_ASSERT_EQUAL_UINT32(20, motor.stepsDone());
+    runToEnd(5000);
+    TEST_ASSERT_EQUAL_UINT32(100, motor.stepsDone());
+}
+
+int main() {
+    coilOutput.attachPins(0, 5, 4, 14, 12);  // D1, D2, D5, D6
+    stepScheduler.add(motor);
+    UNITY_BEGIN();
+    RUN_TEST(test_move_makes_requested_steps_and_releases);
+    RUN_TEST(test_cruise_steps_on_exact_deadlines);
+    RUN_TEST(test_ramp_starts_slower_than_cruise);
+    RUN_TEST(test_half_step_doubles_steps_per_rev);
+    RUN_TEST(test_alternating_motion_matches_duration);
+    RUN_TEST(test_short_alternating_run_is_one_cycle);
+    RUN_TEST(test_long_dwell_is_not_truncated);
+    RUN_TEST(test_endless_program_has_no_totals);
+    RUN_TEST(test_stop_ends_program_early);
+    RUN_TEST(test_polled_mode_catches_up);
+    return UNITY_END();
+}
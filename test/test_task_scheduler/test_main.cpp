@@ -0,0 +1,145 @@
+// TaskScheduler: ordering, fixed-rate periods, wall-clock tasks and a
+// clock step, driven by the fake millis()/now()
+#include <unity.h>
+#include "HalNative.h"
+#include "TaskScheduler.h"
+#include <limits.h>
+#include <string>
+
+using namespace hal::native;
+
+static std::string trace;
+static unsigned long runsAtMs[16];
+static int runs;
+
+static void taskA() { trace += 'A'; }
+static void taskB() { trace += 'B'; }
+static void taskC() { trace += 'C'; }
+static void periodic() {
+    if (runs < 16) runsAtMs[runs] = hal::millis();
+    runs++;
+}
+
+static void advanceMs(unsigned long ms) { advanceMicros(ms * 1000UL); }
+
+void setUp(void) {
+    reset();
+    trace.clear();
+    runs = 0;
+}
+
+void tearDown(void) {}
+
+void test_one_shots_run_in_deadline_order(void) {
+    TaskScheduler s;
+    s.after(300, taskC);
+    s.after(100, taskA);
+    s.after(200, taskB);
+    TEST_ASSERT_EQUAL_UINT32(100, s.msUntilNext());
+    advanceMs(99);
+    s.run();
+    TEST_ASSERT_EQUAL_STRING("", trace.c_str());
+    advanceMs(300);
+    s.run();
+    TEST_ASSERT_EQUAL_STRING("ABC", trace.c_str());
+    TEST_ASSERT_EQUAL(0, s.size());
+    TEST_ASSERT_EQUAL_UINT32(ULONG_MAX, s.msUntilNext());
+}
+
+void test_cancel_removes_task(void) {
+    TaskScheduler s;
+    TaskScheduler::TaskId a = s.after(100, taskA);
+    s.after(100, taskB);
+    s.cancel(a);
+    TEST_ASSERT_EQUAL(TaskScheduler::NONE, a);
+    s.cancel(a);  // cancelling twice is harmless
+    advanceMs(100);
+    s.run();
+    TEST_ASSERT_EQUAL_STRING("B", trace.c_str());
+}
+
+void test_every_keeps_fixed_rate(void) {
+    TaskScheduler s;
+    s.every(1000, periodic);
+    for (int i = 0; i < 10; i++) {
+        advanceMs(1000 + (i % 3) * 7);  // loop() passes a little late
+        s.run();
+    }
+    TEST_ASSERT_EQUAL(10, runs);
+    // Lateness does not accumulate: deadlines stay on the 1 s grid
+    TEST_ASSERT_EQUAL_UINT32(11000, s.msUntilNext() + hal::millis());
+}
+
+void test_every_does_not_burst_after_a_stall(void) {
+    TaskScheduler s;
+    s.every(1000, periodic);
+    advanceMs(5500);
+    s.run();
+    TEST_ASSERT_EQUAL(1, runs);
+    TEST_ASSERT_EQUAL_UINT32(1000, s.msUntilNext());
+}
+
+void test_at_waits_for_wall_clock(void) {
+    setEpoch(1700000000);
+    TaskScheduler s;
+    s.at(1700000060, taskA);
+    TEST_ASSERT_EQUAL_UINT32(60000, s.msUntilNext());
+    advanceMs(59999);
+    s.run();
+    TEST_ASSERT_EQUAL_STRING("", trace.c_str());
+    advanceMs(1);
+    s.run();
+    TEST_ASSERT_EQUAL_STRING("A", trace.c_str());
+}
+
+void test_far_at_is_capped_and_rechecked(void) {
+    setEpoch(1700000000);
+    TaskScheduler s;
+    const time_t week = 7 * 24 * 3600;
+    s.at(1700000000 + week + 3600, taskA);
+    TEST_ASSERT_EQUAL_UINT32(week * 1000UL, s.msUntilNext());
+    advanceMs(week * 1000UL);
+    s.run();
+    TEST_ASSERT_EQUAL_STRING("", trace.c_str());
+    TEST_ASSERT_EQUAL_UINT32(3600000UL, s.msUntilNext());
+}
+
+void test_clock_step_rearms_wall_clock_tasks(void) {
+    setEpoch(1700000000);
+    TaskScheduler s;
+    s.at(1700003600, taskA);
+    s.after(1800000, taskB);
+    // SNTP steps the clock forward 50 minutes
+    setEpoch(1700003000);
+    s.clockChanged();
+    s.run();
+    TEST_ASSERT_EQUAL_UINT32(600000, s.msUntilNext());
+    advanceMs(600000);
+    s.run();
+    TEST_ASSERT_EQUAL_STRING("A", trace.c_str());
+    advanceMs(1200000);
+    s.run();
+    TEST_ASSERT_EQUAL_STRING("AB", trace.c_str());
+}
+
+void test_full_table_returns_none(void) {
+    TaskScheduler s;
+    for (int i = 0; i < TaskScheduler::MAX_TASKS; i++) TEST_ASSERT_NOT_EQUAL(TaskScheduler::NONE, s.after(10, taskA));
+    TEST_ASSERT_EQUAL(TaskScheduler::NONE, s.after(10, taskB));
+    advanceMs(10);
+    s.run();
+    TEST_ASSERT_EQUAL(TaskScheduler::MAX_TASKS, (int)trace.size());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_one_shots_run_in_deadline_order);
+    RUN_TEST(test_cancel_removes_task);
+    RUN_TEST(test_every_keeps_fixed_rate);
+    RUN_TEST(test_every_does_not_burst_after_a_stall);
+    RUN_TEST(test_at_waits_for_wall_clock);
+    RUN_TEST(test_far_at_is_capped_and_rechecked);
+    RUN_TEST(test_clock_step_rearms_wall_clock_tasks);
+    RUN_TEST(test_full_table_returns_none);
+    return UNITY_END();
+}